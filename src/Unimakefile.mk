@@ -35,7 +35,7 @@ LEX = flex
 
 # Generated program and used flags
 PROGRAMS = rulewall
-rulewall_SOURCES   = $(SOURCES_ALL)
+rulewall_SOURCES   = $(filter-out bench.c,$(SOURCES_ALL))
 rulewall_CFLAGS    = -ansi -pedantic
 rulewall_CPPFLAGS  = -D_POSIX_SOURCE -D_BSD_SOURCE -I.
 rulewall_LEXFLAGS  = -p -p -s
@@ -0,0 +1,873 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/astcache.c
+ *
+ * Description: Compiled Configuration Cache
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* ./configure result */
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+/* System headers */
+#include <stdlib.h> /* NULL, malloc(), realloc(), free(), qsort()    */
+#include <stdio.h>  /* FILE *, fopen(), fread(), fwrite(), rename() */
+#include <string.h> /* strlen(), strcmp()                            */
+#if HAVE_MMAP
+#include <sys/types.h> /* size_t, off_t      */
+#include <sys/stat.h>  /* fstat(), S_ISREG() */
+#include <sys/mman.h>  /* mmap(), munmap()   */
+#endif /* HAVE_MMAP */
+
+/* Local headers */
+#include "structs.h"
+#include "memory.h"
+#include "hashtab.h"
+#include "intern.h"
+#include "services.h"
+#include "astcache.h"
+
+
+/*****************************************************************************
+ *
+ * Local Datatypes and Variables
+ *
+ */
+
+/*
+ * The cache is made of unsigned integers, in the byte order of the machine
+ * which wrote it (checked by the magic number):
+ *   - the header (HDR_* words), with the hashes of the services known
+ *     since the port names are resolved while parsing;
+ *   - one record per file (FILE_* words), the given ones first, in order,
+ *     then the included ones;
+ *   - the chains, each being its name, its source ID then its action, the
+ *     actions, expressions and conditions being written in prefix order,
+ *     each one with its source ID after its type;
+ *   - the strings, each one written once, referred to by their offset.
+ * Nothing in it depends on where it is loaded.
+ */
+
+/* Magic number ("RWC3") */
+#define MAGIC 0x52574333U
+
+/* Header words */
+enum {
+    HDR_MAGIC,   /* Magic number                   */
+    HDR_WORD,    /* Size of a word                 */
+    HDR_TOPS,    /* Number of given files          */
+    HDR_FILES,   /* Number of files, included      */
+    HDR_CHAINS,  /* Number of chains               */
+    HDR_NODES,   /* Number of words of the nodes   */
+    HDR_STRINGS, /* Size of the strings            */
+    HDR_SRV1,    /* FNV-1a hash of the services    */
+    HDR_SRV2,    /* Bernstein hash of the services */
+    HDR_SIZE
+};
+
+/* File record words */
+enum {
+    FILE_NAME,  /* Name (string offset)  */
+    FILE_SIZE,  /* Size of the content   */
+    FILE_HASH1, /* FNV-1a hash           */
+    FILE_HASH2, /* Bernstein hash        */
+    FILE_RECORD
+};
+
+/* Size of the blocks read when hashing a file */
+#define BLOCK_SIZE 65536
+
+/* Words being written */
+struct words {
+    unsigned *data;    /* Words          */
+    size_t nb, max;    /* Used and total */
+};
+
+/* Names of the parsed files */
+struct names {
+    const char **data; /* Names          */
+    size_t nb, max;    /* Used and total */
+};
+
+/* Nodes being read from the cache */
+struct reader {
+    const unsigned *pos, *end; /* Next word and end of the nodes */
+    const char *strings;       /* Strings                        */
+    size_t size;               /* Size of the strings            */
+    struct chain **chains;     /* Chains, by index               */
+    unsigned nb_chains;        /* Number of chains               */
+};
+
+/* Loaded cache */
+static unsigned *cache = NULL;
+static size_t cache_size;
+#if HAVE_MMAP
+static enum bool cache_mapped;
+#endif /* HAVE_MMAP */
+
+/* Prototypes */
+static char *cache_name(const char *const *names, unsigned nb);
+static enum bool hash_file(const char *name, unsigned *record);
+static enum bool add_word(struct words *words, unsigned word);
+static enum bool add_string(struct itn_strings *strings,
+			    const char *string, struct words *words);
+static enum bool add_file(const char *name, void *data);
+static int cmp_name(const void *a, const void *b);
+static enum bool write_action(const struct action *action,
+			      struct words *words, struct itn_strings *strings,
+			      const struct itn_chains *chains);
+static enum bool write_expr(const struct expr *expr, struct words *words,
+			    struct itn_strings *strings);
+static enum bool write_condition(const struct condition *cond,
+				 struct words *words,
+				 struct itn_strings *strings);
+static enum bool read_cache(const char *name);
+static enum bool check_files(const char *const *names, unsigned nb);
+static enum bool get_word(struct reader *reader, unsigned *word,
+			  unsigned max);
+static enum bool get_string(struct reader *reader, char **string);
+static struct action *read_action(struct reader *reader);
+static struct expr *read_expr(struct reader *reader);
+static struct condition *read_condition(struct reader *reader);
+
+
+/*****************************************************************************
+ *
+ * Global Functions
+ *
+ */
+
+/*
+ * Load the configuration compiled from the given files, if none of them
+ * (nor the files they include) changed since; return NULL otherwise
+ */
+struct chain *ast_load(const char *const *const names, const unsigned nb)
+{
+    struct reader reader;
+    struct chain *config = NULL, **tail = &config;
+    const char **files;
+    char *name;
+    unsigned i;
+
+    if ((name = cache_name(names, nb)) == NULL)
+	return NULL;
+    if (read_cache(name) == FALSE) {
+	free(name);
+	return NULL;
+    }
+    free(name);
+    if (check_files(names, nb) == FALSE) {
+	ast_free();
+	return NULL;
+    }
+
+    /* The source IDs refer to the files in the order of their records */
+    reader.strings = (const char *) cache + cache_size
+		     - cache[HDR_STRINGS];
+    if ((files = malloc(sizeof(char *) * (cache[HDR_FILES] + 1))) == NULL) {
+	ast_free();
+	return NULL;
+    }
+    for (i = 0; i < cache[HDR_FILES]; i++)
+	files[i] = reader.strings
+		   + cache[HDR_SIZE + FILE_RECORD * i + FILE_NAME];
+    if (set_sources(files, cache[HDR_FILES]) == FALSE) {
+	free(files);
+	ast_free();
+	return NULL;
+    }
+    free(files);
+
+    /* Create the chains first, so that they can be referred to */
+    reader.size = cache[HDR_STRINGS];
+    reader.pos = cache + HDR_SIZE + FILE_RECORD * cache[HDR_FILES];
+    reader.end = reader.pos + cache[HDR_NODES];
+    reader.nb_chains = cache[HDR_CHAINS];
+    if ((reader.chains = malloc(sizeof(struct chain *)
+				* (reader.nb_chains + 1))) == NULL) {
+	ast_free();
+	return NULL;
+    }
+    for (i = 0; i < reader.nb_chains; i++) {
+	if ((*tail = reader.chains[i]
+	     = mem_alloc(sizeof(struct chain))) == NULL)
+	    break;
+	reader.chains[i]->next = NULL;
+	reader.chains[i]->action = NULL;
+	tail = &reader.chains[i]->next;
+    }
+
+    /* Then their actions */
+    if (i == reader.nb_chains)
+	for (i = 0; i < reader.nb_chains; i++)
+	    if (get_string(&reader, &reader.chains[i]->name) == FALSE
+		|| get_word(&reader, &reader.chains[i]->src, ~0U) == FALSE
+		|| (reader.chains[i]->action = read_action(&reader)) == NULL)
+		break;
+    free(reader.chains);
+
+    if (i != reader.nb_chains || reader.pos != reader.end) {
+	free_chain(config);
+	ast_free();
+	return NULL;
+    }
+    return config;
+}
+
+/*
+ * Write the configuration compiled from the given files next to the first
+ * one, keyed by the content of all the parsed files (unless one of them is
+ * the standard input)
+ */
+enum bool ast_save(const struct chain *const config,
+		   const char *const *const names, const unsigned nb)
+{
+    struct words files = { NULL, 0, 0 }, nodes = { NULL, 0, 0 };
+    struct itn_strings strings = { NULL, 0, 0, { NULL, 0, 0 } };
+    struct names included = { NULL, 0, 0 };
+    struct itn_chains chains = { { NULL, 0, 0 }, NULL };
+    const struct chain *chain;
+    unsigned header[HDR_SIZE], nb_chains = 0, nb_files, i, j;
+    enum bool res = FALSE;
+    char *name, *temp = NULL;
+    const char *file;
+    FILE *out;
+
+    /* Standard input is never cached */
+    for (i = 0; i < nb; i++)
+	if (names[i][0] == '-' && names[i][1] == '\0')
+	    return TRUE;
+    if ((name = cache_name(names, nb)) == NULL)
+	return FALSE;
+
+    /* Included files, sorted and each one once */
+    if (list_files(add_file, &included) == FALSE)
+	goto end;
+    if (included.nb != 0)
+	qsort(included.data, included.nb, sizeof(char *), cmp_name);
+    for (i = j = 0; i < included.nb; i++) {
+	if (j != 0 && strcmp(included.data[i], included.data[j - 1]) == 0)
+	    continue;
+	for (nb_files = 0; nb_files < nb; nb_files++)
+	    if (strcmp(included.data[i], names[nb_files]) == 0)
+		break;
+	if (nb_files == nb)
+	    included.data[j++] = included.data[i];
+    }
+    nb_files = nb + j;
+
+    /* File records */
+    for (i = 0; i < nb_files; i++) {
+	file = i < nb ? names[i] : included.data[i - nb];
+	if (add_string(&strings, file, &files) == FALSE
+	    || add_word(&files, 0) == FALSE || add_word(&files, 0) == FALSE
+	    || add_word(&files, 0) == FALSE
+	    || hash_file(file, files.data + files.nb - FILE_RECORD) == FALSE)
+	    goto end;
+    }
+
+    /* Chains, indexed to write the user-defined targets */
+    for (chain = config; chain != NULL; chain = chain->next)
+	nb_chains++;
+    if (itn_chains(&chains, config) == FALSE)
+	goto end;
+    for (chain = config; chain != NULL; chain = chain->next)
+	if (add_string(&strings, chain->name, &nodes) == FALSE
+	    || add_word(&nodes, chain->src) == FALSE
+	    || write_action(chain->action, &nodes, &strings,
+			    &chains) == FALSE)
+	    goto end;
+
+    /* Header, the strings being padded to a whole number of words */
+    header[HDR_MAGIC] = MAGIC;
+    header[HDR_WORD] = sizeof(unsigned);
+    header[HDR_TOPS] = nb;
+    header[HDR_FILES] = nb_files;
+    header[HDR_CHAINS] = nb_chains;
+    header[HDR_NODES] = (unsigned) nodes.nb;
+    header[HDR_STRINGS] = (unsigned) ((strings.len + sizeof(unsigned) - 1)
+				      / sizeof(unsigned) * sizeof(unsigned));
+    srv_hash(header + HDR_SRV1, header + HDR_SRV2);
+
+    /* Write a new file, then replace the old one */
+    if ((temp = malloc(strlen(name) + 2)) == NULL)
+	goto end;
+    strcpy(temp, name);
+    strcat(temp, "~");
+    if ((out = fopen(temp, "wb")) == NULL)
+	goto end;
+    res = fwrite(header, sizeof(unsigned), HDR_SIZE, out) == HDR_SIZE
+	  && fwrite(files.data, sizeof(unsigned), files.nb, out) == files.nb
+	  && fwrite(nodes.data, sizeof(unsigned), nodes.nb, out) == nodes.nb
+	  && fwrite(strings.data, 1, strings.len, out) == strings.len
+	  && fwrite("\0\0\0\0\0\0\0", 1, header[HDR_STRINGS] - strings.len,
+		    out) == header[HDR_STRINGS] - strings.len
+	  ? TRUE : FALSE;
+    if (fclose(out) != 0)
+	res = FALSE;
+    if (res == FALSE || rename(temp, name) != 0) {
+	remove(temp);
+	res = FALSE;
+    }
+
+ end:
+    free(temp);
+    itn_free_chains(&chains);
+    free(included.data);
+    itn_free_strings(&strings, TRUE);
+    free(nodes.data);
+    free(files.data);
+    free(name);
+    return res;
+}
+
+/*
+ * Release the loaded cache, once the strings of its configuration aren't
+ * used anymore
+ */
+void ast_free(void)
+{
+    if (cache == NULL)
+	return;
+
+#if HAVE_MMAP
+    if (cache_mapped == TRUE)
+	munmap(cache, cache_size);
+    else
+#endif /* HAVE_MMAP */
+	free(cache);
+    cache = NULL;
+}
+
+
+/*****************************************************************************
+ *
+ * Local Functions
+ *
+ */
+
+/*
+ * Make the name of the cache file, none being used for standard input
+ */
+static char *cache_name(const char *const *const names, const unsigned nb)
+{
+    char *name;
+    unsigned i;
+
+    for (i = 0; i < nb; i++)
+	if (names[i][0] == '-' && names[i][1] == '\0')
+	    return NULL;
+
+    if (nb == 0 || (name = malloc(strlen(names[0])
+				  + sizeof(AST_SUFFIX))) == NULL)
+	return NULL;
+    strcpy(name, names[0]);
+    strcat(name, AST_SUFFIX);
+    return name;
+}
+
+/*
+ * Fill the size and the hashes of the content of a file in its record
+ */
+static enum bool hash_file(const char *const name, unsigned *const record)
+{
+    unsigned char *block;
+    unsigned long size = 0, hash1 = HASH_FNV_SEED, hash2 = HASH_SEED;
+    size_t nb, i;
+    FILE *file;
+
+    if ((file = fopen(name, "rb")) == NULL)
+	return FALSE;
+    if ((block = malloc(BLOCK_SIZE)) == NULL) {
+	fclose(file);
+	return FALSE;
+    }
+
+    while ((nb = fread(block, 1, BLOCK_SIZE, file)) != 0) {
+	for (i = 0; i < nb; i++) {
+	    hash1 = HASH_FNV_MIX(hash1, block[i]);
+	    hash2 = HASH_MIX(hash2, block[i]);
+	}
+	size += nb;
+    }
+
+    free(block);
+    if (ferror(file)) {
+	fclose(file);
+	return FALSE;
+    }
+    fclose(file);
+
+    record[FILE_SIZE] = (unsigned) size;
+    record[FILE_HASH1] = (unsigned) hash1;
+    record[FILE_HASH2] = (unsigned) hash2;
+    return TRUE;
+}
+
+/*
+ * Append a word, growing the array as needed
+ */
+static enum bool add_word(struct words *const words, const unsigned word)
+{
+    unsigned *data;
+    size_t max;
+
+    if (words->nb == words->max) {
+	max = words->max == 0 ? 1024 : words->max * 2;
+	if ((data = realloc(words->data, sizeof(unsigned) * max)) == NULL)
+	    return FALSE;
+	words->data = data;
+	words->max = max;
+    }
+
+    words->data[words->nb++] = word;
+    return TRUE;
+}
+
+/*
+ * Append the offset of a string, adding it to the strings if new
+ */
+static enum bool add_string(struct itn_strings *const strings,
+			    const char *const string,
+			    struct words *const words)
+{
+    unsigned offset;
+
+    return itn_string(strings, string, &offset) == TRUE
+	   && add_word(words, offset) == TRUE ? TRUE : FALSE;
+}
+
+/*
+ * Add the name of a parsed file to an array
+ */
+static enum bool add_file(const char *const name, void *const data)
+{
+    struct names *const names = data;
+    const char **array;
+    size_t max;
+
+    if (names->nb == names->max) {
+	max = names->max == 0 ? 64 : names->max * 2;
+	if ((array = realloc(names->data, sizeof(char *) * max)) == NULL)
+	    return FALSE;
+	names->data = array;
+	names->max = max;
+    }
+
+    names->data[names->nb++] = name;
+    return TRUE;
+}
+
+/*
+ * Compare two file names, for qsort()
+ */
+static int cmp_name(const void *const a, const void *const b)
+{
+    return strcmp(*(const char *const *) a, *(const char *const *) b);
+}
+
+/*
+ * Write an action and what it contains
+ */
+static enum bool write_action(const struct action *const action,
+			      struct words *const words,
+			      struct itn_strings *const strings,
+			      const struct itn_chains *const chains)
+{
+    unsigned index;
+
+    if (add_word(words, (unsigned) action->type) == FALSE
+	|| add_word(words, action->src) == FALSE)
+	return FALSE;
+
+    switch (action->type) {
+    case TARGET_FINAL:
+	return add_word(words, (unsigned) action->action.final);
+
+    case TARGET_USER:
+	if ((index = itn_chain(chains, action->action.user)) == ITN_NONE)
+	    return FALSE;
+	return add_word(words, index);
+
+    case TARGET_TEST:
+	return add_word(words, action->action.test->src) == TRUE
+	       && write_expr(action->action.test->expr, words, strings) == TRUE
+	       && write_action(action->action.test->act_then, words, strings,
+			       chains) == TRUE
+	       && write_action(action->action.test->act_else, words, strings,
+			       chains) == TRUE ? TRUE : FALSE;
+    }
+
+    return FALSE;
+}
+
+/*
+ * Write an expression and its operands
+ */
+static enum bool write_expr(const struct expr *const expr,
+			    struct words *const words,
+			    struct itn_strings *const strings)
+{
+    if (add_word(words, (unsigned) expr->type) == FALSE
+	|| add_word(words, expr->src) == FALSE
+	|| add_word(words, (unsigned) expr->not) == FALSE)
+	return FALSE;
+
+    if (expr->type == EXPR_COND)
+	return write_condition(expr->sub.cond, words, strings);
+    return write_expr(expr->sub.expr.left, words, strings) == TRUE
+	   && write_expr(expr->sub.expr.right, words, strings) == TRUE
+	   ? TRUE : FALSE;
+}
+
+/*
+ * Write a condition: its type, source ID, direction, protocol, then its list
+ */
+static enum bool write_condition(const struct condition *const cond,
+				 struct words *const words,
+				 struct itn_strings *const strings)
+{
+    const struct addr *addr;
+    const struct port *port;
+    unsigned nb = 0;
+
+    if (cond->type == COND_ADDR)
+	for (addr = cond->cond.addr; addr != NULL; addr = addr->next)
+	    nb++;
+    else
+	for (port = cond->cond.port; port != NULL; port = port->next)
+	    nb++;
+    if (add_word(words, (unsigned) cond->type) == FALSE
+	|| add_word(words, cond->src) == FALSE
+	|| add_word(words, (unsigned) cond->dir) == FALSE
+	|| add_word(words, (unsigned) cond->proto) == FALSE
+	|| add_word(words, nb) == FALSE)
+	return FALSE;
+
+    if (cond->type == COND_ADDR) {
+	for (addr = cond->cond.addr; addr != NULL; addr = addr->next)
+	    if (add_string(strings, addr->string, words) == FALSE)
+		return FALSE;
+	return TRUE;
+    }
+
+    for (port = cond->cond.port; port != NULL; port = port->next) {
+	if (add_word(words, (unsigned) port->type) == FALSE)
+	    return FALSE;
+	if (port->type == PORT_NAME) {
+	    if (add_string(strings, port->port.name, words) == FALSE)
+		return FALSE;
+	} else if (add_word(words, port->port.range.from) == FALSE
+		   || add_word(words, port->port.range.to) == FALSE)
+	    return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Load a cache file in memory, mapping it if possible, and check that its
+ * parts fit in it
+ */
+static enum bool read_cache(const char *const name)
+{
+    size_t size = 0, max = 0, nb;
+    unsigned *data;
+    FILE *file;
+#if HAVE_MMAP
+    struct stat st;
+    void *base;
+#endif /* HAVE_MMAP */
+
+    if ((file = fopen(name, "rb")) == NULL)
+	return FALSE;
+
+#if HAVE_MMAP
+    cache_mapped = FALSE;
+    if (fstat(fileno(file), &st) == 0 && S_ISREG(st.st_mode)
+	&& st.st_size != 0
+	&& (base = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE,
+			fileno(file), 0)) != MAP_FAILED) {
+	/* A single mapping, nothing being copied */
+	cache = base;
+	cache_size = (size_t) st.st_size;
+	cache_mapped = TRUE;
+    } else
+#endif /* HAVE_MMAP */
+    {
+	/* Read it whole */
+	do {
+	    if (size == max) {
+		max = max == 0 ? 65536 : max * 2;
+		if ((data = realloc(cache, max)) == NULL) {
+		    free(cache);
+		    cache = NULL;
+		    fclose(file);
+		    return FALSE;
+		}
+		cache = data;
+	    }
+	    size += nb = fread((char *) cache + size, 1, max - size, file);
+	} while (nb != 0);
+	cache_size = size;
+	if (ferror(file)) {
+	    fclose(file);
+	    ast_free();
+	    return FALSE;
+	}
+    }
+    fclose(file);
+
+    /* Check the header, then the size of each part */
+    max = cache_size / sizeof(unsigned);
+    if (max < HDR_SIZE || cache[HDR_MAGIC] != MAGIC
+	|| cache[HDR_WORD] != sizeof(unsigned)
+	|| cache[HDR_TOPS] > cache[HDR_FILES]
+	|| cache[HDR_FILES] > max / FILE_RECORD
+	|| cache[HDR_NODES] > max || cache[HDR_STRINGS] == 0
+	|| cache[HDR_STRINGS] % sizeof(unsigned) != 0
+	|| cache_size != (HDR_SIZE + (size_t) FILE_RECORD * cache[HDR_FILES]
+			  + cache[HDR_NODES]) * sizeof(unsigned)
+			 + cache[HDR_STRINGS]
+	|| ((const char *) cache)[cache_size - 1] != '\0') {
+	ast_free();
+	return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Check that the cache was written for the given files and service names,
+ * and that none of the parsed files changed since
+ */
+static enum bool check_files(const char *const *const names,
+			     const unsigned nb)
+{
+    const char *const strings = (const char *) cache + cache_size
+				- cache[HDR_STRINGS];
+    const unsigned *record = cache + HDR_SIZE;
+    unsigned current[FILE_RECORD], i;
+
+    if (cache[HDR_TOPS] != nb)
+	return FALSE;
+    srv_hash(current + FILE_HASH1, current + FILE_HASH2);
+    if (current[FILE_HASH1] != cache[HDR_SRV1]
+	|| current[FILE_HASH2] != cache[HDR_SRV2])
+	return FALSE;
+
+    for (i = 0; i < cache[HDR_FILES]; i++, record += FILE_RECORD) {
+	if (record[FILE_NAME] >= cache[HDR_STRINGS]
+	    || (i < nb && strcmp(strings + record[FILE_NAME], names[i]) != 0)
+	    || hash_file(strings + record[FILE_NAME], current) == FALSE
+	    || current[FILE_SIZE] != record[FILE_SIZE]
+	    || current[FILE_HASH1] != record[FILE_HASH1]
+	    || current[FILE_HASH2] != record[FILE_HASH2])
+	    return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Read the next word of the nodes, which must be at most max
+ */
+static enum bool get_word(struct reader *const reader, unsigned *const word,
+			  const unsigned max)
+{
+    if (reader->pos == reader->end || *reader->pos > max)
+	return FALSE;
+
+    *word = *reader->pos++;
+    return TRUE;
+}
+
+/*
+ * Read a string offset and point to the string, inside the cache
+ */
+static enum bool get_string(struct reader *const reader, char **const string)
+{
+    unsigned offset;
+
+    if (get_word(reader, &offset, (unsigned) reader->size - 1) == FALSE)
+	return FALSE;
+
+    /* The strings aren't modified once parsed */
+    *string = (char *) reader->strings + offset;
+    return TRUE;
+}
+
+/*
+ * Read an action and what it contains
+ */
+static struct action *read_action(struct reader *const reader)
+{
+    struct action *action;
+    struct test *test;
+    unsigned word, src;
+
+    if (get_word(reader, &word, TARGET_TEST) == FALSE
+	|| get_word(reader, &src, ~0U) == FALSE
+	|| (action = mem_alloc(sizeof(struct action))) == NULL)
+	return NULL;
+    action->src = src;
+
+    switch (action->type = word) {
+    case TARGET_FINAL:
+	if (get_word(reader, &word, FINAL_REJECT) == FALSE)
+	    break;
+	action->action.final = word;
+	return action;
+
+    case TARGET_USER:
+	if (get_word(reader, &word, reader->nb_chains - 1) == FALSE)
+	    break;
+	action->action.user = reader->chains[word];
+	return action;
+
+    case TARGET_TEST:
+	if (get_word(reader, &src, ~0U) == FALSE
+	    || (test = mem_alloc(sizeof(struct test))) == NULL)
+	    break;
+	test->act_then = test->act_else = NULL;
+	test->src = src;
+	action->action.test = test;
+	if ((test->expr = read_expr(reader)) == NULL
+	    || (test->act_then = read_action(reader)) == NULL
+	    || (test->act_else = read_action(reader)) == NULL) {
+	    free_action(action);
+	    return NULL;
+	}
+	return action;
+    }
+
+    mem_free(action);
+    return NULL;
+}
+
+/*
+ * Read an expression and its operands
+ */
+static struct expr *read_expr(struct reader *const reader)
+{
+    struct expr *expr;
+    unsigned type, src, not;
+
+    if (get_word(reader, &type, EXPR_OR) == FALSE
+	|| get_word(reader, &src, ~0U) == FALSE
+	|| get_word(reader, &not, TRUE) == FALSE
+	|| (expr = mem_alloc(sizeof(struct expr))) == NULL)
+	return NULL;
+    expr->type = type;
+    expr->src = src;
+    expr->not = not;
+
+    if (type == EXPR_COND) {
+	if ((expr->sub.cond = read_condition(reader)) != NULL)
+	    return expr;
+	mem_free(expr);
+	return NULL;
+    }
+
+    expr->sub.expr.right = NULL;
+    if ((expr->sub.expr.left = read_expr(reader)) == NULL
+	|| (expr->sub.expr.right = read_expr(reader)) == NULL) {
+	free_expr(expr);
+	return NULL;
+    }
+    return expr;
+}
+
+/*
+ * Read a condition and its list
+ */
+static struct condition *read_condition(struct reader *const reader)
+{
+    struct condition *cond;
+    struct addr **addr;
+    struct port **port;
+    unsigned type, src, dir, proto, nb, word;
+
+    if (get_word(reader, &type, COND_PORT) == FALSE
+	|| get_word(reader, &src, ~0U) == FALSE
+	|| get_word(reader, &dir, DIR_DST) == FALSE
+	|| get_word(reader, &proto, PROTO_UDP) == FALSE
+	|| get_word(reader, &nb, (unsigned) (reader->end - reader->pos))
+	   == FALSE
+	|| (cond = mem_alloc(sizeof(struct condition))) == NULL)
+	return NULL;
+    cond->type = type;
+    cond->src = src;
+    cond->dir = dir;
+    cond->proto = proto;
+
+    if (type == COND_ADDR) {
+	cond->cond.addr = NULL;
+	for (addr = &cond->cond.addr; nb != 0; nb--) {
+	    if ((*addr = mem_alloc(sizeof(struct addr))) == NULL)
+		break;
+	    (*addr)->next = NULL;
+	    if (get_string(reader, &(*addr)->string) == FALSE)
+		break;
+	    addr = &(*addr)->next;
+	}
+    } else {
+	cond->cond.port = NULL;
+	for (port = &cond->cond.port; nb != 0; nb--) {
+	    if ((*port = mem_alloc(sizeof(struct port))) == NULL)
+		break;
+	    (*port)->next = NULL;
+	    if (get_word(reader, &word, PORT_NAME) == FALSE)
+		break;
+	    if (((*port)->type = word) == PORT_NAME) {
+		if (get_string(reader, &(*port)->port.name) == FALSE)
+		    break;
+	    } else {
+		if (get_word(reader, &word, 65535) == FALSE)
+		    break;
+		(*port)->port.range.from = (unsigned short) word;
+		if (get_word(reader, &word, 65535) == FALSE)
+		    break;
+		(*port)->port.range.to = (unsigned short) word;
+	    }
+	    port = &(*port)->next;
+	}
+    }
+
+    if (nb != 0) {
+	free_condition(cond);
+	return NULL;
+    }
+    return cond;
+}
+
+/* End of File */
@@ -0,0 +1,57 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/astcache.h
+ *
+ * Description: Compiled Configuration Cache Header
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/* Process only once */
+#ifndef ASTCACHE_H
+#define ASTCACHE_H
+
+/* C++ protection */
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Suffix of the cache file, written next to the first configuration file */
+#define AST_SUFFIX ".rwc"
+
+/* Compiled configuration cache functions */
+struct chain *ast_load(const char *const *names, unsigned nb);
+enum bool ast_save(const struct chain *config, const char *const *names,
+		   unsigned nb);
+void ast_free(void);
+
+/* C++ protection */
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !ASTCACHE_H */
+
+/* End of File */
@@ -0,0 +1,252 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/attrib.c
+ *
+ * Description: Counter Attribution to the Source Lines
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* System headers */
+#include <stdlib.h> /* NULL, realloc(), free(), strtoul(), qsort() */
+#include <stdio.h>  /* FILE *, fprintf(), fputs()                  */
+#include <string.h> /* strcmp()                                    */
+
+/* Local headers */
+#include "structs.h"
+#include "counters.h"
+#include "attrib.h"
+
+
+/*****************************************************************************
+ *
+ * Local Datatypes and Variables
+ *
+ */
+
+/* Initial number of counted lines */
+#define INITIAL_SIZE 256
+
+/* Counters of a source line, or of a single rule until they are merged */
+struct line {
+    unsigned src;   /* Source ID, as put in the rule comments */
+    double packets; /* Packets matched by the rules           */
+    double bytes;   /* Bytes matched by the rules             */
+    unsigned rules; /* Number of rules                        */
+};
+
+/* Counted lines */
+static struct line *lines = NULL;
+
+/* Number of allocated and of used lines */
+static unsigned long size = 0, count = 0;
+
+/* Auxiliary functions */
+static enum bool add_rule(double packets, double bytes, char **tokens);
+static unsigned long merge_lines(void);
+static void print_source(FILE *out, unsigned src);
+static int cmp_src(const void *a, const void *b);
+static int cmp_packets(const void *a, const void *b);
+
+
+/*****************************************************************************
+ *
+ * Global Functions
+ *
+ */
+
+/*
+ * Read the counters of the rules, from the output of "iptables-save -c" for
+ * rules generated with their source IDs ("-m comment --comment file:line");
+ * the rules without such comment are ignored.  Return FALSE if there is not
+ * enough memory.
+ */
+enum bool atr_read(FILE *const in)
+{
+    return cnt_read(in, add_rule);
+}
+
+/*
+ * Write the report of the counters read with atr_read(), for the parsed
+ * files: the source lines whose rules matched packets, busiest first, and
+ * then the lines whose rules never matched any packet
+ */
+void atr_report(FILE *const out)
+{
+    unsigned long nb, i;
+
+    /* Merge the rules of the same lines, and put the dead ones at the end */
+    nb = merge_lines();
+    qsort(lines, nb, sizeof(struct line), cmp_packets);
+
+    fputs("Hot spots:\n", out);
+    fprintf(out, "%14s %16s %6s  %s\n", "packets", "bytes", "rules",
+	    "source");
+    for (i = 0; i < nb && lines[i].packets > 0; i++) {
+	fprintf(out, "%14.0f %16.0f %6u  ", lines[i].packets, lines[i].bytes,
+		lines[i].rules);
+	print_source(out, lines[i].src);
+    }
+
+    fputs("\nDead rules:\n", out);
+    fprintf(out, "%6s  %s\n", "rules", "source");
+    for (; i < nb; i++) {
+	fprintf(out, "%6u  ", lines[i].rules);
+	print_source(out, lines[i].src);
+    }
+}
+
+/*
+ * Forget the counters
+ */
+void atr_free(void)
+{
+    free(lines);
+    lines = NULL;
+    size = count = 0;
+}
+
+
+/*****************************************************************************
+ *
+ * Auxiliary Functions
+ *
+ */
+
+/*
+ * Add the counters of a rule tagged with its source ID, growing the table
+ * if needed
+ */
+static enum bool add_rule(const double packets, const double bytes,
+			  char **tokens)
+{
+    struct line *new_lines;
+    unsigned long file, num;
+    char *token, *end;
+
+    /* Look for the source ID, which iptables-save may quote */
+    for (; *tokens != NULL; tokens++)
+	if (strcmp(*tokens, "--comment") == 0)
+	    break;
+    if (*tokens == NULL || (token = tokens[1]) == NULL)
+	return TRUE;
+    if (*token == '"')
+	token++;
+    file = strtoul(token, &end, 10);
+    if (end == token || *end != ':')
+	return TRUE;
+    num = strtoul(token = end + 1, &end, 10);
+    if (end == token || (*end != '\0' && *end != '"') || num == 0
+	|| num > SRC_LINE_MAX || file > SRC_FILE_MAX)
+	return TRUE;
+
+    if (count == size) {
+	if ((new_lines = realloc(lines, sizeof(struct line)
+				 * (size == 0 ? INITIAL_SIZE : size * 2)))
+	    == NULL)
+	    return FALSE;
+	lines = new_lines;
+	size = size == 0 ? INITIAL_SIZE : size * 2;
+    }
+
+    lines[count].src = SRC_ID(file, num);
+    lines[count].packets = packets;
+    lines[count].bytes = bytes;
+    lines[count].rules = 1;
+    count++;
+    return TRUE;
+}
+
+/*
+ * Add up the counters of the rules generated from the same source line,
+ * and give the number of lines left
+ */
+static unsigned long merge_lines(void)
+{
+    unsigned long i, nb = 0;
+
+    if (count == 0)
+	return 0;
+
+    qsort(lines, count, sizeof(struct line), cmp_src);
+    for (i = 1; i < count; i++)
+	if (lines[i].src == lines[nb].src) {
+	    lines[nb].packets += lines[i].packets;
+	    lines[nb].bytes += lines[i].bytes;
+	    lines[nb].rules += lines[i].rules;
+	} else
+	    lines[++nb] = lines[i];
+
+    return count = nb + 1;
+}
+
+/*
+ * Print a source line as "file:line"; a file not parsed this time is given
+ * by its index
+ */
+static void print_source(FILE *const out, const unsigned src)
+{
+    const char *const name = get_source(SRC_FILE(src));
+
+    if (name != NULL)
+	fprintf(out, "%s:%u", name, SRC_LINE(src));
+    else
+	fprintf(out, "#%u:%u", SRC_FILE(src), SRC_LINE(src));
+    fputc('\n', out);
+}
+
+/*
+ * Compare two lines by source ID, for qsort()
+ */
+static int cmp_src(const void *const a, const void *const b)
+{
+    const unsigned src_a = ((const struct line *) a)->src;
+    const unsigned src_b = ((const struct line *) b)->src;
+
+    return src_a < src_b ? -1 : src_a > src_b ? 1 : 0;
+}
+
+/*
+ * Compare two lines by decreasing number of packets, then by source ID, for
+ * qsort()
+ */
+static int cmp_packets(const void *const a, const void *const b)
+{
+    const struct line *const line_a = a, *const line_b = b;
+
+    if (line_a->packets != line_b->packets)
+	return line_a->packets > line_b->packets ? -1 : 1;
+    return cmp_src(a, b);
+}
+
+/* End of File */
@@ -0,0 +1,56 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/attrib.h
+ *
+ * Description: Counter Attribution to the Source Lines Header
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/* Process only once */
+#ifndef ATTRIB_H
+#define ATTRIB_H
+
+/* C++ protection */
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* System headers */
+#include <stdio.h> /* FILE * */
+
+/* Attribution functions */
+enum bool atr_read(FILE *in);
+void atr_report(FILE *out);
+void atr_free(void);
+
+/* C++ protection */
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !ATTRIB_H */
+
+/* End of File */
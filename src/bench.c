@@ -0,0 +1,732 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/bench.c
+ *
+ * Description: Policy Evaluation Benchmark
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* System headers */
+#include <stdlib.h>  /* NULL, malloc(), free(), qsort(), atoi(), strtoul() */
+#include <stdio.h>   /* FILE *, fopen(), fread(), fgets(), printf()        */
+#include <string.h>  /* strcmp()                                          */
+#include <time.h>    /* clock_gettime()                                   */
+#include <unistd.h>  /* sysconf()                                         */
+#include <pthread.h> /* pthread_create(), pthread_join()                  */
+
+/* Local headers */
+#include "structs.h"
+#include "classify.h"
+#include "memory.h"
+
+
+/*****************************************************************************
+ *
+ * Prototypes and Local Variables
+ *
+ */
+
+/* Lookups timed together (a single one is too short for the clock) */
+#define BATCH 64
+
+/* Default number of lookups and synthetic tuples */
+#define DEFAULT_LOOKUPS 10000000UL
+#define DEFAULT_TUPLES  100000UL
+
+/* Packet 5-tuple */
+struct tuple {
+    unsigned long src, dst;        /* IPv4 addresses (host byte order) */
+    unsigned proto, sport, dport;  /* Protocol and ports               */
+};
+
+/* Per-thread benchmark state */
+struct worker {
+    pthread_t thread;              /* Thread identifier               */
+    unsigned long first, lookups;  /* First tuple, number of lookups  */
+    unsigned long *samples;        /* Nanoseconds per lookup of batch */
+    unsigned long nb_samples;      /* Number of samples               */
+    double elapsed;                /* Total time (seconds)            */
+    unsigned long checksum;        /* Sum of verdicts (kept alive)    */
+};
+
+/* Values found in the policy, used to build matching synthetic tuples */
+struct values {
+    struct prefix *prefixes;       /* IPv4 prefixes */
+    unsigned *ports;               /* Port numbers  */
+    unsigned nb_prefixes, nb_ports, max_prefixes, max_ports;
+};
+
+/* Auxiliary functions */
+static void usage(const char *exe);
+static double now(void);
+static unsigned long random32(unsigned long *state);
+static int cmp_ulong(const void *a, const void *b);
+static unsigned long get16(const unsigned char *data, enum bool swap);
+static unsigned long get32(const unsigned char *data, enum bool swap);
+
+/* Local functions */
+static void collect_action(struct values *values,
+			   const struct action *action);
+static void collect_expr(struct values *values, const struct expr *expr);
+static enum bool make_tuples(const struct chain *config, unsigned long nb,
+			     unsigned long seed);
+static enum bool read_tuples(const char *filename);
+static enum bool read_pcap(FILE *file, const unsigned char *header);
+static enum bool add_tuple(const struct tuple *tuple);
+static void *run(void *arg);
+static void report(const char *title, struct worker *workers,
+		   unsigned nb_workers);
+
+/* Local variables */
+static const struct cls_program *program;
+static int entry;
+static struct tuple *tuples;
+static unsigned long nb_tuples, max_tuples;
+
+
+/*****************************************************************************
+ *
+ * Global Functions
+ *
+ */
+
+/*
+ * Main function
+ */
+int main(const int argc, const char *const *const argv)
+{
+    const char *chain_name = NULL, *trace = NULL, *what;
+    unsigned long lookups = DEFAULT_LOOKUPS, seed = 1;
+    unsigned long verdicts[CLS_NB_VERDICTS], *hits, i;
+    unsigned nb_threads = 0, nb;
+    struct chain *config;
+    struct cls_program *prog;
+    struct worker *workers;
+    const struct tuple *t;
+    double start;
+    int arg;
+
+    /* Parse options */
+    for (arg = 1; arg < argc && argv[arg][0] == '-'; arg++) {
+	if (argv[arg][1] == '\0' || argv[arg][2] != '\0'
+	    || (argv[arg][1] != 'h' && arg + 1 == argc)) {
+	    usage(argv[0]);
+	    return 1;
+	}
+
+	switch (argv[arg][1]) {
+	case 'c':
+	    chain_name = argv[++arg];
+	    break;
+
+	case 'f':
+	    trace = argv[++arg];
+	    break;
+
+	case 'h':
+	    usage(argv[0]);
+	    return 0;
+
+	case 'n':
+	    lookups = strtoul(argv[++arg], NULL, 10);
+	    break;
+
+	case 's':
+	    seed = strtoul(argv[++arg], NULL, 10);
+	    break;
+
+	case 't':
+	    nb_threads = (unsigned) atoi(argv[++arg]);
+	    break;
+
+	default:
+	    usage(argv[0]);
+	    return 1;
+	}
+    }
+    if (arg == argc) {
+	usage(argv[0]);
+	return 1;
+    }
+    if (nb_threads == 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+	const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	nb_threads = cpus > 1 ? (unsigned) cpus : 2;
+#else
+	nb_threads = 4;
+#endif /* _SC_NPROCESSORS_ONLN */
+    }
+
+    /* Load and compile the policy */
+    start = now();
+    if ((config = parse_files((const char *const *) argv + arg,
+			      (unsigned) (argc - arg))) == NULL)
+	return 2;
+    printf("Policy: parsed in %.3f ms", (now() - start) * 1000.0);
+    start = now();
+    switch (cls_compile(config, &prog, &what)) {
+    case CLS_OK:
+	break;
+
+    case CLS_NO_MEMORY:
+	fputs("\nError: not enough memory to compile the policy.\n", stderr);
+	return 3;
+
+    case CLS_LOOP:
+	fprintf(stderr, "\nError: chain \"%s\" jumps to itself.\n", what);
+	return 3;
+
+    case CLS_BAD_ADDRESS:
+	fprintf(stderr, "\nError: cannot compile address \"%s\" (only IPv4 "
+		"addresses and networks are supported).\n", what);
+	return 3;
+
+    case CLS_BAD_PORT:
+	fprintf(stderr, "\nError: unknown port name \"%s\".\n", what);
+	return 3;
+
+    case CLS_BAD_CHAIN:
+	fprintf(stderr, "\nError: chain \"%s\" is not in the policy.\n",
+		what);
+	return 3;
+    }
+    program = prog;
+    printf(", compiled in %.3f ms, %u chains\n", (now() - start) * 1000.0,
+	   cls_count(prog));
+
+    /* Select the entry chain: the first one by default */
+    if ((entry = cls_find(prog, chain_name != NULL ? chain_name
+						   : config->name)) < 0) {
+	fprintf(stderr, "Error: no chain named \"%s\".\n", chain_name);
+	return 1;
+    }
+
+    /* Build the tuple stream */
+    if (trace != NULL ? read_tuples(trace) == FALSE
+		      : make_tuples(config, DEFAULT_TUPLES, seed) == FALSE)
+	return 4;
+    if (nb_tuples == 0) {
+	fputs("Error: no IPv4 packet in the trace.\n", stderr);
+	return 4;
+    }
+    printf("Stream: %lu tuples (%s), entry chain \"%s\", %lu lookups per "
+	   "run\n\n", nb_tuples, trace != NULL ? trace : "synthetic",
+	   cls_name(prog, entry), lookups);
+
+    /* The AST is no longer needed */
+    free_chain(config);
+    free_files();
+    mem_free_all();
+
+    /* Run single-threaded, then multi-threaded */
+    if ((workers = malloc(sizeof(struct worker) * nb_threads)) == NULL)
+	return 10;
+    for (nb = 1; ; nb = nb_threads) {
+	char title[32];
+
+	for (i = 0; i < nb; i++) {
+	    workers[i].first = nb_tuples / nb * i;
+	    workers[i].lookups = lookups;
+	}
+	if (nb == 1)
+	    run(&workers[0]);
+	else {
+	    for (i = 0; i < nb; i++)
+		if (pthread_create(&workers[i].thread, NULL, run,
+				   &workers[i]) != 0) {
+		    fputs("Error: cannot create threads.\n", stderr);
+		    return 10;
+		}
+	    for (i = 0; i < nb; i++)
+		pthread_join(workers[i].thread, NULL);
+	}
+
+	sprintf(title, "%u thread%s", nb, nb > 1 ? "s" : "");
+	report(title, workers, nb);
+	if (nb == nb_threads)
+	    break;
+    }
+    free(workers);
+
+    /* Verdicts and chain hits, over the whole stream */
+    if ((hits = calloc(cls_count(prog), sizeof(unsigned long))) == NULL)
+	return 10;
+    verdicts[CLS_ACCEPT] = verdicts[CLS_DROP] = verdicts[CLS_REJECT] = 0;
+    for (i = 0, t = tuples; i < nb_tuples; i++, t++)
+	verdicts[cls_trace(prog, entry, t->src, t->dst, t->proto, t->sport,
+			   t->dport, hits)]++;
+
+    printf("\nVerdicts: accept %lu, drop %lu, reject %lu\n"
+	   "Chain hits (tuples whose evaluation went through the chain):\n",
+	   verdicts[CLS_ACCEPT], verdicts[CLS_DROP], verdicts[CLS_REJECT]);
+    for (i = 0; i < cls_count(prog); i++)
+	printf("    %-20s %10lu  %5.1f%%\n", cls_name(prog, (int) i), hits[i],
+	       hits[i] * 100.0 / nb_tuples);
+
+    free(hits);
+    free(tuples);
+    cls_free(prog);
+    return 0;
+}
+
+
+/*****************************************************************************
+ *
+ * Auxiliary Functions
+ *
+ */
+
+/*
+ * Display the program usage help message
+ */
+static void usage(const char *const exe)
+{
+    printf("Syntax: %s [options...] files...\n"
+	   "\n"
+	   "Available options:\n", exe);
+    fputs("    -c <chain>:   entry chain (the first one by default)\n"
+	  "    -f <file>:    replay a trace: pcap file, or text lines\n"
+	  "                  \"src dst proto sport dport\"\n"
+	  "    -h:           display this help message\n"
+	  "    -n <number>:  lookups per thread (10000000 by default)\n",
+	  stdout);
+    fputs("    -s <seed>:    seed of the synthetic stream (1 by default)\n"
+	  "    -t <number>:  threads of the multi-threaded run (one per CPU "
+		  "by default)\n"
+	  "\n"
+	  "Without a trace, the stream is generated from the addresses and "
+		  "ports found\n"
+	  "in the policy, so that the same seed gives the same stream.\n",
+	  stdout);
+}
+
+/*
+ * Get the current time in seconds, from a monotonic clock
+ */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Get the next 32-bit pseudo-random number (xorshift, so that streams do not
+ * depend on the C library)
+ */
+static unsigned long random32(unsigned long *const state)
+{
+    unsigned long x = *state;
+
+    x ^= (x << 13) & 0xFFFFFFFFUL;
+    x ^= x >> 17;
+    x ^= (x << 5) & 0xFFFFFFFFUL;
+    return *state = x;
+}
+
+/*
+ * Sort unsigned long integers
+ */
+static int cmp_ulong(const void *const a, const void *const b)
+{
+    const unsigned long ua = *(const unsigned long *) a;
+    const unsigned long ub = *(const unsigned long *) b;
+
+    return ua < ub ? -1 : ua > ub ? 1 : 0;
+}
+
+/*
+ * Read a 16-bit or 32-bit integer, big endian unless swapped
+ */
+static unsigned long get16(const unsigned char *const data,
+			   const enum bool swap)
+{
+    return swap == TRUE ? data[0] | (unsigned long) data[1] << 8
+			: (unsigned long) data[0] << 8 | data[1];
+}
+
+static unsigned long get32(const unsigned char *const data,
+			   const enum bool swap)
+{
+    return swap == TRUE ? get16(data, TRUE) | get16(data + 2, TRUE) << 16
+			: get16(data, FALSE) << 16 | get16(data + 2, FALSE);
+}
+
+
+/*****************************************************************************
+ *
+ * Local Functions
+ *
+ */
+
+/*
+ * Collect the IPv4 prefixes and port numbers of an action
+ */
+static void collect_action(struct values *const values,
+			   const struct action *const action)
+{
+    if (action->type != TARGET_TEST)
+	return;
+
+    collect_expr(values, action->action.test->expr);
+    collect_action(values, action->action.test->act_then);
+    collect_action(values, action->action.test->act_else);
+}
+
+/*
+ * Collect the IPv4 prefixes and port numbers of an expression
+ */
+static void collect_expr(struct values *const values,
+			 const struct expr *const expr)
+{
+    const struct addr *addr;
+    const struct port *port;
+    void *res;
+
+    if (expr->type != EXPR_COND) {
+	collect_expr(values, expr->sub.expr.left);
+	collect_expr(values, expr->sub.expr.right);
+	return;
+    }
+
+    if (expr->sub.cond->type == COND_ADDR) {
+	for (addr = expr->sub.cond->cond.addr; addr != NULL;
+	     addr = addr->next) {
+	    if (values->nb_prefixes == values->max_prefixes) {
+		values->max_prefixes = values->max_prefixes * 2 + 16;
+		if ((res = realloc(values->prefixes, sizeof(struct prefix)
+				   * values->max_prefixes)) == NULL)
+		    return;
+		values->prefixes = res;
+	    }
+	    if (addr_to_prefix(addr, &values->prefixes[values->nb_prefixes])
+		== TRUE)
+		values->nb_prefixes++;
+	}
+    } else
+	for (port = expr->sub.cond->cond.port; port != NULL;
+	     port = port->next) {
+	    if (port->type != PORT_NUMERIC)
+		continue;
+	    if (values->nb_ports == values->max_ports) {
+		values->max_ports = values->max_ports * 2 + 16;
+		if ((res = realloc(values->ports, sizeof(unsigned)
+				   * values->max_ports)) == NULL)
+		    return;
+		values->ports = res;
+	    }
+	    values->ports[values->nb_ports++] = port->port.range.from;
+	}
+}
+
+/*
+ * Generate a synthetic stream: each field is taken, one time out of two,
+ * from the values of the policy
+ */
+static enum bool make_tuples(const struct chain *const config,
+			     const unsigned long nb, unsigned long seed)
+{
+    struct values values = { NULL, NULL, 0, 0, 0, 0 };
+    const struct chain *chain;
+    const struct prefix *prefix;
+    struct tuple tuple;
+    unsigned long i, r;
+    enum bool ok = TRUE;
+
+    for (chain = config; chain != NULL; chain = chain->next)
+	collect_action(&values, chain->action);
+
+    /* Xorshift must not start from zero */
+    seed = (seed * 2654435761UL + 1) & 0xFFFFFFFFUL;
+    if (seed == 0)
+	seed = 1;
+
+    for (i = 0; ok == TRUE && i < nb; i++) {
+	r = random32(&seed);
+	tuple.proto = (r & 3) == 0 ? 1 : (r & 3) == 1 ? 17 : 6;
+
+	tuple.src = random32(&seed);
+	tuple.dst = random32(&seed);
+	if (values.nb_prefixes > 0 && (r & 4) != 0) {
+	    prefix = &values.prefixes[random32(&seed) % values.nb_prefixes];
+	    tuple.src = prefix->net | (prefix->len == 0 ? tuple.src
+				       : tuple.src & (0xFFFFFFFFUL
+						      >> prefix->len));
+	}
+	if (values.nb_prefixes > 0 && (r & 8) != 0) {
+	    prefix = &values.prefixes[random32(&seed) % values.nb_prefixes];
+	    tuple.dst = prefix->net | (prefix->len == 0 ? tuple.dst
+				       : tuple.dst & (0xFFFFFFFFUL
+						      >> prefix->len));
+	}
+
+	tuple.sport = 1024 + random32(&seed) % 64512;
+	tuple.dport = random32(&seed) & 0xFFFF;
+	if (values.nb_ports > 0 && (r & 16) != 0)
+	    tuple.dport = values.ports[random32(&seed) % values.nb_ports];
+	if (tuple.proto == 1)
+	    tuple.sport = tuple.dport = 0;
+
+	ok = add_tuple(&tuple);
+    }
+
+    free(values.prefixes);
+    free(values.ports);
+    return ok;
+}
+
+/*
+ * Read a trace, either a pcap file or a text file with one
+ * "src dst proto sport dport" line per packet
+ */
+static enum bool read_tuples(const char *const filename)
+{
+    FILE *const file = fopen(filename, "rb");
+    unsigned char header[24];
+    char line[256];
+    unsigned a[4], b[4];
+    struct tuple tuple;
+    unsigned long nb_line = 0;
+    enum bool ok = TRUE;
+
+    if (file == NULL) {
+	fprintf(stderr, "Error: cannot read file \"%s\": ", filename);
+	perror(NULL);
+	return FALSE;
+    }
+
+    /* pcap file (either byte order, microsecond or nanosecond stamps) */
+    if (fread(header, 1, 24, file) == 24) {
+	const unsigned long magic = get32(header, FALSE);
+
+	if (magic == 0xA1B2C3D4UL || magic == 0xD4C3B2A1UL
+	    || magic == 0xA1B23C4DUL || magic == 0x4D3CB2A1UL) {
+	    ok = read_pcap(file, header);
+	    fclose(file);
+	    return ok;
+	}
+    }
+
+    /* Text file */
+    rewind(file);
+    while (ok == TRUE && fgets(line, sizeof(line), file) != NULL) {
+	nb_line++;
+	if (line[0] == '#' || line[0] == '\n')
+	    continue;
+	if (sscanf(line, "%u.%u.%u.%u %u.%u.%u.%u %u %u %u",
+		   &a[0], &a[1], &a[2], &a[3], &b[0], &b[1], &b[2], &b[3],
+		   &tuple.proto, &tuple.sport, &tuple.dport) != 11) {
+	    fprintf(stderr, "Error: file \"%s\", line %lu: invalid tuple.\n",
+		    filename, nb_line);
+	    ok = FALSE;
+	    break;
+	}
+	tuple.src = ((unsigned long) a[0] << 24 | (unsigned long) a[1] << 16
+		     | a[2] << 8 | a[3]) & 0xFFFFFFFFUL;
+	tuple.dst = ((unsigned long) b[0] << 24 | (unsigned long) b[1] << 16
+		     | b[2] << 8 | b[3]) & 0xFFFFFFFFUL;
+	ok = add_tuple(&tuple);
+    }
+
+    fclose(file);
+    return ok;
+}
+
+/*
+ * Read the IPv4 packets of a pcap file (Ethernet, Linux cooked or raw IP
+ * link layers)
+ */
+static enum bool read_pcap(FILE *const file, const unsigned char *const header)
+{
+    const enum bool swap = header[0] == 0xD4 || header[0] == 0x4D
+			   ? TRUE : FALSE;
+    const unsigned long link = get32(header + 20, swap);
+    unsigned char record[16], data[128];
+    unsigned long caplen, len, off, type;
+    struct tuple tuple;
+
+    while (fread(record, 1, 16, file) == 16) {
+	caplen = get32(record + 8, swap);
+	len = caplen < sizeof(data) ? caplen : sizeof(data);
+	if (fread(data, 1, len, file) != len
+	    || (caplen > len && fseek(file, (long) (caplen - len),
+				      SEEK_CUR) != 0))
+	    break;
+
+	/* Find the IPv4 header */
+	switch (link) {
+	case 1: /* Ethernet, with optional VLAN tags; none if truncated */
+	    type = 0;
+	    for (off = 12; off + 2 <= len; off += 4)
+		if ((type = get16(data + off, FALSE)) != 0x8100
+		    && type != 0x88A8)
+		    break;
+	    off += 2;
+	    if (type != 0x0800)
+		continue;
+	    break;
+
+	case 113: /* Linux cooked capture */
+	    if (len < 16 || get16(data + 14, FALSE) != 0x0800)
+		continue;
+	    off = 16;
+	    break;
+
+	case 101: /* Raw IP */
+	case 228: /* Raw IPv4 */
+	    off = 0;
+	    break;
+
+	default:
+	    fprintf(stderr, "Error: unsupported pcap link type %lu.\n",
+		    link);
+	    return FALSE;
+	}
+	if (off + 20 > len || (data[off] >> 4) != 4)
+	    continue;
+
+	tuple.proto = data[off + 9];
+	tuple.src = get32(data + off + 12, FALSE);
+	tuple.dst = get32(data + off + 16, FALSE);
+	tuple.sport = tuple.dport = 0;
+
+	/* Ports are only in the first fragment */
+	if ((tuple.proto == 6 || tuple.proto == 17)
+	    && (get16(data + off + 6, FALSE) & 0x1FFF) == 0) {
+	    off += (data[off] & 0x0F) * 4;
+	    if (off + 4 <= len) {
+		tuple.sport = get16(data + off, FALSE);
+		tuple.dport = get16(data + off + 2, FALSE);
+	    }
+	}
+
+	if (add_tuple(&tuple) == FALSE)
+	    return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Append a tuple to the stream
+ */
+static enum bool add_tuple(const struct tuple *const tuple)
+{
+    struct tuple *res;
+
+    if (nb_tuples == max_tuples) {
+	max_tuples = max_tuples * 2 + 1024;
+	if ((res = realloc(tuples, sizeof(struct tuple) * max_tuples))
+	    == NULL) {
+	    fputs("Error: not enough memory.\n", stderr);
+	    return FALSE;
+	}
+	tuples = res;
+    }
+
+    tuples[nb_tuples++] = *tuple;
+    return TRUE;
+}
+
+/*
+ * Replay the stream from a given tuple, timing batches of lookups
+ */
+static void *run(void *const arg)
+{
+    struct worker *const worker = arg;
+    const struct tuple *t = tuples + worker->first;
+    const struct tuple *const end = tuples + nb_tuples;
+    unsigned long done = 0, checksum = 0, size, nb;
+    double start, batch;
+
+    worker->nb_samples = 0;
+    worker->samples = malloc(sizeof(unsigned long)
+			     * (worker->lookups / BATCH + 1));
+
+    start = now();
+    while (done < worker->lookups) {
+	size = worker->lookups - done < BATCH ? worker->lookups - done : BATCH;
+	batch = now();
+	for (done += size, nb = size; nb > 0; nb--) {
+	    checksum += cls_classify(program, entry, t->src, t->dst,
+				     t->proto, t->sport, t->dport);
+	    if (++t == end)
+		t = tuples;
+	}
+	if (worker->samples != NULL)
+	    worker->samples[worker->nb_samples++]
+		    = (unsigned long) ((now() - batch) * 1e9 / size + 0.5);
+    }
+    worker->elapsed = now() - start;
+    worker->checksum = checksum;
+
+    return NULL;
+}
+
+/*
+ * Display the throughput and latency of a run
+ */
+static void report(const char *const title, struct worker *const workers,
+		   const unsigned nb_workers)
+{
+    unsigned long total = 0, nb_samples = 0, *samples, i, j;
+    double elapsed = 0.0;
+
+    for (i = 0; i < nb_workers; i++) {
+	total += workers[i].lookups;
+	nb_samples += workers[i].nb_samples;
+	if (workers[i].elapsed > elapsed)
+	    elapsed = workers[i].elapsed;
+    }
+
+    /* Merge the samples of all the workers */
+    samples = malloc(sizeof(unsigned long) * (nb_samples + 1));
+    for (i = 0, nb_samples = 0; i < nb_workers; i++) {
+	for (j = 0; samples != NULL && j < workers[i].nb_samples; j++)
+	    samples[nb_samples++] = workers[i].samples[j];
+	free(workers[i].samples);
+    }
+
+    printf("%-10s %8.2f M lookups/s", title, total / elapsed / 1e6);
+    if (samples != NULL && nb_samples > 0) {
+	qsort(samples, nb_samples, sizeof(unsigned long), cmp_ulong);
+	printf(", p50 %lu ns, p99 %lu ns", samples[nb_samples / 2],
+	       samples[nb_samples * 99 / 100]);
+    }
+    putchar('\n');
+
+    free(samples);
+}
+
+/* End of File */
@@ -0,0 +1,810 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/classify.c
+ *
+ * Description: Compiled Packet Classifier
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* Configuration header */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+/* System headers */
+#include <stdlib.h> /* NULL, malloc(), realloc(), free(), qsort(), bsearch() */
+#include <string.h> /* strcmp(), strchr(), strdup()               */
+
+/* Local headers */
+#include "structs.h"
+#include "hashtab.h"
+#include "services.h"
+#include "classify.h"
+
+
+/*****************************************************************************
+ *
+ * Local Datatypes and Variables
+ *
+ */
+
+/* Special trie node indexes: no address below, all addresses below */
+#define TRIE_NONE  0
+#define TRIE_MATCH 1
+
+/* IP protocol numbers */
+#define IPPROTO_NB_TCP 6
+#define IPPROTO_NB_UDP 17
+
+/* Decision node: the first CLS_NB_VERDICTS ones are the verdicts, the other
+ * ones test a match and go on with one of their two successors */
+struct node {
+    unsigned match;   /* Tested match           */
+    unsigned next[2]; /* Next node if false/true */
+};
+
+/* Compiled condition */
+struct match {
+    enum cond_type type; /* Condition type                */
+    enum direction dir;  /* Packet direction              */
+    unsigned trie;       /* Address trie root             */
+    unsigned first[2];   /* First TCP/UDP port range      */
+    unsigned nb[2];      /* Number of TCP/UDP port ranges */
+};
+
+/* Binary trie node */
+struct trie {
+    unsigned child[2]; /* Sub-tries for the next bit being 0/1 */
+};
+
+/* Sorted and disjoint port range */
+struct range {
+    unsigned from, to; /* Bounds (inclusive) */
+};
+
+/* Named chain entry point */
+struct entry {
+    char *name;     /* Chain name                 */
+    unsigned root;  /* Root node                  */
+    unsigned order; /* Position in the config     */
+};
+
+/* Compiled program */
+struct cls_program {
+    struct node *nodes;    /* Decision nodes         */
+    struct match *matches; /* Conditions             */
+    struct trie *tries;    /* Address tries          */
+    struct range *ranges;  /* Port ranges            */
+    struct entry *chains;  /* Chains, sorted by name */
+    unsigned *owners;      /* Chain of each node     */
+    unsigned nb_nodes, nb_matches, nb_tries, nb_ranges, nb_chains;
+    unsigned max_nodes, max_owners, max_matches, max_tries, max_ranges;
+};
+
+/* Compilation state of a chain */
+struct state {
+    struct hsh_elem elem;                     /* Hash table element       */
+    const struct chain *chain;                /* Chain                    */
+    enum { ST_TODO, ST_BUSY, ST_DONE } state; /* Compilation progress     */
+    unsigned root;                            /* Root node, once compiled */
+    unsigned order;                           /* Position in the config   */
+};
+
+/* Compilation context, so that several configurations can be compiled at
+ * the same time */
+struct compiler {
+    struct cls_program *prog; /* Program being filled                 */
+    struct hsh_table states;  /* States of the chains, by name        */
+    unsigned owner;           /* Chain owning the nodes being created */
+    enum cls_error error;     /* Why the compilation failed           */
+    const char *what;         /* What could not be compiled           */
+};
+
+/* Local functions */
+static void *grow(void *array, unsigned *max, size_t elem_size,
+		  unsigned needed);
+static enum bool is_state_of(const struct hsh_elem *elem,
+			     const void *chain);
+static struct state *find_state(const struct compiler *comp,
+				const struct chain *chain);
+static enum bool compile_chain(struct compiler *comp,
+			       const struct chain *chain, unsigned *root);
+static enum bool compile_action(struct compiler *comp,
+				const struct action *action, unsigned *root);
+static enum bool compile_expr(struct compiler *comp,
+			      const struct expr *expr,
+			      unsigned n_then, unsigned n_else,
+			      unsigned *root);
+static enum bool compile_cond(struct compiler *comp,
+			      const struct condition *cond, unsigned *match);
+static enum bool add_prefix(struct cls_program *prog, unsigned *root,
+			    const struct prefix *prefix);
+static enum bool add_ports(struct compiler *comp, struct match *match,
+			   const struct port *port, unsigned which);
+static int cmp_range(const void *a, const void *b);
+static int cmp_entry(const void *a, const void *b);
+static enum bool eval_match(const struct cls_program *prog,
+			    const struct match *match,
+			    unsigned long src, unsigned long dst,
+			    unsigned proto, unsigned sport, unsigned dport);
+static enum bool match_addr(const struct cls_program *prog, unsigned trie,
+			    unsigned long addr);
+static enum bool match_port(const struct cls_program *prog,
+			    unsigned first, unsigned nb, unsigned port);
+
+
+/*****************************************************************************
+ *
+ * Global Functions
+ *
+ */
+
+/*
+ * Compile a configuration into a decision program; on error, return why,
+ * and unless there is not enough memory, what could not be compiled (the
+ * name of a chain, an address or a port name, inside the configuration)
+ */
+enum cls_error cls_compile(const struct chain *const config,
+			   struct cls_program **const res,
+			   const char **const what)
+{
+    struct cls_program *const prog = calloc(1, sizeof(struct cls_program));
+    struct compiler comp;
+    const struct chain *chain;
+    struct state *states;
+    unsigned long i;
+    unsigned *perm;
+    enum bool ok = TRUE;
+
+    *res = NULL;
+    *what = NULL;
+    if (prog == NULL)
+	return CLS_NO_MEMORY;
+
+    /* Index the chains by name */
+    for (chain = config; chain != NULL; chain = chain->next)
+	prog->nb_chains++;
+    comp.prog = prog;
+    comp.states.buckets = NULL;
+    comp.states.size = comp.states.count = 0;
+    comp.owner = 0;
+    comp.error = CLS_NO_MEMORY;
+    comp.what = NULL;
+    states = malloc(sizeof(struct state) * (prog->nb_chains + 1));
+    prog->chains = malloc(sizeof(struct entry) * (prog->nb_chains + 1));
+    if (states == NULL || prog->chains == NULL) {
+	free(states);
+	free(prog->chains);
+	free(prog);
+	return CLS_NO_MEMORY;
+    }
+    for (i = 0, chain = config; chain != NULL; chain = chain->next, i++) {
+	states[i].chain = chain;
+	states[i].state = ST_TODO;
+	states[i].order = (unsigned) i;
+	if (hsh_add(&comp.states, &states[i].elem,
+		    hash_string(HASH_SEED, chain->name)) == FALSE)
+	    ok = FALSE;
+    }
+
+    /* The verdict nodes come first, and the special trie nodes too */
+    prog->nodes = grow(NULL, &prog->max_nodes, sizeof(struct node),
+		       CLS_NB_VERDICTS);
+    prog->owners = grow(NULL, &prog->max_owners, sizeof(unsigned),
+			CLS_NB_VERDICTS);
+    prog->tries = grow(NULL, &prog->max_tries, sizeof(struct trie), 2);
+    if (prog->nodes == NULL || prog->owners == NULL || prog->tries == NULL)
+	ok = FALSE;
+    prog->nb_nodes = CLS_NB_VERDICTS;
+    prog->nb_tries = 2;
+
+    /* Compile all the chains */
+    prog->nb_chains = 0;
+    for (chain = config; ok == TRUE && chain != NULL; chain = chain->next) {
+	/* An entry is counted once its name is there to be freed */
+	if ((prog->chains[prog->nb_chains].name = strdup(chain->name))
+		== NULL) {
+	    ok = FALSE;
+	    continue;
+	}
+	prog->chains[prog->nb_chains].order = prog->nb_chains;
+	if (compile_chain(&comp, chain,
+			  &prog->chains[prog->nb_chains].root) == FALSE)
+	    ok = FALSE;
+	prog->nb_chains++;
+    }
+
+    /* Node owners now refer to the sorted chains */
+    if (ok == TRUE) {
+	qsort(prog->chains, prog->nb_chains, sizeof(struct entry),
+	      cmp_entry);
+	if ((perm = malloc(sizeof(unsigned) * (prog->nb_chains + 1))) == NULL)
+	    ok = FALSE;
+	else {
+	    for (i = 0; i < prog->nb_chains; i++)
+		perm[prog->chains[i].order] = i;
+	    for (i = CLS_NB_VERDICTS; i < prog->nb_nodes; i++)
+		prog->owners[i] = perm[prog->owners[i]];
+	    free(perm);
+	}
+    }
+
+    /* Forget the compilation state */
+    hsh_free(&comp.states, FALSE);
+    free(states);
+
+    if (ok == FALSE) {
+	cls_free(prog);
+	*what = comp.what;
+	return comp.error;
+    }
+    *res = prog;
+    return CLS_OK;
+}
+
+/*
+ * Find the entry point of a chain; return -1 if there is no such chain
+ */
+int cls_find(const struct cls_program *const prog, const char *const name)
+{
+    struct entry key;
+    const struct entry *res;
+
+    key.name = (char *) name;
+    res = bsearch(&key, prog->chains, prog->nb_chains, sizeof(struct entry),
+		  cmp_entry);
+    return res != NULL ? (int) (res - prog->chains) : -1;
+}
+
+/*
+ * Find the verdict of a chain for an IPv4 packet (addresses in host byte
+ * order, ports only meaningful for TCP and UDP)
+ */
+enum cls_verdict cls_classify(const struct cls_program *const prog,
+			      const int chain, const unsigned long src,
+			      const unsigned long dst, const unsigned proto,
+			      const unsigned sport, const unsigned dport)
+{
+    const struct node *const nodes = prog->nodes;
+    unsigned cur = prog->chains[chain].root;
+
+    while (cur >= CLS_NB_VERDICTS)
+	cur = nodes[cur].next[eval_match(prog,
+					 &prog->matches[nodes[cur].match],
+					 src, dst, proto, sport, dport)];
+
+    return (enum cls_verdict) cur;
+}
+
+/*
+ * Same as cls_classify(), also counting in hits (one counter per chain, see
+ * cls_count()) the chains whose tests have been evaluated
+ */
+enum cls_verdict cls_trace(const struct cls_program *const prog,
+			   const int chain, const unsigned long src,
+			   const unsigned long dst, const unsigned proto,
+			   const unsigned sport, const unsigned dport,
+			   unsigned long *const hits)
+{
+    const struct node *const nodes = prog->nodes;
+    unsigned cur = prog->chains[chain].root, owner = (unsigned) chain;
+
+    hits[owner]++;
+    while (cur >= CLS_NB_VERDICTS) {
+	if (prog->owners[cur] != owner) {
+	    owner = prog->owners[cur];
+	    hits[owner]++;
+	}
+	cur = nodes[cur].next[eval_match(prog,
+					 &prog->matches[nodes[cur].match],
+					 src, dst, proto, sport, dport)];
+    }
+
+    return (enum cls_verdict) cur;
+}
+
+/*
+ * Get the number of chains
+ */
+unsigned cls_count(const struct cls_program *const prog)
+{
+    return prog->nb_chains;
+}
+
+/*
+ * Get the name of a chain
+ */
+const char *cls_name(const struct cls_program *const prog, const int chain)
+{
+    return prog->chains[chain].name;
+}
+
+/*
+ * Free a compiled program
+ */
+void cls_free(struct cls_program *const prog)
+{
+    unsigned i;
+
+    if (prog == NULL)
+	return;
+
+    for (i = 0; i < prog->nb_chains; i++)
+	free(prog->chains[i].name);
+    free(prog->chains);
+    free(prog->nodes);
+    free(prog->owners);
+    free(prog->matches);
+    free(prog->tries);
+    free(prog->ranges);
+    free(prog);
+}
+
+
+/*****************************************************************************
+ *
+ * Auxiliary Functions
+ *
+ */
+
+/*
+ * Make room for more elements in a growable array; return the (possibly
+ * moved) array, or NULL if there is not enough memory
+ */
+static void *grow(void *const array, unsigned *const max,
+		  const size_t elem_size, const unsigned needed)
+{
+    unsigned new_max = *max == 0 ? 64 : *max;
+    void *res;
+
+    if (needed <= *max)
+	return array;
+
+    while (new_max < needed)
+	new_max *= 2;
+    if ((res = realloc(array, elem_size * new_max)) != NULL)
+	*max = new_max;
+
+    return res;
+}
+
+/*
+ * Check if a compilation state is the one of a chain
+ */
+static enum bool is_state_of(const struct hsh_elem *const elem,
+			     const void *const chain)
+{
+    return ((const struct state *) elem)->chain == chain ? TRUE : FALSE;
+}
+
+/*
+ * Find the compilation state of a chain, NULL if not in the configuration
+ */
+static struct state *find_state(const struct compiler *const comp,
+				const struct chain *const chain)
+{
+    return (struct state *) hsh_find(&comp->states,
+				     hash_string(HASH_SEED, chain->name),
+				     is_state_of, chain);
+}
+
+/*
+ * Sort port ranges by lower bound
+ */
+static int cmp_range(const void *const a, const void *const b)
+{
+    const struct range *const ra = a, *const rb = b;
+
+    return ra->from < rb->from ? -1 : ra->from > rb->from ? 1 : 0;
+}
+
+/*
+ * Sort chain entries by name
+ */
+static int cmp_entry(const void *const a, const void *const b)
+{
+    return strcmp(((const struct entry *) a)->name,
+		  ((const struct entry *) b)->name);
+}
+
+/*
+ * Evaluate a compiled condition for a packet
+ */
+static enum bool eval_match(const struct cls_program *const prog,
+			    const struct match *const match,
+			    const unsigned long src, const unsigned long dst,
+			    const unsigned proto,
+			    const unsigned sport, const unsigned dport)
+{
+    enum bool res = FALSE;
+    unsigned which;
+
+    if (match->type == COND_ADDR) {
+	if (match->dir != DIR_DST)
+	    res = match_addr(prog, match->trie, src);
+	if (res == FALSE && match->dir != DIR_SRC)
+	    res = match_addr(prog, match->trie, dst);
+    } else if (proto == IPPROTO_NB_TCP || proto == IPPROTO_NB_UDP) {
+	which = proto == IPPROTO_NB_TCP ? 0 : 1;
+	if (match->dir != DIR_DST)
+	    res = match_port(prog, match->first[which], match->nb[which],
+			     sport);
+	if (res == FALSE && match->dir != DIR_SRC)
+	    res = match_port(prog, match->first[which], match->nb[which],
+			     dport);
+    }
+
+    return res;
+}
+
+/*
+ * Check if an address is covered by a trie
+ */
+static enum bool match_addr(const struct cls_program *const prog,
+			    unsigned trie, const unsigned long addr)
+{
+    const struct trie *const tries = prog->tries;
+    unsigned long bit = 0x80000000UL;
+
+    while (trie > TRIE_MATCH) {
+	trie = tries[trie].child[(addr & bit) != 0];
+	bit >>= 1;
+    }
+
+    return trie == TRIE_MATCH ? TRUE : FALSE;
+}
+
+/*
+ * Check if a port is in one of a sorted array of ranges
+ */
+static enum bool match_port(const struct cls_program *const prog,
+			    const unsigned first, unsigned nb,
+			    const unsigned port)
+{
+    const struct range *range = prog->ranges + first;
+    unsigned half;
+
+    /* Find the last range starting before the port */
+    while (nb > 1) {
+	half = nb / 2;
+	if (range[half].from <= port) {
+	    range += half;
+	    nb -= half;
+	} else
+	    nb = half;
+    }
+
+    return nb == 1 && range->from <= port && port <= range->to
+	   ? TRUE : FALSE;
+}
+
+
+/*****************************************************************************
+ *
+ * Local Functions
+ *
+ */
+
+/*
+ * Compile a chain (once), a user-defined target being directly replaced by
+ * the root node of its chain
+ */
+static enum bool compile_chain(struct compiler *const comp,
+			       const struct chain *const chain,
+			       unsigned *const root)
+{
+    struct state *const state = find_state(comp, chain);
+    unsigned owner;
+
+    if (state == NULL) {
+	comp->error = CLS_BAD_CHAIN;
+	comp->what = chain->name;
+	return FALSE;
+    }
+
+    switch (state->state) {
+    case ST_DONE:
+	*root = state->root;
+	return TRUE;
+
+    case ST_BUSY:
+	comp->error = CLS_LOOP;
+	comp->what = chain->name;
+	return FALSE;
+
+    case ST_TODO:
+	break;
+    }
+
+    state->state = ST_BUSY;
+    owner = comp->owner;
+    comp->owner = state->order;
+    if (compile_action(comp, chain->action, &state->root) == FALSE)
+	return FALSE;
+    comp->owner = owner;
+    state->state = ST_DONE;
+
+    *root = state->root;
+    return TRUE;
+}
+
+/*
+ * Compile an action
+ */
+static enum bool compile_action(struct compiler *const comp,
+				const struct action *const action,
+				unsigned *const root)
+{
+    unsigned n_then, n_else;
+
+    switch (action->type) {
+    case TARGET_FINAL:
+	switch (action->action.final) {
+	case FINAL_ACCEPT:
+	    *root = CLS_ACCEPT;
+	    break;
+
+	case FINAL_DROP:
+	    *root = CLS_DROP;
+	    break;
+
+	case FINAL_REJECT:
+	    *root = CLS_REJECT;
+	}
+	return TRUE;
+
+    case TARGET_USER:
+	return compile_chain(comp, action->action.user, root);
+
+    case TARGET_TEST:
+	return compile_action(comp, action->action.test->act_then, &n_then)
+	       && compile_action(comp, action->action.test->act_else, &n_else)
+	       && compile_expr(comp, action->action.test->expr,
+			       n_then, n_else, root) ? TRUE : FALSE;
+    }
+
+    return FALSE;
+}
+
+/*
+ * Compile an expression into short-circuit decision nodes
+ */
+static enum bool compile_expr(struct compiler *const comp,
+			      const struct expr *const expr,
+			      unsigned n_then, unsigned n_else,
+			      unsigned *const root)
+{
+    struct cls_program *const prog = comp->prog;
+    unsigned inter, match, *owners;
+    struct node *node;
+
+    if (expr->not) {
+	const unsigned tmp = n_then;
+	n_then = n_else;
+	n_else = tmp;
+    }
+
+    switch (expr->type) {
+    case EXPR_COND:
+	if (compile_cond(comp, expr->sub.cond, &match) == FALSE)
+	    return FALSE;
+	if ((node = grow(prog->nodes, &prog->max_nodes, sizeof(struct node),
+			 prog->nb_nodes + 1)) == NULL)
+	    return FALSE;
+	prog->nodes = node;
+	node += prog->nb_nodes;
+	if ((owners = grow(prog->owners, &prog->max_owners, sizeof(unsigned),
+			   prog->nb_nodes + 1)) == NULL)
+	    return FALSE;
+	prog->owners = owners;
+	owners[prog->nb_nodes] = comp->owner;
+	node->match = match;
+	node->next[FALSE] = n_else;
+	node->next[TRUE] = n_then;
+	*root = prog->nb_nodes++;
+	return TRUE;
+
+    case EXPR_AND:
+	return compile_expr(comp, expr->sub.expr.right, n_then, n_else,
+			    &inter)
+	       && compile_expr(comp, expr->sub.expr.left, inter, n_else, root)
+	       ? TRUE : FALSE;
+
+    case EXPR_OR:
+	return compile_expr(comp, expr->sub.expr.right, n_then, n_else,
+			    &inter)
+	       && compile_expr(comp, expr->sub.expr.left, n_then, inter, root)
+	       ? TRUE : FALSE;
+    }
+
+    return FALSE;
+}
+
+/*
+ * Compile a condition: an address trie, or sorted port ranges for TCP and
+ * UDP
+ */
+static enum bool compile_cond(struct compiler *const comp,
+			      const struct condition *const cond,
+			      unsigned *const match)
+{
+    struct cls_program *const prog = comp->prog;
+    struct match *res;
+    const struct addr *addr;
+    struct prefix prefix;
+
+    if ((res = grow(prog->matches, &prog->max_matches, sizeof(struct match),
+		    prog->nb_matches + 1)) == NULL)
+	return FALSE;
+    prog->matches = res;
+    res += prog->nb_matches;
+    res->type = cond->type;
+    res->dir = cond->dir;
+    res->trie = TRIE_NONE;
+    res->first[0] = res->first[1] = 0;
+    res->nb[0] = res->nb[1] = 0;
+
+    switch (cond->type) {
+    case COND_ADDR:
+	/* Packets are IPv4 ones */
+	if (cond->proto == PROTO_IPV6)
+	    break;
+
+	for (addr = cond->cond.addr; addr != NULL; addr = addr->next)
+	    if (addr_to_prefix(addr, &prefix) == TRUE) {
+		if (add_prefix(prog, &res->trie, &prefix) == FALSE)
+		    return FALSE;
+	    } else if (strchr(addr->string, ':') == NULL) {
+		comp->error = CLS_BAD_ADDRESS;
+		comp->what = addr->string;
+		return FALSE;
+	    }
+	break;
+
+    case COND_PORT:
+	if (cond->proto != PROTO_UDP
+	    && add_ports(comp, res, cond->cond.port, 0) == FALSE)
+	    return FALSE;
+	if (cond->proto != PROTO_TCP
+	    && add_ports(comp, res, cond->cond.port, 1) == FALSE)
+	    return FALSE;
+    }
+
+    *match = prog->nb_matches++;
+    return TRUE;
+}
+
+/*
+ * Add a prefix to an address trie, more specific prefixes being pruned
+ */
+static enum bool add_prefix(struct cls_program *const prog,
+			    unsigned *const root,
+			    const struct prefix *const prefix)
+{
+    unsigned long bit = 0x80000000UL;
+    unsigned node, parent = 0, side = 0, i;
+    struct trie *tries;
+
+    if (prefix->len == 0) {
+	*root = TRIE_MATCH;
+	return TRUE;
+    }
+
+    for (i = 0, node = *root; ; i++, bit >>= 1) {
+	if (node == TRIE_MATCH)
+	    return TRUE;
+
+	/* New node, linked from the root or the previous node */
+	if (node == TRIE_NONE) {
+	    if ((tries = grow(prog->tries, &prog->max_tries,
+			      sizeof(struct trie), prog->nb_tries + 1)) == NULL)
+		return FALSE;
+	    prog->tries = tries;
+	    tries[prog->nb_tries].child[0] = TRIE_NONE;
+	    tries[prog->nb_tries].child[1] = TRIE_NONE;
+	    node = prog->nb_tries++;
+	    if (i == 0)
+		*root = node;
+	    else
+		tries[parent].child[side] = node;
+	}
+
+	side = (prefix->net & bit) != 0;
+	if (i + 1 == prefix->len) {
+	    prog->tries[node].child[side] = TRIE_MATCH;
+	    return TRUE;
+	}
+	parent = node;
+	node = prog->tries[node].child[side];
+    }
+}
+
+/*
+ * Add the sorted and merged port ranges of a list for TCP (which = 0) or UDP
+ * (which = 1), the reversed ones being put back in order
+ */
+static enum bool add_ports(struct compiler *const comp,
+			   struct match *const match,
+			   const struct port *const list,
+			   const unsigned which)
+{
+    struct cls_program *const prog = comp->prog;
+    const struct port *port;
+    struct range *ranges;
+    unsigned short number;
+    unsigned nb = 0, i;
+
+    for (port = list; port != NULL; port = port->next)
+	nb++;
+    if ((ranges = grow(prog->ranges, &prog->max_ranges, sizeof(struct range),
+		       prog->nb_ranges + nb)) == NULL)
+	return FALSE;
+    prog->ranges = ranges;
+    ranges += prog->nb_ranges;
+
+    for (nb = 0, port = list; port != NULL; port = port->next, nb++)
+	if (port->type == PORT_NUMERIC) {
+	    ranges[nb].from = port->port.range.from;
+	    ranges[nb].to = port->port.range.to;
+	    if (ranges[nb].from > ranges[nb].to) {
+		ranges[nb].from = port->port.range.to;
+		ranges[nb].to = port->port.range.from;
+	    }
+	} else {
+	    if (srv_find(port->port.name, which == 0 ? PROTO_TCP : PROTO_UDP,
+			 &number) == TRUE) {
+		ranges[nb].from = ranges[nb].to = number;
+		continue;
+	    }
+	    comp->error = CLS_BAD_PORT;
+	    comp->what = port->port.name;
+	    return FALSE;
+	}
+
+    /* Sort, then merge overlapping and adjacent ranges */
+    qsort(ranges, nb, sizeof(struct range), cmp_range);
+    for (i = 1, match->nb[which] = nb > 0 ? 1 : 0; i < nb; i++) {
+	struct range *const last = &ranges[match->nb[which] - 1];
+
+	if (ranges[i].from <= last->to + 1) {
+	    if (ranges[i].to > last->to)
+		last->to = ranges[i].to;
+	} else
+	    ranges[match->nb[which]++] = ranges[i];
+    }
+
+    match->first[which] = prog->nb_ranges;
+    prog->nb_ranges += match->nb[which];
+    return TRUE;
+}
+
+/* End of File */
@@ -0,0 +1,82 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/classify.h
+ *
+ * Description: Compiled Packet Classifier Header
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/* Process only once */
+#ifndef CLASSIFY_H
+#define CLASSIFY_H
+
+/* C++ protection */
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Parsed configuration chain (see structs.h) */
+struct chain;
+
+/* Verdicts (also the indexes of the final decision nodes) */
+enum cls_verdict { CLS_ACCEPT, CLS_DROP, CLS_REJECT, CLS_NB_VERDICTS };
+
+/* Compilation results */
+enum cls_error {
+    CLS_OK,          /* Compiled                          */
+    CLS_NO_MEMORY,   /* Not enough memory                 */
+    CLS_LOOP,        /* A chain jumps to itself           */
+    CLS_BAD_ADDRESS, /* Address not supported (not IPv4)  */
+    CLS_BAD_PORT,    /* Unknown port name                 */
+    CLS_BAD_CHAIN    /* Target chain not in the config    */
+};
+
+/* Compiled configuration (opaque) */
+struct cls_program;
+
+/* Classifier functions */
+enum cls_error cls_compile(const struct chain *config,
+			   struct cls_program **prog, const char **what);
+int cls_find(const struct cls_program *prog, const char *name);
+enum cls_verdict cls_classify(const struct cls_program *prog, int chain,
+			      unsigned long src, unsigned long dst,
+			      unsigned proto, unsigned sport, unsigned dport);
+enum cls_verdict cls_trace(const struct cls_program *prog, int chain,
+			   unsigned long src, unsigned long dst,
+			   unsigned proto, unsigned sport, unsigned dport,
+			   unsigned long *hits);
+unsigned cls_count(const struct cls_program *prog);
+const char *cls_name(const struct cls_program *prog, int chain);
+void cls_free(struct cls_program *prog);
+
+/* C++ protection */
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !CLASSIFY_H */
+
+/* End of File */
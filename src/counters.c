@@ -0,0 +1,101 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/counters.c
+ *
+ * Description: Packet Counters Reader
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* System headers */
+#include <stdlib.h> /* strtod()           */
+#include <stdio.h>  /* FILE *, fgets()    */
+#include <string.h> /* strchr(), strtok() */
+
+/* Local headers */
+#include "structs.h"
+#include "counters.h"
+
+
+/*****************************************************************************
+ *
+ * Local Datatypes and Variables
+ *
+ */
+
+/* Maximum length of a rule line */
+#define LINE_SIZE 4096
+
+/* Characters separating the options of a rule */
+#define BLANKS " \t\n"
+
+
+/*****************************************************************************
+ *
+ * Global Functions
+ *
+ */
+
+/*
+ * Read the output of "iptables-save -c", giving the counters and the
+ * options of each rule to a function; return FALSE if it fails
+ */
+enum bool cnt_read(FILE *const in, cnt_rule *const func)
+{
+    char line[LINE_SIZE], *tokens[LINE_SIZE / 2 + 1], *token, *end;
+    double packets, bytes;
+    unsigned nb;
+
+    while (fgets(line, LINE_SIZE, in) != NULL) {
+	/* Only the rules have counters: "[packets:bytes] -A chain ..." */
+	if (line[0] != '[' || (end = strchr(line, ']')) == NULL)
+	    continue;
+	*end = '\0';
+	packets = strtod(line + 1, &token);
+	if (*token != ':')
+	    continue;
+	bytes = strtod(token + 1, NULL);
+
+	/* Split the options */
+	nb = 0;
+	for (token = strtok(end + 1, BLANKS); token != NULL;
+	     token = strtok(NULL, BLANKS))
+	    tokens[nb++] = token;
+	tokens[nb] = NULL;
+
+	if (func(packets, bytes, tokens) == FALSE)
+	    return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* End of File */
@@ -0,0 +1,540 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/flat.c
+ *
+ * Description: Flat Configuration Layout
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* System headers */
+#include <stdlib.h> /* NULL, malloc(), calloc(), free() */
+
+/* Local headers */
+#include "structs.h"
+#include "hashtab.h"
+#include "intern.h"
+#include "flat.h"
+
+
+/*****************************************************************************
+ *
+ * Local Datatypes and Variables
+ *
+ */
+
+/* Flat configuration being built */
+struct builder {
+    struct flat *flat;          /* Configuration being filled     */
+    enum bool sources;          /* Wether to keep the source IDs  */
+    enum bool ok;               /* Wether there was enough memory */
+    struct itn_chains chains;   /* Indices of the chains          */
+    struct itn_strings strings; /* Strings, each one once         */
+};
+
+/* Hash value combination, the Bernstein one being as in structs.c */
+#define HASH(hash, value) FLAT_MIX(func, hash, value)
+
+/* Source ID combination, leaving the hash value unchanged without it */
+#define HASH_SRC(hash, src) ((src) != 0 ? HASH(hash, src) : (hash))
+
+/* Prototypes */
+static void count_action(struct builder *builder,
+			 const struct action *action);
+static void count_expr(struct builder *builder, const struct expr *expr);
+static unsigned put_action(struct builder *builder,
+			   const struct action *action);
+static unsigned put_expr(struct builder *builder, const struct expr *expr);
+static unsigned put_cond(struct builder *builder,
+			 const struct condition *cond);
+static unsigned put_string(struct builder *builder, const char *string);
+static unsigned long hash_cond(const struct flat *flat, unsigned cond,
+				enum flat_hash func);
+static enum bool equal_cond(const struct flat *flat, unsigned a,
+			    unsigned b);
+
+
+/*****************************************************************************
+ *
+ * Global Functions
+ *
+ */
+
+/*
+ * Flatten a configuration, with the source IDs of the nodes if asked to;
+ * the strings are copied, so that the linked nodes can be released
+ * afterwards
+ */
+struct flat *flat_config(const struct chain *const config,
+			 const enum bool sources)
+{
+    struct builder builder;
+    struct flat *flat;
+    const struct chain *chain;
+    unsigned i;
+
+    if ((flat = calloc(1, sizeof(struct flat))) == NULL)
+	return NULL;
+    builder.flat = flat;
+    builder.sources = sources;
+    builder.ok = TRUE;
+    builder.strings.data = NULL;
+    builder.strings.len = builder.strings.max = 0;
+    builder.strings.index.buckets = NULL;
+    builder.strings.index.size = builder.strings.index.count = 0;
+
+    /* Count the nodes, so that each array is allocated once */
+    for (chain = config; chain != NULL; chain = chain->next) {
+	flat->nb_chains++;
+	count_action(&builder, chain->action);
+    }
+    if (itn_chains(&builder.chains, config) == FALSE) {
+	flat_free(flat);
+	return NULL;
+    }
+    flat->chains = malloc(sizeof(struct flat_chain) * (flat->nb_chains + 1));
+    flat->actions = malloc(sizeof(struct flat_action)
+			   * (flat->nb_actions + 1));
+    flat->tests = malloc(sizeof(struct flat_test) * (flat->nb_tests + 1));
+    flat->exprs = malloc(sizeof(struct flat_expr) * (flat->nb_exprs + 1));
+    flat->conds = malloc(sizeof(struct flat_cond) * (flat->nb_conds + 1));
+    flat->addrs = malloc(sizeof(unsigned) * (flat->nb_addrs + 1));
+    flat->ports = malloc(sizeof(struct flat_port) * (flat->nb_ports + 1));
+    if (flat->chains == NULL || flat->actions == NULL
+	|| flat->tests == NULL || flat->exprs == NULL || flat->conds == NULL
+	|| flat->addrs == NULL || flat->ports == NULL) {
+	itn_free_chains(&builder.chains);
+	flat_free(flat);
+	return NULL;
+    }
+
+    /* Then fill the arrays, the counters being set again */
+    flat->nb_actions = flat->nb_tests = flat->nb_exprs = flat->nb_conds = 0;
+    flat->nb_addrs = flat->nb_ports = 0;
+    for (chain = config, i = 0; chain != NULL; chain = chain->next, i++) {
+	flat->chains[i].name = put_string(&builder, chain->name);
+	flat->chains[i].action = put_action(&builder, chain->action);
+	flat->chains[i].src = sources == TRUE ? chain->src : 0;
+    }
+
+    /* The strings are kept, their index is not */
+    flat->strings = builder.strings.data;
+    flat->strings_len = builder.strings.len;
+    itn_free_strings(&builder.strings, FALSE);
+    itn_free_chains(&builder.chains);
+    if (builder.ok == FALSE) {
+	flat_free(flat);
+	return NULL;
+    }
+    return flat;
+}
+
+/*
+ * Free a flat configuration
+ */
+void flat_free(struct flat *const flat)
+{
+    if (flat == NULL)
+	return;
+
+    free(flat->strings);
+    free(flat->ports);
+    free(flat->addrs);
+    free(flat->conds);
+    free(flat->exprs);
+    free(flat->tests);
+    free(flat->actions);
+    free(flat->chains);
+    free(flat);
+}
+
+
+/*****************************************************************************
+ *
+ * Comparison Functions
+ *
+ */
+
+/*
+ * Combine the characters of a string into a hash value
+ */
+unsigned long flat_hash_string(unsigned long hash, const char *string,
+			       const enum flat_hash func)
+{
+    while (*string != '\0')
+	hash = HASH(hash, (unsigned char) *string++);
+
+    return hash;
+}
+
+/*
+ * Compute the hash value of an action with a hash function, the Bernstein
+ * one giving the same as hash_action() unless the source IDs are kept
+ */
+unsigned long flat_hash_action(const struct flat *const flat,
+			       const unsigned action,
+			       const enum flat_hash func)
+{
+    const struct flat_action *const node = FLAT_ACTION(flat, action);
+    const struct flat_test *test;
+    unsigned long hash = HASH_SRC(HASH(FLAT_SEED(func), node->type),
+				  node->src);
+
+    switch (node->type) {
+    case TARGET_FINAL:
+	return HASH(hash, node->value);
+
+    case TARGET_USER:
+	return flat_hash_string(hash, FLAT_NAME(flat, node->value), func);
+
+    case TARGET_TEST:
+	test = FLAT_TEST(flat, node->value);
+	hash = HASH_SRC(hash, test->src);
+	hash = HASH(hash, flat_hash_expr(flat, test->expr, func));
+	hash = HASH(hash, flat_hash_action(flat, test->act_then, func));
+	return HASH(hash, flat_hash_action(flat, test->act_else, func));
+    }
+
+    return hash;
+}
+
+/*
+ * Compute the hash value of an expression with a hash function, the
+ * Bernstein one giving the same as hash_expr() unless the source IDs are
+ * kept
+ */
+unsigned long flat_hash_expr(const struct flat *const flat,
+			     const unsigned expr, const enum flat_hash func)
+{
+    const struct flat_expr *const node = FLAT_EXPR(flat, expr);
+    unsigned long hash = HASH_SRC(HASH(FLAT_SEED(func), node->type),
+				  node->src);
+
+    hash = HASH(hash, node->not);
+    if (node->type == EXPR_COND)
+	return HASH(hash, hash_cond(flat, node->left, func));
+
+    hash = HASH(hash, flat_hash_expr(flat, node->left, func));
+    return HASH(hash, flat_hash_expr(flat, node->right, func));
+}
+
+/*
+ * Check if two actions are identical
+ */
+enum bool flat_equal_action(const struct flat *const flat, const unsigned a,
+			    const unsigned b)
+{
+    const struct flat_action *const node_a = FLAT_ACTION(flat, a);
+    const struct flat_action *const node_b = FLAT_ACTION(flat, b);
+    const struct flat_test *test_a, *test_b;
+
+    if (a == b)
+	return TRUE;
+    if (node_a->type != node_b->type || node_a->src != node_b->src)
+	return FALSE;
+    if (node_a->type != TARGET_TEST)
+	return node_a->value == node_b->value ? TRUE : FALSE;
+
+    test_a = FLAT_TEST(flat, node_a->value);
+    test_b = FLAT_TEST(flat, node_b->value);
+    return test_a->src == test_b->src
+	   && flat_equal_expr(flat, test_a->expr, test_b->expr)
+	   && flat_equal_action(flat, test_a->act_then, test_b->act_then)
+	   && flat_equal_action(flat, test_a->act_else, test_b->act_else)
+	   ? TRUE : FALSE;
+}
+
+/*
+ * Check if two expressions are identical
+ */
+enum bool flat_equal_expr(const struct flat *const flat, const unsigned a,
+			  const unsigned b)
+{
+    const struct flat_expr *const node_a = FLAT_EXPR(flat, a);
+    const struct flat_expr *const node_b = FLAT_EXPR(flat, b);
+
+    if (a == b)
+	return TRUE;
+    if (node_a->type != node_b->type || node_a->not != node_b->not
+	|| node_a->src != node_b->src)
+	return FALSE;
+
+    if (node_a->type == EXPR_COND)
+	return equal_cond(flat, node_a->left, node_b->left);
+
+    return flat_equal_expr(flat, node_a->left, node_b->left)
+	   && flat_equal_expr(flat, node_a->right, node_b->right)
+	   ? TRUE : FALSE;
+}
+
+
+/*****************************************************************************
+ *
+ * Local Functions
+ *
+ */
+
+/*
+ * Count the nodes of an action
+ */
+static void count_action(struct builder *const builder,
+			 const struct action *const action)
+{
+    builder->flat->nb_actions++;
+    if (action->type != TARGET_TEST)
+	return;
+
+    builder->flat->nb_tests++;
+    count_expr(builder, action->action.test->expr);
+    count_action(builder, action->action.test->act_then);
+    count_action(builder, action->action.test->act_else);
+}
+
+/*
+ * Count the nodes of an expression
+ */
+static void count_expr(struct builder *const builder,
+		       const struct expr *const expr)
+{
+    const struct addr *addr;
+    const struct port *port;
+
+    builder->flat->nb_exprs++;
+    if (expr->type != EXPR_COND) {
+	count_expr(builder, expr->sub.expr.left);
+	count_expr(builder, expr->sub.expr.right);
+	return;
+    }
+
+    builder->flat->nb_conds++;
+    if (expr->sub.cond->type == COND_ADDR)
+	for (addr = expr->sub.cond->cond.addr; addr != NULL;
+	     addr = addr->next)
+	    builder->flat->nb_addrs++;
+    else
+	for (port = expr->sub.cond->cond.port; port != NULL;
+	     port = port->next)
+	    builder->flat->nb_ports++;
+}
+
+/*
+ * Store an action and its nodes, returning its index
+ */
+static unsigned put_action(struct builder *const builder,
+			   const struct action *const action)
+{
+    struct flat *const flat = builder->flat;
+    const unsigned index = flat->nb_actions++;
+    struct flat_action *const node = FLAT_ACTION(flat, index);
+    unsigned test, chain;
+
+    node->type = (unsigned) action->type;
+    node->src = builder->sources == TRUE ? action->src : 0;
+    switch (action->type) {
+    case TARGET_FINAL:
+	node->value = (unsigned) action->action.final;
+	break;
+
+    case TARGET_USER:
+	chain = itn_chain(&builder->chains, action->action.user);
+	node->value = chain != ITN_NONE ? chain : FLAT_NONE;
+	break;
+
+    case TARGET_TEST:
+	node->value = test = flat->nb_tests++;
+	FLAT_TEST(flat, test)->src = builder->sources == TRUE
+				     ? action->action.test->src : 0;
+	FLAT_TEST(flat, test)->expr
+		= put_expr(builder, action->action.test->expr);
+	FLAT_TEST(flat, test)->act_then
+		= put_action(builder, action->action.test->act_then);
+	FLAT_TEST(flat, test)->act_else
+		= put_action(builder, action->action.test->act_else);
+    }
+
+    return index;
+}
+
+/*
+ * Store an expression and its nodes, returning its index
+ */
+static unsigned put_expr(struct builder *const builder,
+			 const struct expr *const expr)
+{
+    struct flat *const flat = builder->flat;
+    const unsigned index = flat->nb_exprs++;
+    struct flat_expr *const node = FLAT_EXPR(flat, index);
+
+    node->type = (unsigned char) expr->type;
+    node->not = (unsigned char) expr->not;
+    node->src = builder->sources == TRUE ? expr->src : 0;
+    if (expr->type == EXPR_COND) {
+	node->left = put_cond(builder, expr->sub.cond);
+	node->right = FLAT_NONE;
+    } else {
+	node->left = put_expr(builder, expr->sub.expr.left);
+	node->right = put_expr(builder, expr->sub.expr.right);
+    }
+
+    return index;
+}
+
+/*
+ * Store a condition, its addresses or ports being added after the previous
+ * ones, returning its index
+ */
+static unsigned put_cond(struct builder *const builder,
+			 const struct condition *const cond)
+{
+    struct flat *const flat = builder->flat;
+    const unsigned index = flat->nb_conds++;
+    struct flat_cond *const node = FLAT_COND(flat, index);
+    const struct addr *addr;
+    const struct port *port;
+    struct flat_port *elem;
+
+    node->type = (unsigned char) cond->type;
+    node->dir = (unsigned char) cond->dir;
+    node->proto = (unsigned char) cond->proto;
+    node->src = builder->sources == TRUE ? cond->src : 0;
+
+    if (cond->type == COND_ADDR) {
+	node->first = flat->nb_addrs;
+	for (addr = cond->cond.addr; addr != NULL; addr = addr->next)
+	    flat->addrs[flat->nb_addrs++] = put_string(builder, addr->string);
+	node->nb = flat->nb_addrs - node->first;
+    } else {
+	node->first = flat->nb_ports;
+	for (port = cond->cond.port; port != NULL; port = port->next) {
+	    elem = flat->ports + flat->nb_ports++;
+	    if (port->type == PORT_NAME) {
+		elem->name = put_string(builder, port->port.name);
+		elem->range.from = elem->range.to = 0;
+	    } else {
+		elem->name = FLAT_NONE;
+		elem->range = port->port.range;
+	    }
+	}
+	node->nb = flat->nb_ports - node->first;
+    }
+
+    return index;
+}
+
+/*
+ * Store a string unless already stored, returning its offset (0 without
+ * memory, the whole configuration being dropped then)
+ */
+static unsigned put_string(struct builder *const builder,
+			   const char *const string)
+{
+    unsigned offset;
+
+    if (itn_string(&builder->strings, string, &offset) == FALSE) {
+	builder->ok = FALSE;
+	return 0;
+    }
+    return offset;
+}
+
+/*
+ * Compute the hash value of a condition with a hash function, the Bernstein
+ * one giving the same as hash_condition() in structs.c
+ */
+static unsigned long hash_cond(const struct flat *const flat,
+			       const unsigned cond,
+			       const enum flat_hash func)
+{
+    const struct flat_cond *const node = FLAT_COND(flat, cond);
+    const struct flat_port *port;
+    unsigned long hash = FLAT_SEED(func);
+    unsigned i;
+
+    hash = HASH_SRC(HASH(hash, node->type), node->src);
+    hash = HASH(hash, node->dir);
+    hash = HASH(hash, node->proto);
+
+    if (node->type == COND_ADDR)
+	for (i = 0; i < node->nb; i++)
+	    hash = flat_hash_string(HASH(hash, ','), FLAT_ADDR(flat, node, i),
+				    func);
+    else
+	for (i = 0; i < node->nb; i++) {
+	    port = FLAT_PORT(flat, node, i);
+	    if (port->name != FLAT_NONE)
+		hash = flat_hash_string(HASH(hash, ','),
+					FLAT_STRING(flat, port->name), func);
+	    else {
+		hash = HASH(hash, port->range.from);
+		hash = HASH(hash, port->range.to);
+	    }
+	}
+
+    return hash;
+}
+
+/*
+ * Check if two conditions are identical (including the order of the list
+ * elements); the strings being stored once, their offsets are compared
+ */
+static enum bool equal_cond(const struct flat *const flat, const unsigned a,
+			    const unsigned b)
+{
+    const struct flat_cond *const node_a = FLAT_COND(flat, a);
+    const struct flat_cond *const node_b = FLAT_COND(flat, b);
+    const struct flat_port *port_a, *port_b;
+    unsigned i;
+
+    if (node_a->type != node_b->type || node_a->dir != node_b->dir
+	|| node_a->proto != node_b->proto || node_a->nb != node_b->nb
+	|| node_a->src != node_b->src)
+	return FALSE;
+
+    if (node_a->type == COND_ADDR) {
+	for (i = 0; i < node_a->nb; i++)
+	    if (flat->addrs[node_a->first + i]
+		!= flat->addrs[node_b->first + i])
+		return FALSE;
+	return TRUE;
+    }
+
+    for (i = 0; i < node_a->nb; i++) {
+	port_a = FLAT_PORT(flat, node_a, i);
+	port_b = FLAT_PORT(flat, node_b, i);
+	if (port_a->name != port_b->name
+	    || port_a->range.from != port_b->range.from
+	    || port_a->range.to != port_b->range.to)
+	    return FALSE;
+    }
+    return TRUE;
+}
+
+/* End of File */
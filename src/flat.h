@@ -0,0 +1,162 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/flat.h
+ *
+ * Description: Flat Configuration Layout Header
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/* Process only once */
+#ifndef FLAT_H
+#define FLAT_H
+
+/* C++ protection */
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* System headers */
+#include <stddef.h> /* size_t */
+
+/* Local headers */
+#include "structs.h"
+
+/*
+ * A configuration flattened in one array per node type, nodes referring to
+ * each other by 32-bit indices, and the addresses and ports of a condition
+ * lying next to each other; every string is stored once, so that identical
+ * strings have the same offset.  The source IDs are kept on demand only:
+ * then they take part in the comparisons, so that identical nodes from
+ * different places are told apart.
+ */
+
+/* No node */
+#define FLAT_NONE 0xFFFFFFFFU
+
+/* Chain */
+struct flat_chain {
+    unsigned name;   /* Name (string offset) */
+    unsigned action; /* Associated action    */
+    unsigned src;    /* Source ID, or 0      */
+};
+
+/* Action */
+struct flat_action {
+    unsigned type;  /* TARGET_FINAL, TARGET_USER or TARGET_TEST   */
+    unsigned value; /* Final target, chain index, or test index   */
+    unsigned src;   /* Source ID, or 0                            */
+};
+
+/* Test */
+struct flat_test {
+    unsigned expr;               /* Associated test expression */
+    unsigned act_then, act_else; /* Taken actions              */
+    unsigned src;                /* Source ID, or 0            */
+};
+
+/* Expression */
+struct flat_expr {
+    unsigned char type;   /* Expression type                      */
+    unsigned char not;    /* Wether to negate test ("!" operator) */
+    unsigned left, right; /* Operands, or condition and FLAT_NONE */
+    unsigned src;         /* Source ID, or 0                      */
+};
+
+/* Condition */
+struct flat_cond {
+    unsigned char type;  /* Condition type                      */
+    unsigned char dir;   /* Packet direction                    */
+    unsigned char proto; /* Concerned protocol                  */
+    unsigned first, nb;  /* Range of its addresses, or of ports */
+    unsigned src;        /* Source ID, or 0                     */
+};
+
+/* Port number/range/name */
+struct flat_port {
+    unsigned name;         /* Name (string offset), FLAT_NONE if numeric */
+    struct one_port range; /* Port range                                 */
+};
+
+/* Flat configuration */
+struct flat {
+    struct flat_chain *chains;   /* Chains, in order                */
+    struct flat_action *actions; /* Actions                         */
+    struct flat_test *tests;     /* Tests                           */
+    struct flat_expr *exprs;     /* Expressions                     */
+    struct flat_cond *conds;     /* Conditions                      */
+    unsigned *addrs;             /* Addresses (string offsets)      */
+    struct flat_port *ports;     /* Ports                           */
+    char *strings;               /* Strings, each one once          */
+    unsigned nb_chains, nb_actions, nb_tests, nb_exprs, nb_conds;
+    unsigned nb_addrs, nb_ports; /* Numbers of nodes                */
+    size_t strings_len;          /* Size of the strings             */
+};
+
+/* Node accessors */
+#define FLAT_CHAIN(flat, index)  ((flat)->chains + (index))
+#define FLAT_ACTION(flat, index) ((flat)->actions + (index))
+#define FLAT_TEST(flat, index)   ((flat)->tests + (index))
+#define FLAT_EXPR(flat, index)   ((flat)->exprs + (index))
+#define FLAT_COND(flat, index)   ((flat)->conds + (index))
+#define FLAT_STRING(flat, offset) ((flat)->strings + (offset))
+
+/* Element accessors: name of a chain, address or port of a condition */
+#define FLAT_NAME(flat, index) \
+	FLAT_STRING(flat, FLAT_CHAIN(flat, index)->name)
+#define FLAT_ADDR(flat, cond, i) \
+	FLAT_STRING(flat, (flat)->addrs[(cond)->first + (i)])
+#define FLAT_PORT(flat, cond, i) ((flat)->ports + (cond)->first + (i))
+
+/* Hash functions (see HASH_MIX() and HASH_FNV_MIX() in structs.h) */
+enum flat_hash { FLAT_BERNSTEIN, FLAT_FNV };
+
+/* Initial hash value, and combination of a value into a hash value */
+#define FLAT_SEED(func) ((func) == FLAT_FNV ? HASH_FNV_SEED : HASH_SEED)
+#define FLAT_MIX(func, hash, value) \
+	((func) == FLAT_FNV ? HASH_FNV_MIX(hash, value) \
+	 : HASH_MIX(hash, value))
+
+/* Flat configuration functions */
+struct flat *flat_config(const struct chain *config, enum bool sources);
+void flat_free(struct flat *flat);
+unsigned long flat_hash_string(unsigned long hash, const char *string,
+			       enum flat_hash func);
+unsigned long flat_hash_action(const struct flat *flat, unsigned action,
+			       enum flat_hash func);
+unsigned long flat_hash_expr(const struct flat *flat, unsigned expr,
+			     enum flat_hash func);
+enum bool flat_equal_action(const struct flat *flat, unsigned a,
+			    unsigned b);
+enum bool flat_equal_expr(const struct flat *flat, unsigned a, unsigned b);
+
+/* C++ protection */
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !FLAT_H */
+
+/* End of File */
@@ -0,0 +1,161 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/hashtab.c
+ *
+ * Description: Hash Tables
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* System headers */
+#include <stdlib.h> /* NULL, calloc(), free() */
+
+/* Local headers */
+#include "structs.h"
+#include "hashtab.h"
+
+
+/*****************************************************************************
+ *
+ * Local Datatypes and Variables
+ *
+ */
+
+/* Initial number of buckets (must be a power of two) */
+#define INITIAL_SIZE 256
+
+
+/*****************************************************************************
+ *
+ * Local Functions
+ *
+ */
+
+/*
+ * Double the number of buckets, keeping the elements; without memory, the
+ * lists just get longer
+ */
+static void grow(struct hsh_table *const table)
+{
+    struct hsh_elem **const buckets
+	    = calloc(table->size * 2, sizeof(struct hsh_elem *));
+    struct hsh_elem *elem, *next;
+    unsigned long i;
+
+    if (buckets == NULL)
+	return;
+
+    for (i = 0; i < table->size; i++)
+	for (elem = table->buckets[i]; elem != NULL; elem = next) {
+	    next = elem->next;
+	    elem->next = buckets[elem->hash & (table->size * 2 - 1)];
+	    buckets[elem->hash & (table->size * 2 - 1)] = elem;
+	}
+
+    free(table->buckets);
+    table->buckets = buckets;
+    table->size *= 2;
+}
+
+
+/*****************************************************************************
+ *
+ * Global Functions
+ *
+ */
+
+/*
+ * Find the first element having a hash value and, unless no function is
+ * given, the given key; NULL if there is none
+ */
+struct hsh_elem *hsh_find(const struct hsh_table *const table,
+			  const unsigned long hash, hsh_equal *const equal,
+			  const void *const key)
+{
+    struct hsh_elem *elem;
+
+    if (table->buckets == NULL)
+	return NULL;
+
+    for (elem = table->buckets[hash & (table->size - 1)]; elem != NULL;
+	 elem = elem->next)
+	if (elem->hash == hash && (equal == NULL || equal(elem, key) == TRUE))
+	    return elem;
+
+    /* Not found */
+    return NULL;
+}
+
+/*
+ * Add an element having a hash value, without looking for an identical one;
+ * return FALSE if there is not enough memory
+ */
+enum bool hsh_add(struct hsh_table *const table, struct hsh_elem *const elem,
+		  const unsigned long hash)
+{
+    /* Create the table the first time, and keep the load factor under 1 */
+    if (table->buckets == NULL) {
+	if ((table->buckets = calloc(INITIAL_SIZE, sizeof(struct hsh_elem *)))
+		== NULL)
+	    return FALSE;
+	table->size = INITIAL_SIZE;
+    } else if (table->count >= table->size)
+	grow(table);
+
+    elem->hash = hash;
+    elem->next = table->buckets[hash & (table->size - 1)];
+    table->buckets[hash & (table->size - 1)] = elem;
+    table->count++;
+    return TRUE;
+}
+
+/*
+ * Empty a hash table, freeing its elements as well if asked to (they must
+ * have been allocated by malloc() then)
+ */
+void hsh_free(struct hsh_table *const table, const enum bool elems)
+{
+    struct hsh_elem *elem, *next;
+    unsigned long i;
+
+    if (elems == TRUE)
+	for (i = 0; i < table->size; i++)
+	    for (elem = table->buckets[i]; elem != NULL; elem = next) {
+		next = elem->next;
+		free(elem);
+	    }
+
+    free(table->buckets);
+    table->buckets = NULL;
+    table->size = table->count = 0;
+}
+
+/* End of File */
@@ -0,0 +1,70 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/hashtab.h
+ *
+ * Description: Hash Tables Header
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/* Process only once */
+#ifndef HASHTAB_H
+#define HASHTAB_H
+
+/* C++ protection */
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Element of a hash table, put first in the structures it holds */
+struct hsh_elem {
+    struct hsh_elem *next; /* Next element in the same bucket */
+    unsigned long hash;    /* Hash value of its key           */
+};
+
+/* Hash table, made of linked lists (empty if filled with zeros) */
+struct hsh_table {
+    struct hsh_elem **buckets; /* Buckets, NULL until the first element */
+    unsigned long size, count; /* Numbers of buckets and of elements    */
+};
+
+/* Function telling if an element has the given key */
+typedef enum bool hsh_equal(const struct hsh_elem *elem, const void *key);
+
+/* Hash table functions */
+struct hsh_elem *hsh_find(const struct hsh_table *table, unsigned long hash,
+			  hsh_equal *equal, const void *key);
+enum bool hsh_add(struct hsh_table *table, struct hsh_elem *elem,
+		  unsigned long hash);
+void hsh_free(struct hsh_table *table, enum bool elems);
+
+/* C++ protection */
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !HASHTAB_H */
+
+/* End of File */
@@ -0,0 +1,224 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/intern.c
+ *
+ * Description: String and Chain Interning
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* System headers */
+#include <stdlib.h> /* NULL, malloc(), realloc(), free() */
+#include <string.h> /* strlen(), strcmp(), memcpy()      */
+
+/* Local headers */
+#include "structs.h"
+#include "hashtab.h"
+#include "intern.h"
+
+
+/*****************************************************************************
+ *
+ * Local Datatypes and Variables
+ *
+ */
+
+/* Initial size of the strings (doubled as needed) */
+#define INITIAL_SIZE 16384
+
+/* A stored string */
+struct itn_string {
+    struct hsh_elem elem; /* Hash table element   */
+    unsigned offset;      /* Offset of the string */
+};
+
+/* A string being looked up */
+struct itn_key {
+    const char *data;   /* Stored strings */
+    const char *string; /* Looked up one  */
+};
+
+/* A chain and its index */
+struct itn_chain {
+    struct hsh_elem elem;      /* Hash table element      */
+    const struct chain *chain; /* Chain                   */
+    unsigned index;            /* Its index in the config */
+};
+
+
+/*****************************************************************************
+ *
+ * Local Functions
+ *
+ */
+
+/*
+ * Tell if a stored string is the looked up one
+ */
+static enum bool is_string(const struct hsh_elem *const elem,
+			   const void *const key)
+{
+    const struct itn_key *const look = key;
+
+    return strcmp(look->data + ((const struct itn_string *) elem)->offset,
+		  look->string) == 0 ? TRUE : FALSE;
+}
+
+/*
+ * Tell if an index element is the one of a chain
+ */
+static enum bool is_chain(const struct hsh_elem *const elem,
+			  const void *const chain)
+{
+    return ((const struct itn_chain *) elem)->chain == chain ? TRUE : FALSE;
+}
+
+
+/*****************************************************************************
+ *
+ * Global Functions
+ *
+ */
+
+/*
+ * Get the offset of a string, storing it unless already there; return FALSE
+ * if there is not enough memory
+ */
+enum bool itn_string(struct itn_strings *const strings,
+		     const char *const string, unsigned *const offset)
+{
+    const unsigned long hash = hash_string(HASH_SEED, string);
+    const size_t len = strlen(string) + 1;
+    struct itn_string *found;
+    struct itn_key key;
+    size_t max;
+    char *data;
+
+    /* Look for it */
+    key.data = strings->data;
+    key.string = string;
+    if ((found = (struct itn_string *) hsh_find(&strings->index, hash,
+						is_string, &key)) != NULL) {
+	*offset = found->offset;
+	return TRUE;
+    }
+
+    /* Add it */
+    if (strings->len + len > strings->max) {
+	max = strings->max == 0 ? INITIAL_SIZE : strings->max;
+	while (strings->len + len > max)
+	    max *= 2;
+	if ((data = realloc(strings->data, max)) == NULL)
+	    return FALSE;
+	strings->data = data;
+	strings->max = max;
+    }
+    if ((found = malloc(sizeof(struct itn_string))) == NULL)
+	return FALSE;
+    found->offset = (unsigned) strings->len;
+    if (hsh_add(&strings->index, &found->elem, hash) == FALSE) {
+	free(found);
+	return FALSE;
+    }
+    memcpy(strings->data + strings->len, string, len);
+    strings->len += len;
+    *offset = found->offset;
+    return TRUE;
+}
+
+/*
+ * Forget the stored strings, freeing the strings themselves as well if asked
+ * to (they are kept by the caller otherwise)
+ */
+void itn_free_strings(struct itn_strings *const strings, const enum bool data)
+{
+    hsh_free(&strings->index, TRUE);
+    if (data == TRUE)
+	free(strings->data);
+    strings->data = NULL;
+    strings->len = strings->max = 0;
+}
+
+/*
+ * Index the chains of a configuration; return FALSE if there is not enough
+ * memory
+ */
+enum bool itn_chains(struct itn_chains *const chains,
+		     const struct chain *const config)
+{
+    const struct chain *chain;
+    unsigned nb = 0, i;
+
+    for (chain = config; chain != NULL; chain = chain->next)
+	nb++;
+    chains->index.buckets = NULL;
+    chains->index.size = chains->index.count = 0;
+    if ((chains->data = malloc(sizeof(struct itn_chain) * (nb + 1)))
+	    == NULL)
+	return FALSE;
+
+    for (chain = config, i = 0; chain != NULL; chain = chain->next, i++) {
+	chains->data[i].chain = chain;
+	chains->data[i].index = i;
+	if (hsh_add(&chains->index, &chains->data[i].elem,
+		    hash_string(HASH_SEED, chain->name)) == FALSE) {
+	    itn_free_chains(chains);
+	    return FALSE;
+	}
+    }
+    return TRUE;
+}
+
+/*
+ * Get the index of a chain, ITN_NONE if not in the configuration
+ */
+unsigned itn_chain(const struct itn_chains *const chains,
+		   const struct chain *const chain)
+{
+    const struct itn_chain *const found = (const struct itn_chain *)
+	    hsh_find(&chains->index, hash_string(HASH_SEED, chain->name),
+		     is_chain, chain);
+
+    return found != NULL ? found->index : ITN_NONE;
+}
+
+/*
+ * Free the index of the chains
+ */
+void itn_free_chains(struct itn_chains *const chains)
+{
+    hsh_free(&chains->index, FALSE);
+    free(chains->data);
+    chains->data = NULL;
+}
+
+/* End of File */
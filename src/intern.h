@@ -0,0 +1,78 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/intern.h
+ *
+ * Description: String and Chain Interning Header
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+
+/* Process only once */
+#ifndef INTERN_H
+#define INTERN_H
+
+/* C++ protection */
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* System headers */
+#include <stddef.h> /* size_t */
+
+/* No index */
+#define ITN_NONE 0xFFFFFFFFU
+
+/* Strings stored one after the other, each one once (empty if filled with
+ * zeros) */
+struct itn_strings {
+    char *data;             /* Strings                            */
+    size_t len, max;        /* Used and allocated sizes           */
+    struct hsh_table index; /* Offsets of the strings, by content */
+};
+
+/* Indices of the chains of a configuration, by address */
+struct itn_chains {
+    struct hsh_table index; /* Chains, by name hash        */
+    struct itn_chain *data; /* Elements of the index       */
+};
+
+/* Interning functions */
+enum bool itn_string(struct itn_strings *strings, const char *string,
+		     unsigned *offset);
+void itn_free_strings(struct itn_strings *strings, enum bool data);
+enum bool itn_chains(struct itn_chains *chains, const struct chain *config);
+unsigned itn_chain(const struct itn_chains *chains,
+		   const struct chain *chain);
+void itn_free_chains(struct itn_chains *chains);
+
+/* C++ protection */
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !INTERN_H */
+
+/* End of File */
@@ -0,0 +1,244 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/interval.c
+ *
+ * Description: Numeric Intervals
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* System headers */
+#include <stdlib.h> /* NULL, qsort() */
+
+/* Local headers */
+#include "structs.h"
+#include "flat.h"
+#include "output.h"
+#include "interval.h"
+
+
+/*****************************************************************************
+ *
+ * Local Functions
+ *
+ */
+
+/*
+ * Set the bounds of an interval from a network prefix
+ */
+static void set_prefix(struct interval *const elem,
+		       const struct prefix *const prefix)
+{
+    elem->from = prefix->net;
+    elem->to = prefix->net | (prefix->len >= 32 ? 0
+			      : 0xFFFFFFFFUL >> prefix->len);
+}
+
+/*
+ * Set the bounds of an interval from a port range, put back in order if
+ * reversed (such as 1023-1)
+ */
+static void set_range(struct interval *const elem,
+		      const struct one_port *const range)
+{
+    elem->from = range->from < range->to ? range->from : range->to;
+    elem->to = range->from < range->to ? range->to : range->from;
+}
+
+/*
+ * Compare two intervals, for sorting by arm, then by lower bound
+ */
+static int cmp_arm(const void *const a, const void *const b)
+{
+    const struct interval *const elem_a = a, *const elem_b = b;
+
+    if (elem_a->arm != elem_b->arm)
+	return elem_a->arm < elem_b->arm ? -1 : 1;
+    if (elem_a->from != elem_b->from)
+	return elem_a->from < elem_b->from ? -1 : 1;
+    if (elem_a->to != elem_b->to)
+	return elem_a->to > elem_b->to ? -1 : 1;
+    return 0;
+}
+
+/*
+ * Compare two intervals, for sorting by lower bound
+ */
+static int cmp_bound(const void *const a, const void *const b)
+{
+    const struct interval *const elem_a = a, *const elem_b = b;
+
+    if (elem_a->from != elem_b->from)
+	return elem_a->from < elem_b->from ? -1 : 1;
+    if (elem_a->to != elem_b->to)
+	return elem_a->to > elem_b->to ? -1 : 1;
+    return elem_a->arm < elem_b->arm ? -1 : elem_a->arm > elem_b->arm;
+}
+
+
+/*****************************************************************************
+ *
+ * Global Functions
+ *
+ */
+
+/*
+ * Fill an array with the numeric values of a parsed condition, leading to
+ * an arm; return their number, the symbolic ones (host and service names)
+ * being skipped
+ */
+unsigned itv_get_cond(const struct condition *const cond, const unsigned arm,
+		      struct interval *const elems)
+{
+    const struct addr *addr;
+    const struct port *port;
+    struct prefix prefix;
+    unsigned nb = 0;
+
+    if (cond->type == COND_ADDR) {
+	for (addr = cond->cond.addr; addr != NULL; addr = addr->next)
+	    if (addr_to_prefix(addr, &prefix) == TRUE) {
+		set_prefix(&elems[nb], &prefix);
+		elems[nb].arm = arm;
+		elems[nb++].src = cond->src;
+	    }
+    } else
+	for (port = cond->cond.port; port != NULL; port = port->next)
+	    if (port->type == PORT_NUMERIC) {
+		set_range(&elems[nb], &port->port.range);
+		elems[nb].arm = arm;
+		elems[nb++].src = cond->src;
+	    }
+
+    return nb;
+}
+
+/*
+ * Fill an array with the numeric values of a flat condition, leading to an
+ * arm; return their number, the symbolic ones being skipped
+ */
+unsigned itv_get_flat(const struct flat *const flat,
+		      const struct flat_cond *const cond, const unsigned arm,
+		      struct interval *const elems)
+{
+    const struct flat_port *port;
+    struct prefix prefix;
+    unsigned nb = 0, i;
+
+    for (i = 0; i < cond->nb; i++)
+	if (cond->type == COND_ADDR) {
+	    if (string_to_prefix(FLAT_ADDR(flat, cond, i), &prefix) == TRUE) {
+		set_prefix(&elems[nb], &prefix);
+		elems[nb].arm = arm;
+		elems[nb++].src = cond->src;
+	    }
+	} else if ((port = FLAT_PORT(flat, cond, i))->name == FLAT_NONE) {
+	    set_range(&elems[nb], &port->range);
+	    elems[nb].arm = arm;
+	    elems[nb++].src = cond->src;
+	}
+
+    return nb;
+}
+
+/*
+ * Sort intervals by arm and merge the overlapping or adjacent ones of a
+ * same arm, returning the new interval count
+ */
+unsigned itv_merge(struct interval *const elems, const unsigned nb)
+{
+    unsigned i, last = 0;
+
+    if (nb == 0)
+	return 0;
+
+    qsort(elems, nb, sizeof(struct interval), cmp_arm);
+    for (i = 1; i < nb; i++)
+	if (elems[i].arm == elems[last].arm
+	    && (elems[i].from <= elems[last].to
+		|| elems[i].from == elems[last].to + 1)) {
+	    if (elems[i].to > elems[last].to)
+		elems[last].to = elems[i].to;
+	} else
+	    elems[++last] = elems[i];
+
+    return last + 1;
+}
+
+/*
+ * Sort intervals by lower bound; return FALSE if two of them overlap
+ */
+enum bool itv_disjoint(struct interval *const elems, const unsigned nb)
+{
+    unsigned i;
+
+    /* Once sorted, an interval overlapping another one also overlaps its
+     * predecessor */
+    qsort(elems, nb, sizeof(struct interval), cmp_bound);
+    for (i = 1; i < nb; i++)
+	if (elems[i].from <= elems[i - 1].to)
+	    return FALSE;
+
+    return TRUE;
+}
+
+/*
+ * Check if an address interval is a network prefix, giving its length
+ */
+enum bool itv_prefix(const unsigned long from, const unsigned long to,
+		     unsigned *const len)
+{
+    const unsigned long host = to - from;
+    unsigned long bits;
+
+    if ((host & (host + 1)) != 0 || (from & host) != 0)
+	return FALSE;
+
+    for (*len = 32, bits = host; bits != 0; bits >>= 1)
+	(*len)--;
+    return TRUE;
+}
+
+/*
+ * Output an IPv4 address in dotted-quad notation
+ */
+void itv_out_ipv4(struct out_sink *const sink, const unsigned long addr)
+{
+    out_number(sink, (addr >> 24) & 0xFF);
+    out_char(sink, '.');
+    out_number(sink, (addr >> 16) & 0xFF);
+    out_char(sink, '.');
+    out_number(sink, (addr >> 8) & 0xFF);
+    out_char(sink, '.');
+    out_number(sink, addr & 0xFF);
+}
+
+/* End of File */
@@ -0,0 +1,66 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/interval.h
+ *
+ * Description: Numeric Intervals Header
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/* Process only once */
+#ifndef INTERVAL_H
+#define INTERVAL_H
+
+/* C++ protection */
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Values of an address or port condition leading to an arm of a cascade
+ * (0 if not in a cascade) */
+struct interval {
+    unsigned long from, to; /* Interval bounds        */
+    unsigned arm;           /* Arm index              */
+    unsigned src;           /* Source ID of its value */
+};
+
+/* Interval functions */
+unsigned itv_get_cond(const struct condition *cond, unsigned arm,
+		      struct interval *elems);
+unsigned itv_get_flat(const struct flat *flat, const struct flat_cond *cond,
+		      unsigned arm, struct interval *elems);
+unsigned itv_merge(struct interval *elems, unsigned nb);
+enum bool itv_disjoint(struct interval *elems, unsigned nb);
+enum bool itv_prefix(unsigned long from, unsigned long to, unsigned *len);
+void itv_out_ipv4(struct out_sink *sink, unsigned long addr);
+
+/* C++ protection */
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !INTERVAL_H */
+
+/* End of File */
@@ -35,14 +35,29 @@
  *
  */
 
+/* ./configure result */
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
 /* System headers */
-#include <stdlib.h> /* NULL, malloc(), free() */
-#include <stdio.h> /* printf() */
+#include <stdlib.h> /* NULL, malloc(), calloc(), realloc(), free(), qsort() */
+#include <stdio.h> /* FILE *, fputs(), sprintf() */
 #include <string.h> /* strdup(), strcmp() */
+#if HAVE_PTHREAD_H
+#include <unistd.h>  /* sysconf()                                  */
+#include <pthread.h> /* pthread_create(), pthread_join()           */
+#endif /* HAVE_PTHREAD_H */
 
 /* Local headers */
 #include "structs.h"
+#include "flat.h"
+#include "output.h"
+#include "hashtab.h"
+#include "interval.h"
 #include "iptables.h"
+#include "manifest.h"
+#include "stats.h"
 
 
 /*****************************************************************************
@@ -54,29 +69,224 @@
 /* Default IPTables program name */
 #define DEFAULT_IPT_EXE "iptables"
 
+/* Maximum number of generating threads */
+#define MAX_THREADS 16
+
+/* Maximum number of ports in a multiport match (a range counts as two) */
+#define MULTIPORT_MAX 15
+
+/* Cascades of at least this number of tests on the same field are
+ * dispatched by a binary search, down to this number of intervals */
+#define CASCADE_MIN  8
+#define CASCADE_LEAF 4
+
+/* User chains of at most this number of rules are inlined where they are
+ * called, through at most this number of nested calls */
+#define INLINE_RULES 4
+#define INLINE_DEPTH 8
+
+/* IPSet program name, and default maximum number of elements of a set */
+#define IPSET_EXE    "ipset"
+#define IPSET_MAXELEM 65536
+
+/* Length of a set name: a prefix and two hash values */
+#define SET_NAME_LEN 20
+
+/* Hash value combinations giving the set names */
+#define SET_HASH1(hash, value) HASH_MIX(hash, value)
+#define SET_HASH2(hash, value) HASH_FNV_MIX(hash, value)
+
+/* Table being filled: a chain of the configuration, or a generated table
+ * processing a test action or evaluating an expression with given outcomes,
+ * shared by all the identical ones */
+struct shared {
+    struct hsh_elem elem;          /* Element of the known ones      */
+    struct shared *list;           /* Next one in creation order     */
+    struct shared *parent;         /* Table filled at creation time  */
+    unsigned chain;                /* Chain, FLAT_NONE if generated  */
+    unsigned long base, hash;      /* Content hash, and name one     */
+    unsigned long check;           /* Independent content hash       */
+    unsigned action;               /* Processed action, or FLAT_NONE */
+    unsigned expr;                 /* Evaluated expr., or FLAT_NONE  */
+    char *tbl_then, *tbl_else;     /* Expression outcomes            */
+    char *name;                    /* Table name                     */
+    enum bool changed;             /* Wether rules have to be output */
+    enum bool skip;                /* Wether generated elsewhere     */
+    size_t decl_begin, decl_end;   /* Declaration in the output      */
+    size_t rules_begin, rules_end; /* Rules in the output            */
+    unsigned nb_rules, nb_jumps;   /* Output rules, jumps among them */
+    unsigned first, end;           /* Dispatched intervals, if any   */
+};
+
+/* Cascade of tests on the same field ("if A then X else if B then Y..."),
+ * the arms matching different values */
+struct cascade {
+    unsigned action;              /* First test action               */
+    const struct flat_cond *cond; /* Condition of the first test     */
+    struct interval *elems;       /* Sorted intervals of all the arms */
+    unsigned nb_elems;            /* Number of intervals             */
+    const char **targets;         /* Table of each arm               */
+    const char *rest;             /* Table if no arm matches         */
+};
+
+/* IPSet matched by a rule instead of one rule per element, named after
+ * its contents */
+struct ipt_set {
+    const struct shared *table;    /* Table matching it             */
+    const struct flat_cond *cond;  /* Listed elements               */
+    char name[SET_NAME_LEN + 1];   /* Set name                      */
+    unsigned order;                /* Position among all the sets   */
+    enum bool skip;                /* Wether defined elsewhere      */
+};
+
+/* Generation context: some chains of the configuration (usually one),
+ * rendered on their own in a thread; the tables generated by the previous
+ * chains are not known, so the shared ones are generated again and removed
+ * from the output afterwards */
+struct ipt_gen {
+    unsigned chain;               /* First chain to process           */
+    unsigned nb_chains;           /* Number of chains to process      */
+    struct out_sink decl, rules;  /* Declarations and rules           */
+    struct hsh_table table;       /* Known generated tables           */
+    struct shared *first, *last;  /* All tables, in creation order    */
+    struct shared *cur;           /* Table being filled               */
+    struct ipt_set *sets;         /* Matched sets, in creation order  */
+    unsigned nb_sets, max_sets;   /* Numbers of used and allocated    */
+    unsigned inlined;             /* Depth of the inlined user chains */
+};
+
+/* Output buffer functions */
+static void buf_write(const struct out_sink *buf, struct shared *first,
+		      enum bool decl, struct out_sink *out);
+static int cmp_region(const void *a, const void *b);
+static enum bool sets_write(struct ipt_gen *gens, unsigned nb_gens,
+			    struct out_sink *out);
+static int cmp_set(const void *a, const void *b);
+
 /* Auxiliary functions */
-static void ipt_out_create(const char *table);
-static char *ipt_new_table(const struct action *action);
-static void ipt_out_jump(const char *table, const char *target);
-static const char *make_port(const struct port *port);
+static struct out_sink *ipt_decl(struct ipt_gen *gen);
+static void ipt_out_create(struct ipt_gen *gen, const struct shared *table);
+static void ipt_out_append(struct out_sink *buf, const char *table,
+			   unsigned src);
+static void ipt_out_flush(struct out_sink *buf, const char *table);
+static void ipt_removed_flush(const char *table);
+static void ipt_removed_delete(const char *table);
+static void ipt_removed_set(const char *set);
+static struct shared *ipt_new_table(struct ipt_gen *gen, unsigned chain,
+				    unsigned long base, unsigned long hash,
+				    unsigned long check);
+static const char *ipt_branch_table(struct ipt_gen *gen, unsigned action,
+				    struct shared **fill);
+static struct shared *ipt_shared_table(struct ipt_gen *gen, unsigned action,
+				       unsigned expr, const char *tbl_then,
+				       const char *tbl_else,
+				       enum bool *known);
+static struct shared *ipt_node_table(struct ipt_gen *gen, unsigned action,
+				     unsigned first, unsigned end,
+				     enum bool *known);
+static enum bool same_shared(const struct shared *cur, unsigned action,
+			     unsigned expr, unsigned first, unsigned end,
+			     const char *tbl_then, const char *tbl_else);
+static struct shared *find_shared(const struct hsh_table *table,
+				  unsigned long hash);
+static void free_shared(struct ipt_gen *gen);
+static void ipt_fill_begin(struct ipt_gen *gen, struct shared *table);
+static void ipt_fill_end(struct ipt_gen *gen, struct shared *table);
+static void ipt_out_jump(struct ipt_gen *gen, struct shared *table,
+			 const char *target, unsigned src);
+static void ipt_out_target(struct out_sink *buf, const char *target);
+static enum bool ipt_is_jump(const char *target);
+static const struct flat_port *ipt_port_chunk(const struct flat_port *first,
+					     const struct flat_port *last);
+static void ipt_out_ports(struct out_sink *buf, const char *table,
+			  const char *proto, const char *dir,
+			  const struct flat_port *first,
+			  const struct flat_port *end, const char *target,
+			  unsigned src);
+static void ipt_out_list(struct out_sink *buf, const struct flat_port *first,
+			 const struct flat_port *end);
+static const char *ipt_new_set(struct ipt_gen *gen,
+			       const struct shared *table,
+			       const struct flat_cond *cond);
+static enum bool same_set(const struct flat_cond *a,
+			  const struct flat_cond *b);
+static void ipt_out_set(struct out_sink *buf, const char *table,
+			const char *proto, const char *set, const char *dir,
+			const char *target, unsigned src);
+static void ipt_out_range(struct ipt_gen *gen, struct shared *table,
+			  const struct flat_cond *cond, unsigned long from,
+			  unsigned long to, const char *target, unsigned src);
+static unsigned long ipt_hash_shared(unsigned action, unsigned expr,
+				     const char *tbl_then,
+				     const char *tbl_else,
+				     enum flat_hash func);
+static unsigned long ipt_hash_action(unsigned action, enum flat_hash func);
+static unsigned long ipt_hash_inlined(unsigned long hash, unsigned action,
+				      unsigned depth, enum flat_hash func);
+static unsigned long ipt_hash_options(unsigned long hash,
+				      enum flat_hash func);
+static unsigned ipt_resolve(unsigned action);
+static enum bool ipt_small(unsigned chain);
+static enum bool ipt_inlined(const struct ipt_gen *gen, unsigned action);
+static enum bool ipt_direct(unsigned expr, enum bool value);
+static enum bool ipt_negatable(const struct flat_cond *cond);
 
 /* Local functions */
-static void ipt_chain(const struct chain *chain);
-static void ipt_action(const char *table,
-		       const struct action *action);
-static void ipt_test(const char *table, const struct test *test);
-static void ipt_expr(const char *table,
+static void ipt_generate(struct ipt_gen *gen);
+static enum bool ipt_merge(struct ipt_gen *gen, struct hsh_table *known);
+static void ipt_run(struct ipt_gen *gens, unsigned nb_gens);
+static void *ipt_worker(void *arg);
+static void ipt_chain(struct ipt_gen *gen, unsigned chain);
+static void ipt_action(struct ipt_gen *gen, struct shared *table,
+		       unsigned action);
+static void ipt_test(struct ipt_gen *gen, struct shared *table,
+		     unsigned test);
+static enum bool ipt_cascade(struct ipt_gen *gen, struct shared *table,
+			     unsigned action);
+static void ipt_dispatch(struct ipt_gen *gen, struct shared *table,
+			 const struct cascade *cascade, unsigned first,
+			 unsigned end, unsigned long upper);
+static void ipt_expr(struct ipt_gen *gen, struct shared *table,
 		     const char *tbl_then, const char *tbl_else,
-		     const struct expr *expr);
-static void ipt_cond(const char *table,
+		     unsigned expr);
+static void ipt_match(struct ipt_gen *gen, struct shared *table,
+		      const char *target, unsigned expr, enum bool value);
+static void ipt_cond(struct ipt_gen *gen, struct shared *table,
 		     const char *tbl_then, const char *tbl_else,
-		     const struct condition *cond);
+		     const struct flat_cond *cond);
+static void ipt_cond_rules(struct ipt_gen *gen, struct shared *table,
+			   const char *target, const struct flat_cond *cond);
+static void ipt_cond_negated(struct ipt_gen *gen, struct shared *table,
+			     const char *target,
+			     const struct flat_cond *cond);
+static unsigned ipt_cond_ports(struct out_sink *buf, const char *table,
+			       const char *proto, enum direction dir,
+			       const struct flat_port *first,
+			       const struct flat_port *end,
+			       const char *target, unsigned src);
+static unsigned ipt_cond_set(struct ipt_gen *gen, const struct shared *table,
+			     const char *target,
+			     const struct flat_cond *cond);
 
-/* Local variables */
+/* Local variables (set once, then only read by the threads) */
 static const char *const default_ipt_exe = "iptables";
 static const char *ipt_exe;
-static const char *cur_chain;
-static FILE *out_file;
+static enum ipt_format format;
+static const struct flat *flat;
+
+/* Lists of at least this number of elements are matched through a set
+ * (never if zero), defined in the given file or in the script itself */
+static unsigned set_min;
+static FILE *set_file;
+
+/* Output of the removed chains commands */
+static struct out_sink output;
+
+/* Generation contexts left to process by the threads */
+static struct ipt_gen *next_gen, *end_gen;
+#if HAVE_PTHREAD_H
+static pthread_mutex_t gen_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif /* HAVE_PTHREAD_H */
 
 
 /*****************************************************************************
@@ -85,110 +295,1151 @@ static FILE *out_file;
  *
  */
 
-void ipt_config(const struct chain *config, const char *const exe,
-		FILE *const out)
+/*
+ * Generate the IPTables rules corresponding to a configuration, either as a
+ * shellscript or as an iptables-restore input file; if a previous manifest
+ * has been read, only the chains which differ from it are output
+ *
+ * Each chain is rendered in its own buffers, in parallel; the result is the
+ * same as processing the chains one after another.  Return FALSE if the
+ * rules or the sets could not be generated or written.
+ */
+enum bool ipt_config(const struct flat *const config, const char *const exe,
+		     const enum ipt_format fmt, FILE *const out)
 {
+    struct ipt_gen *gens;
+    struct hsh_table known = { NULL, 0, 0 };
+    struct out_sink sets, sets_out;
+    const struct shared *cur;
+    unsigned nb_gens = 0, i;
+    enum bool failed = FALSE, clash = FALSE;
+
     ipt_exe = exe == NULL ? default_ipt_exe : exe;
-    out_file = out == NULL ? stdout : out;
+    format = fmt;
+    flat = config;
 
-    while (config != NULL) {
-	putc('\n', out_file);
-	ipt_chain(config);
-	config = config->next;
+    /* One generation context per chain */
+    nb_gens = flat->nb_chains;
+    if ((gens = calloc(nb_gens != 0 ? nb_gens : 1,
+		       sizeof(struct ipt_gen))) == NULL) {
+	fputs("Error: not enough memory to generate the rules.\n", stderr);
+	return FALSE;
     }
+    for (i = 0; i < nb_gens; i++) {
+	gens[i].chain = i;
+	gens[i].nb_chains = 1;
+	out_memory(&gens[i].decl);
+	out_memory(&gens[i].rules);
+    }
+
+    /* Render them, then keep each shared table in the first chain using it
+     * only, as if they had been processed in order */
+    ipt_run(gens, nb_gens);
+    for (i = 0; i < nb_gens; i++)
+	if (ipt_merge(&gens[i], &known) == FALSE)
+	    break;
+
+    /* If two different tables have the same hash value, the generated
+     * names depend on the processing order: everything is done again in a
+     * single context */
+    if (i < nb_gens) {
+	for (i = 0; i < nb_gens; i++)
+	    free_shared(&gens[i]);
+	hsh_free(&known, FALSE);
+	gens[0].chain = 0;
+	gens[0].nb_chains = nb_gens;
+	nb_gens = 1;
+	ipt_generate(&gens[0]);
 
+	/* The names can only differ here if a table could not be recorded */
+	if (ipt_merge(&gens[0], &known) == FALSE)
+	    gens[0].rules.failed = TRUE;
+    }
+    for (i = 0; i < nb_gens; i++)
+	if (gens[i].decl.failed == TRUE || gens[i].rules.failed == TRUE)
+	    failed = TRUE;
+
+    /* Count the output tables and rules */
+    for (i = 0; i < nb_gens && failed == FALSE; i++)
+	for (cur = gens[i].first; cur != NULL; cur = cur->list)
+	    if (cur->skip == FALSE && cur->changed == TRUE) {
+		sta_add(STA_OUT_CHAINS, 1);
+		sta_add(STA_OUT_RULES, cur->nb_rules);
+		sta_add(STA_OUT_JUMPS, cur->nb_jumps);
+	    }
+
+    /* Definitions of the matched sets */
+    out_memory(&sets);
+    if (failed == FALSE && set_min != 0) {
+	clash = sets_write(gens, nb_gens, &sets) == FALSE ? TRUE : FALSE;
+	failed = sets.failed;
+    }
+
+    out_open(&output, out == NULL ? stdout : out);
+    if (failed == TRUE)
+	fputs("Error: not enough memory to generate the rules.\n", stderr);
+    else if (clash == TRUE)
+	fputs("Error: two different lists have the same set name.\n",
+	      stderr);
+    else if (format == IPT_SCRIPT) {
+	/* Sets are loaded at once, before any rule matches them */
+	if (set_file == NULL && sets.len != 0) {
+	    out_str(&output, "\n" IPSET_EXE " restore -exist <<'EOF'\n");
+	    out_text(&output, sets.data, sets.len);
+	    out_str(&output, "EOF\n");
+	}
+
+	/* One command per line, chains being created when needed, and the
+	 * removed ones being deleted once nothing references them anymore */
+	for (i = 0; i < nb_gens; i++)
+	    buf_write(&gens[i].rules, gens[i].first, FALSE, &output);
+	man_removed(ipt_removed_flush);
+	man_removed(ipt_removed_delete);
+	man_removed_sets(ipt_removed_set);
+    } else {
+	/* iptables-restore wants all the chains to be declared before the
+	 * rules */
+	out_str(&output, "*filter\n");
+	for (i = 0; i < nb_gens; i++)
+	    buf_write(&gens[i].decl, gens[i].first, TRUE, &output);
+	man_removed(ipt_removed_flush);
+	for (i = 0; i < nb_gens; i++)
+	    buf_write(&gens[i].rules, gens[i].first, FALSE, &output);
+	man_removed(ipt_removed_delete);
+	out_str(&output, "COMMIT\n");
+
+	/* iptables-restore can't destroy the sets it doesn't match anymore,
+	 * this has to be done once the rules are loaded */
+	man_removed_sets(ipt_removed_set);
+    }
+    if (out_close(&output) == FALSE) {
+	fputs("Error: cannot write the rules.\n", stderr);
+	failed = TRUE;
+    }
+
+    /* Or in their own file, for "ipset restore" */
+    if (failed == FALSE && clash == FALSE && set_file != NULL) {
+	out_open(&sets_out, set_file);
+	out_text(&sets_out, sets.data, sets.len);
+	if (out_close(&sets_out) == FALSE) {
+	    fputs("Error: cannot write the sets.\n", stderr);
+	    failed = TRUE;
+	}
+    }
+    out_close(&sets);
+
+    for (i = 0; i < nb_gens; i++)
+	free_shared(&gens[i]);
+    hsh_free(&known, FALSE);
+    free(gens);
     ipt_exe = default_ipt_exe;
-    out_file = stdout;
+    format = IPT_SCRIPT;
+    flat = NULL;
+    set_min = 0;
+    set_file = NULL;
+
+    return failed == TRUE || clash == TRUE ? FALSE : TRUE;
+}
+
+/*
+ * Match the lists of at least min elements (none if zero) through IPSets
+ * in the next call to ipt_config(); the sets are defined in the given file
+ * as "ipset restore" input, or in the generated shellscript if it is NULL
+ */
+void ipt_sets(const unsigned min, FILE *const file)
+{
+    set_min = min;
+    set_file = file;
 }
 
 
 /*****************************************************************************
  *
- * Auxiliary Functions
+ * Output Buffers
  *
  */
 
 /*
- * Output an IPTables table creation command
+ * Write a buffer, without the declarations (or the rules) of the skipped
+ * tables
+ */
+static void buf_write(const struct out_sink *const buf,
+		      struct shared *const first, const enum bool decl,
+		      struct out_sink *const out)
+{
+    size_t (*regions)[2] = NULL, pos = 0;
+    struct out_piece *pieces;
+    unsigned nb = 0, nb_pieces = 0, i;
+    const struct shared *cur;
+
+    /* Regions of the skipped tables; in a shellscript, the declarations and
+     * the rules are in the same buffer, a table being declared inside the
+     * rules of the one it was created for */
+    for (cur = first; cur != NULL; cur = cur->list)
+	if (cur->skip == TRUE)
+	    nb += format == IPT_SCRIPT ? 2 : 1;
+    if (nb != 0 && (regions = malloc(sizeof(*regions) * nb)) != NULL) {
+	nb = 0;
+	for (cur = first; cur != NULL; cur = cur->list) {
+	    if (cur->skip == FALSE)
+		continue;
+	    if (decl == TRUE || format == IPT_SCRIPT) {
+		regions[nb][0] = cur->decl_begin;
+		regions[nb++][1] = cur->decl_end;
+	    }
+	    if (decl == FALSE) {
+		regions[nb][0] = cur->rules_begin;
+		regions[nb++][1] = cur->rules_end;
+	    }
+	}
+	qsort(regions, nb, sizeof(*regions), cmp_region);
+    }
+
+    /* Write what lies between them, at once */
+    if ((pieces = malloc(sizeof(*pieces) * (nb + 1))) == NULL) {
+	out->failed = TRUE;
+	free(regions);
+	return;
+    }
+    for (i = 0; i < nb; i++) {
+	if (regions[i][0] > pos) {
+	    pieces[nb_pieces].data = buf->data + pos;
+	    pieces[nb_pieces++].len = regions[i][0] - pos;
+	}
+	if (regions[i][1] > pos)
+	    pos = regions[i][1];
+    }
+    if (buf->len > pos) {
+	pieces[nb_pieces].data = buf->data + pos;
+	pieces[nb_pieces++].len = buf->len - pos;
+    }
+    out_pieces(out, pieces, nb_pieces);
+    free(pieces);
+    free(regions);
+}
+
+/*
+ * Sort output regions by position
  */
-static void ipt_out_create(const char *const table)
+static int cmp_region(const void *const a, const void *const b)
 {
-    fprintf(out_file, "%s -N %s\n", ipt_exe, table);
+    const size_t pos_a = *(const size_t *) a, pos_b = *(const size_t *) b;
+
+    return pos_a < pos_b ? -1 : pos_a > pos_b ? 1 : 0;
 }
 
 /*
- * Create an IPTables table for later use
+ * Write the definitions of the sets matched by the output tables, each one
+ * once; return FALSE if two different lists have the same set name
  */
-static char *ipt_new_table(const struct action *const action)
+static enum bool sets_write(struct ipt_gen *const gens,
+			    const unsigned nb_gens, struct out_sink *const out)
 {
-    static unsigned count = 0;
-    unsigned digits = count, nb = 0;
-    char *res;
+    struct ipt_set **sorted, *set;
+    const struct flat_port *port;
+    unsigned nb = 0, i, j;
+    char maxelem[24];
+
+    for (i = 0; i < nb_gens; i++)
+	nb += gens[i].nb_sets;
+    if (nb == 0)
+	return TRUE;
 
-    if (action != NULL)
-	switch (action->type) {
-	case TARGET_FINAL:
-	    switch (action->action.final) {
-	    case FINAL_ACCEPT:
-		return strdup("ACCEPT");
-	    case FINAL_DROP:
-		return strdup("DROP");
-	    case FINAL_REJECT:
-		return strdup("REJECT");
+    /* Sets of the skipped tables are defined by the other contexts, and
+     * identical ones only once, the first in creation order */
+    if ((sorted = malloc(sizeof(struct ipt_set *) * nb)) == NULL) {
+	out->failed = TRUE;
+	return TRUE;
+    }
+    nb = 0;
+    for (i = 0; i < nb_gens; i++)
+	for (j = 0; j < gens[i].nb_sets; j++) {
+	    set = gens[i].sets + j;
+	    set->skip = set->table->skip;
+	    if (set->skip == FALSE) {
+		set->order = nb;
+		sorted[nb++] = set;
 	    }
-	    break;
+	}
+    qsort(sorted, nb, sizeof(struct ipt_set *), cmp_set);
+    for (i = 1; i < nb; i++)
+	if (strcmp(sorted[i]->name, sorted[i - 1]->name) == 0) {
+	    if (same_set(sorted[i]->cond, sorted[i - 1]->cond) == FALSE) {
+		free(sorted);
+		return FALSE;
+	    }
+	    sorted[i]->skip = TRUE;
+	}
+    free(sorted);
 
-	case TARGET_USER:
-	    return strdup(action->action.user->name);
+    /* Create them (if they don't exist yet, the contents being the same if
+     * the name is), then fill them; the manifest keeps them from being
+     * destroyed */
+    for (i = 0; i < nb_gens; i++)
+	for (j = 0; j < gens[i].nb_sets; j++) {
+	    set = gens[i].sets + j;
+	    if (set->skip == TRUE)
+		continue;
+	    man_update_set(set->name);
 
-	default:
-	    break;
+	    out_strs(out, "create ", set->name, NULL);
+	    if (set->cond->type == COND_ADDR) {
+		out_str(out, set->cond->proto == PROTO_IPV6
+			     ? " hash:net family inet6"
+			     : " hash:net family inet");
+		if (set->cond->nb > IPSET_MAXELEM) {
+		    sprintf(maxelem, " maxelem %u", set->cond->nb);
+		    out_str(out, maxelem);
+		}
+	    } else
+		out_str(out, " bitmap:port range 0-65535");
+	    out_char(out, '\n');
+
+	    for (nb = 0; nb < set->cond->nb; nb++) {
+		out_strs(out, "add ", set->name, " ", NULL);
+		if (set->cond->type == COND_ADDR)
+		    out_str(out, FLAT_ADDR(flat, set->cond, nb));
+		else if ((port = FLAT_PORT(flat, set->cond, nb))->name
+			 != FLAT_NONE)
+		    out_str(out, FLAT_STRING(flat, port->name));
+		else {
+		    out_number(out, (unsigned long) port->range.from);
+		    if (port->range.from != port->range.to) {
+			out_char(out, '-');
+			out_number(out, (unsigned long) port->range.to);
+		    }
+		}
+		out_char(out, '\n');
+	    }
 	}
 
-    /* Count the number of digits */
-    do {
-	digits /= 10;
-	nb++;
-    } while (digits != 0);
+    return TRUE;
+}
+
+/*
+ * Sort sets by name, then by creation order
+ */
+static int cmp_set(const void *const a, const void *const b)
+{
+    const struct ipt_set *const set_a = *(const struct ipt_set *const *) a;
+    const struct ipt_set *const set_b = *(const struct ipt_set *const *) b;
+    const int res = strcmp(set_a->name, set_b->name);
+
+    return res != 0 ? res : set_a->order < set_b->order ? -1
+			  : set_a->order > set_b->order ? 1 : 0;
+}
+
+
+/*****************************************************************************
+ *
+ * Auxiliary Functions
+ *
+ */
+
+/*
+ * Get the buffer receiving the declarations
+ */
+static struct out_sink *ipt_decl(struct ipt_gen *const gen)
+{
+    return format == IPT_SCRIPT ? &gen->rules : &gen->decl;
+}
+
+/*
+ * Output an IPTables table creation command, or a flush command if its
+ * contents changed since the previous build (nothing if they didn't)
+ */
+static void ipt_out_create(struct ipt_gen *const gen,
+			   const struct shared *const table)
+{
+    switch (man_lookup(table->name, table->hash, table->check)) {
+    case MAN_NEW:
+	if (format == IPT_SCRIPT)
+	    out_strs(ipt_decl(gen), ipt_exe, " -N ", table->name, "\n", NULL);
+	else
+	    out_strs(ipt_decl(gen), ":", table->name, " - [0:0]\n", NULL);
+	break;
+
+    case MAN_CHANGED:
+	ipt_out_flush(ipt_decl(gen), table->name);
+
+    case MAN_SAME:
+	break;
+    }
+}
+
+/*
+ * Output the beginning of an IPTables rule appending command, tagged with
+ * the source ID of the node it comes from if known ("file:line", the file
+ * being an index given by get_source())
+ */
+static void ipt_out_append(struct out_sink *const buf, const char *const table,
+			   const unsigned src)
+{
+    if (format == IPT_SCRIPT)
+	out_strs(buf, ipt_exe, " -A ", table, NULL);
+    else
+	out_strs(buf, "-A ", table, NULL);
+
+    if (src != 0) {
+	out_str(buf, " -m comment --comment ");
+	out_number(buf, (unsigned long) SRC_FILE(src));
+	out_char(buf, ':');
+	out_number(buf, (unsigned long) SRC_LINE(src));
+    }
+}
+
+/*
+ * Output an IPTables table flush command (declaring an existing chain
+ * flushes it with iptables-restore --noflush)
+ */
+static void ipt_out_flush(struct out_sink *const buf, const char *const table)
+{
+    if (format == IPT_SCRIPT)
+	out_strs(buf, ipt_exe, " -F ", table, "\n", NULL);
+    else
+	out_strs(buf, ":", table, " - [0:0]\n", NULL);
+}
+
+/*
+ * Output an IPTables table flush command for a removed chain
+ */
+static void ipt_removed_flush(const char *const table)
+{
+    if (format == IPT_SCRIPT)
+	out_strs(&output, ipt_exe, " -F ", table, "\n", NULL);
+    else
+	out_strs(&output, ":", table, " - [0:0]\n", NULL);
+}
+
+/*
+ * Output an IPTables table deletion command for a removed chain
+ */
+static void ipt_removed_delete(const char *const table)
+{
+    if (format == IPT_SCRIPT)
+	out_strs(&output, ipt_exe, " -X ", table, "\n", NULL);
+    else
+	out_strs(&output, "-X ", table, "\n", NULL);
+}
+
+/*
+ * Output an IPSet destruction command for a set which isn't matched
+ * anymore, once the chains matching it are deleted; commented out in an
+ * iptables-restore input file
+ */
+static void ipt_removed_set(const char *const set)
+{
+    out_strs(&output, format == IPT_SCRIPT ? "" : "# ",
+	     IPSET_EXE " destroy ", set, "\n", NULL);
+}
+
+/*
+ * Create an IPTables table: a chain of the configuration, or a generated
+ * one whose name is derived from the hash of its contents; the independent
+ * hash tells the manifest whether a table of the same name changed
+ */
+static struct shared *ipt_new_table(struct ipt_gen *const gen,
+				    const unsigned chain,
+				    const unsigned long base,
+				    const unsigned long hash,
+				    const unsigned long check)
+{
+    struct shared *res;
+
+    if ((res = malloc(sizeof(struct shared))) == NULL)
+	return NULL;
+    res->name = chain != FLAT_NONE ? strdup(FLAT_NAME(flat, chain))
+				   : malloc(13);
+    if (res->name == NULL) {
+	free(res);
+	return NULL;
+    }
+    if (chain == FLAT_NONE)
+	sprintf(res->name, "__RW%08lx", hash);
+
+    res->list = NULL;
+    res->parent = gen->cur;
+    res->chain = chain;
+    res->base = base;
+    res->hash = hash;
+    res->check = check;
+    res->action = FLAT_NONE;
+    res->expr = FLAT_NONE;
+    res->tbl_then = res->tbl_else = NULL;
+    res->changed = man_lookup(res->name, hash, check) != MAN_SAME
+		   ? TRUE : FALSE;
+    res->skip = FALSE;
+    res->rules_begin = res->rules_end = 0;
+    res->nb_rules = res->nb_jumps = 0;
+    res->first = res->end = 0;
 
-    /* Allocate memory and build string */
-    if ((res = malloc(nb + 5)) != NULL)
-	sprintf(res, "__RW%u", count++);
+    /* Remember it, in creation order */
+    if (gen->last == NULL)
+	gen->first = res;
+    else
+	gen->last->list = res;
+    gen->last = res;
+
+    res->decl_begin = ipt_decl(gen)->len;
+    ipt_out_create(gen, res);
+    res->decl_end = ipt_decl(gen)->len;
 
-    /* Output and return the result */
-    ipt_out_create(res);
     return res;
 }
 
+/*
+ * Get the table to jump to for a test branch, the user chains doing nothing
+ * but a verdict or a jump being skipped; test actions are processed in a
+ * table shared across the whole configuration, to be filled if it is new
+ */
+static const char *ipt_branch_table(struct ipt_gen *const gen,
+				    unsigned action,
+				    struct shared **const fill)
+{
+    const struct flat_action *node;
+    struct shared *table;
+    enum bool known;
+
+    *fill = NULL;
+    node = FLAT_ACTION(flat, action = ipt_resolve(action));
+    switch (node->type) {
+    case TARGET_FINAL:
+	switch (node->value) {
+	case FINAL_ACCEPT:
+	    return "ACCEPT";
+	case FINAL_DROP:
+	    return "DROP";
+	case FINAL_REJECT:
+	    return "REJECT";
+	}
+	break;
+
+    case TARGET_USER:
+	return FLAT_NAME(flat, node->value);
+
+    case TARGET_TEST:
+	if ((table = ipt_shared_table(gen, action, FLAT_NONE, NULL, NULL,
+				      &known)) == NULL)
+	    break;
+	if (known == FALSE)
+	    *fill = table;
+	return table->name;
+    }
+
+    return "";
+}
+
+/*
+ * Get the generated table processing a test action (if action is not
+ * FLAT_NONE) or evaluating an expression with the given outcomes, creating
+ * it if no identical one exists yet
+ */
+static struct shared *ipt_shared_table(struct ipt_gen *const gen,
+				       const unsigned action,
+				       const unsigned expr,
+				       const char *const tbl_then,
+				       const char *const tbl_else,
+				       enum bool *const known)
+{
+    const unsigned long base = ipt_hash_shared(action, expr, tbl_then,
+					       tbl_else, FLAT_BERNSTEIN);
+    unsigned long hash = base;
+    struct shared *cur;
+
+    /* Look for an existing one; if another content has the same hash, the
+     * next value is tried, so that generated names stay unique */
+    while ((cur = find_shared(&gen->table, hash)) != NULL) {
+	if (same_shared(cur, action, expr, 0, 0, tbl_then, tbl_else)
+		== TRUE) {
+	    *known = TRUE;
+	    return cur;
+	}
+	hash = (hash + 1) & 0xFFFFFFFFUL;
+    }
+    *known = FALSE;
+
+    /* Make a new table and remember it */
+    if ((cur = ipt_new_table(gen, FLAT_NONE, base, hash,
+			     ipt_hash_shared(action, expr, tbl_then, tbl_else,
+					     FLAT_FNV))) == NULL) {
+	gen->rules.failed = TRUE;
+	return NULL;
+    }
+    cur->action = action;
+    cur->expr = expr;
+    if ((tbl_then != NULL && (cur->tbl_then = strdup(tbl_then)) == NULL)
+	|| (tbl_else != NULL && (cur->tbl_else = strdup(tbl_else)) == NULL)
+	|| hsh_add(&gen->table, &cur->elem, hash) == FALSE)
+	gen->rules.failed = TRUE;
+
+    return cur;
+}
+
+/*
+ * Get the generated table dispatching some intervals of a cascade (see
+ * ipt_cascade()), creating it if no identical one exists yet
+ */
+static struct shared *ipt_node_table(struct ipt_gen *const gen,
+				     const unsigned action,
+				     const unsigned first, const unsigned end,
+				     enum bool *const known)
+{
+    const unsigned long base
+	    = FLAT_MIX(FLAT_BERNSTEIN,
+		       FLAT_MIX(FLAT_BERNSTEIN,
+				ipt_hash_action(action, FLAT_BERNSTEIN),
+				first), end);
+    unsigned long hash = base, check;
+    struct shared *cur;
+
+    while ((cur = find_shared(&gen->table, hash)) != NULL) {
+	if (same_shared(cur, action, FLAT_NONE, first, end, NULL, NULL)
+		== TRUE) {
+	    *known = TRUE;
+	    return cur;
+	}
+	hash = (hash + 1) & 0xFFFFFFFFUL;
+    }
+    *known = FALSE;
+
+    check = FLAT_MIX(FLAT_FNV,
+		     FLAT_MIX(FLAT_FNV, ipt_hash_action(action, FLAT_FNV),
+			      first), end);
+    if ((cur = ipt_new_table(gen, FLAT_NONE, base, hash, check)) == NULL) {
+	gen->rules.failed = TRUE;
+	return NULL;
+    }
+    cur->action = action;
+    cur->first = first;
+    cur->end = end;
+    if (hsh_add(&gen->table, &cur->elem, hash) == FALSE)
+	gen->rules.failed = TRUE;
+
+    return cur;
+}
+
+/*
+ * Check if a shared table has the given contents (intervals of the action
+ * are given for a dispatching table, none otherwise)
+ */
+static enum bool same_shared(const struct shared *const cur,
+			     const unsigned action, const unsigned expr,
+			     const unsigned first, const unsigned end,
+			     const char *const tbl_then,
+			     const char *const tbl_else)
+{
+    if (action != FLAT_NONE)
+	return cur->action != FLAT_NONE && cur->first == first
+	       && cur->end == end
+	       ? flat_equal_action(flat, cur->action, action) : FALSE;
+
+    return cur->expr != FLAT_NONE
+	   && strcmp(cur->tbl_then, tbl_then) == 0
+	   && strcmp(cur->tbl_else, tbl_else) == 0
+	   && flat_equal_expr(flat, cur->expr, expr) == TRUE ? TRUE : FALSE;
+}
+
+/*
+ * Find the shared table having the given hash value
+ */
+static struct shared *find_shared(const struct hsh_table *const table,
+				  const unsigned long hash)
+{
+    return (struct shared *) hsh_find(table, hash, NULL, NULL);
+}
+
+/*
+ * Free everything a generation context created
+ */
+static void free_shared(struct ipt_gen *const gen)
+{
+    struct shared *cur, *next;
+
+    for (cur = gen->first; cur != NULL; cur = next) {
+	next = cur->list;
+	free(cur->tbl_then);
+	free(cur->tbl_else);
+	free(cur->name);
+	free(cur);
+    }
+    gen->first = gen->last = gen->cur = NULL;
+    free(gen->sets);
+    gen->sets = NULL;
+    gen->nb_sets = gen->max_sets = 0;
+
+    hsh_free(&gen->table, FALSE);
+    out_close(&gen->decl);
+    out_close(&gen->rules);
+    out_memory(&gen->decl);
+    out_memory(&gen->rules);
+}
+
+/*
+ * Begin to fill a table, its rules being output from now
+ */
+static void ipt_fill_begin(struct ipt_gen *const gen,
+			   struct shared *const table)
+{
+    table->rules_begin = gen->rules.len;
+    gen->cur = table;
+}
+
+/*
+ * End the filling of a table
+ */
+static void ipt_fill_end(struct ipt_gen *const gen,
+			 struct shared *const table)
+{
+    table->rules_end = gen->rules.len;
+    gen->cur = table->parent;
+}
+
 /*
  * Output an IPTables jump rule
  */
-static void ipt_out_jump(const char *const table, const char *const target)
+static void ipt_out_jump(struct ipt_gen *const gen,
+			 struct shared *const table,
+			 const char *const target, const unsigned src)
 {
-    if ((table[0] == '_' && table[1] == '_') || strcmp(table, cur_chain) == 0)
-	fprintf(out_file, "%s -A %s -j %s\n", ipt_exe, table, target);
+    if (table->changed == FALSE)
+	return;
+
+    ipt_out_append(&gen->rules, table->name, src);
+    ipt_out_target(&gen->rules, target);
+    table->nb_rules++;
+    if (ipt_is_jump(target) == TRUE)
+	table->nb_jumps++;
 }
 
 /*
- * Make a string from the given port structure
+ * Output the target of a rule; no table ever returns, each one ending with
+ * a verdict or a jump, so they are all reached through a goto, which saves
+ * a place in the jump stack of the kernel
  */
-static const char *make_port(const struct port *const port)
+static void ipt_out_target(struct out_sink *const buf,
+			   const char *const target)
 {
-    static char res[12];
+    out_strs(buf, ipt_is_jump(target) == TRUE ? " -g " : " -j ", target,
+	     "\n", NULL);
+}
 
-    switch (port->type) {
-    case PORT_NUMERIC:
-	if (port->port.range.from == port->port.range.to)
-	    sprintf(res, "%d", port->port.range.from);
-	else
-	    sprintf(res, "%d:%d", port->port.range.from, port->port.range.to);
+/*
+ * Tell wether a target is a table, rather than a final one
+ */
+static enum bool ipt_is_jump(const char *const target)
+{
+    return strcmp(target, "ACCEPT") != 0 && strcmp(target, "DROP") != 0
+	   && strcmp(target, "REJECT") != 0 ? TRUE : FALSE;
+}
+
+/*
+ * Get the end of the ports matched by a single rule: several of them are
+ * grouped in a multiport match
+ */
+static const struct flat_port *ipt_port_chunk(
+	const struct flat_port *const first, const struct flat_port *const last)
+{
+    const struct flat_port *port;
+    unsigned nb = 0, size;
+
+    for (port = first; port != last; port++) {
+	size = port->name == FLAT_NONE
+	       && port->range.from != port->range.to ? 2 : 1;
+	if (nb + size > MULTIPORT_MAX)
+	    break;
+	nb += size;
+    }
+
+    return port;
+}
+
+/*
+ * Output an IPTables rule matching some ports ("sport", "dport", or "port"
+ * for both with a multiport match) and jumping to a target
+ */
+static void ipt_out_ports(struct out_sink *const buf, const char *const table,
+			  const char *const proto, const char *const dir,
+			  const struct flat_port *first,
+			  const struct flat_port *const end,
+			  const char *const target, const unsigned src)
+{
+    const enum bool multi = first + 1 != end ? TRUE : FALSE;
+
+    ipt_out_append(buf, table, src);
+    out_strs(buf, " -p ", proto, multi == TRUE ? " -m multiport --" : " --",
+	     dir, multi == TRUE ? "s " : " ", NULL);
+    ipt_out_list(buf, first, end);
+    ipt_out_target(buf, target);
+}
+
+/*
+ * Output a list of ports, separated by commas
+ */
+static void ipt_out_list(struct out_sink *const buf,
+			 const struct flat_port *first,
+			 const struct flat_port *const end)
+{
+    for (; first != end; first++) {
+	if (first->name != FLAT_NONE)
+	    out_str(buf, FLAT_STRING(flat, first->name));
+	else {
+	    out_number(buf, (unsigned long) first->range.from);
+	    if (first->range.from != first->range.to) {
+		out_char(buf, ':');
+		out_number(buf, (unsigned long) first->range.to);
+	    }
+	}
+	if (first + 1 != end)
+	    out_char(buf, ',');
+    }
+}
+
+/*
+ * Register the set matching the elements of a list, named after them
+ */
+static const char *ipt_new_set(struct ipt_gen *const gen,
+			       const struct shared *const table,
+			       const struct flat_cond *const cond)
+{
+    unsigned long hash1 = HASH_SEED, hash2 = HASH_FNV_SEED;
+    const struct flat_port *port;
+    struct ipt_set *set;
+    const char *string;
+    unsigned max, i;
+
+    if (gen->nb_sets == gen->max_sets) {
+	max = gen->max_sets != 0 ? gen->max_sets * 2 : 16;
+	if ((set = realloc(gen->sets, sizeof(struct ipt_set) * max)) == NULL)
+	    return NULL;
+	gen->sets = set;
+	gen->max_sets = max;
+    }
+    set = gen->sets + gen->nb_sets++;
+    set->table = table;
+    set->cond = cond;
+    set->skip = FALSE;
+
+    /* Two different hash values of the type and of the elements */
+    i = cond->type != COND_ADDR ? 'p' : cond->proto == PROTO_IPV6 ? '6' : '4';
+    hash1 = SET_HASH1(hash1, i);
+    hash2 = SET_HASH2(hash2, i);
+    for (i = 0; i < cond->nb; i++) {
+	if (cond->type == COND_ADDR)
+	    string = FLAT_ADDR(flat, cond, i);
+	else if ((port = FLAT_PORT(flat, cond, i))->name != FLAT_NONE)
+	    string = FLAT_STRING(flat, port->name);
+	else {
+	    string = "";
+	    hash1 = SET_HASH1(SET_HASH1(hash1, port->range.from),
+			      port->range.to);
+	    hash2 = SET_HASH2(SET_HASH2(hash2, port->range.from),
+			      port->range.to);
+	}
+	for (; *string != '\0'; string++) {
+	    hash1 = SET_HASH1(hash1, (unsigned char) *string);
+	    hash2 = SET_HASH2(hash2, (unsigned char) *string);
+	}
+	hash1 = SET_HASH1(hash1, ',');
+	hash2 = SET_HASH2(hash2, ',');
+    }
+
+    sprintf(set->name, "__RW%08lx%08lx", hash1, hash2);
+    return set->name;
+}
+
+/*
+ * Check if two lists give the same set
+ */
+static enum bool same_set(const struct flat_cond *const a,
+			  const struct flat_cond *const b)
+{
+    const struct flat_port *port_a, *port_b;
+    unsigned i;
+
+    if (a->type != b->type || a->nb != b->nb
+	|| (a->type == COND_ADDR
+	    && (a->proto == PROTO_IPV6) != (b->proto == PROTO_IPV6)))
+	return FALSE;
+
+    for (i = 0; i < a->nb; i++)
+	if (a->type == COND_ADDR) {
+	    if (flat->addrs[a->first + i] != flat->addrs[b->first + i])
+		return FALSE;
+	} else {
+	    port_a = FLAT_PORT(flat, a, i);
+	    port_b = FLAT_PORT(flat, b, i);
+	    if (port_a->name != port_b->name
+		|| port_a->range.from != port_b->range.from
+		|| port_a->range.to != port_b->range.to)
+		return FALSE;
+	}
+    return TRUE;
+}
+
+/*
+ * Output an IPTables rule matching a set ("src" or "dst" direction) and
+ * jumping to a target; proto is NULL for an address set
+ */
+static void ipt_out_set(struct out_sink *const buf, const char *const table,
+			const char *const proto, const char *const set,
+			const char *const dir, const char *const target,
+			const unsigned src)
+{
+    ipt_out_append(buf, table, src);
+    if (proto != NULL)
+	out_strs(buf, " -p ", proto, NULL);
+    out_strs(buf, " -m set --match-set ", set, " ", dir, NULL);
+    ipt_out_target(buf, target);
+}
+
+/*
+ * Output an IPTables rule jumping to a target if the field tested by a
+ * cascade is in an interval: a port range, a network prefix if possible or
+ * an address range
+ */
+static void ipt_out_range(struct ipt_gen *const gen,
+			  struct shared *const table,
+			  const struct flat_cond *const cond,
+			  const unsigned long from, const unsigned long to,
+			  const char *const target, const unsigned src)
+{
+    struct out_sink *const buf = &gen->rules;
+    unsigned len;
+
+    if (table->changed == FALSE)
+	return;
+
+    ipt_out_append(buf, table->name, src);
+    if (cond->type == COND_PORT) {
+	out_strs(buf, cond->proto == PROTO_TCP ? " -p tcp" : " -p udp",
+		 cond->dir == DIR_SRC ? " --sport " : " --dport ", NULL);
+	out_number(buf, from);
+	if (from != to) {
+	    out_char(buf, ':');
+	    out_number(buf, to);
+	}
+    } else if (itv_prefix(from, to, &len) == TRUE) {
+	out_str(buf, cond->dir == DIR_SRC ? " -s " : " -d ");
+	itv_out_ipv4(buf, from);
+	if (len < 32) {
+	    out_char(buf, '/');
+	    out_number(buf, (unsigned long) len);
+	}
+    } else {
+	out_str(buf, cond->dir == DIR_SRC ? " -m iprange --src-range "
+					  : " -m iprange --dst-range ");
+	itv_out_ipv4(buf, from);
+	out_char(buf, '-');
+	itv_out_ipv4(buf, to);
+    }
+    ipt_out_target(buf, target);
+
+    table->nb_rules++;
+    if (ipt_is_jump(target) == TRUE)
+	table->nb_jumps++;
+}
+
+/*
+ * Compute the hash value of the generated table processing a test action
+ * (if action is not FLAT_NONE) or evaluating an expression with the given
+ * outcomes, with a hash function
+ */
+static unsigned long ipt_hash_shared(const unsigned action,
+				     const unsigned expr,
+				     const char *const tbl_then,
+				     const char *const tbl_else,
+				     const enum flat_hash func)
+{
+    unsigned long hash;
+
+    if (action != FLAT_NONE)
+	return ipt_hash_action(action, func);
+
+    hash = flat_hash_string(flat_hash_expr(flat, expr, func), tbl_then, func);
+    return ipt_hash_options(flat_hash_string(hash, tbl_else, func), func);
+}
+
+/*
+ * Compute the hash value of the table processing an action with a hash
+ * function: the small user chains it calls may be inlined, so their
+ * contents count as well
+ */
+static unsigned long ipt_hash_action(const unsigned action,
+				     const enum flat_hash func)
+{
+    const unsigned long hash = flat_hash_action(flat, action, func);
+
+    return ipt_hash_options(ipt_hash_inlined(hash, action, 0, func), func);
+}
+
+/*
+ * Mix the generation options changing the rules of a table into a hash
+ * value, with a hash function, so that the manifest tells the tables
+ * generated with other options apart
+ */
+static unsigned long ipt_hash_options(const unsigned long hash,
+				      const enum flat_hash func)
+{
+    return FLAT_MIX(func, hash, set_min);
+}
+
+/*
+ * Mix the hash values of the small user chains called by an action into a
+ * hash value, with a hash function
+ */
+static unsigned long ipt_hash_inlined(unsigned long hash,
+				      const unsigned action,
+				      const unsigned depth,
+				      const enum flat_hash func)
+{
+    const struct flat_action *const node = FLAT_ACTION(flat, action);
+    const struct flat_test *test;
+    unsigned inner;
+
+    switch (node->type) {
+    case TARGET_FINAL:
 	break;
 
-    case PORT_NAME:
-	return port->port.name;
+    case TARGET_USER:
+	if (depth < INLINE_DEPTH && ipt_small(node->value) == TRUE) {
+	    inner = FLAT_CHAIN(flat, node->value)->action;
+	    hash = FLAT_MIX(func, hash, flat_hash_action(flat, inner, func));
+	    hash = ipt_hash_inlined(hash, inner, depth + 1, func);
+	}
+	break;
+
+    case TARGET_TEST:
+	test = FLAT_TEST(flat, node->value);
+	hash = ipt_hash_inlined(hash, test->act_then, depth, func);
+	hash = ipt_hash_inlined(hash, test->act_else, depth, func);
     }
 
-    return res;
+    return hash;
+}
+
+/*
+ * Get the action a branch really leads to, skipping the user chains doing
+ * nothing but a verdict or a jump
+ */
+static unsigned ipt_resolve(unsigned action)
+{
+    const struct flat_action *node = FLAT_ACTION(flat, action);
+    unsigned depth, next;
+
+    for (depth = 0; node->type == TARGET_USER && depth < INLINE_DEPTH;
+	 depth++) {
+	next = FLAT_CHAIN(flat, node->value)->action;
+	if (FLAT_ACTION(flat, next)->type == TARGET_TEST)
+	    break;
+	node = FLAT_ACTION(flat, action = next);
+    }
+
+    return action;
+}
+
+/*
+ * Tell wether a user chain is small enough to be inlined where it is
+ * called: a verdict, a jump, or a test of a single condition between two
+ * of them, in a few rules
+ */
+static enum bool ipt_small(const unsigned chain)
+{
+    const struct flat_action *const node
+	    = FLAT_ACTION(flat, FLAT_CHAIN(flat, chain)->action);
+    const struct flat_test *test;
+    const struct flat_expr *expr;
+    const struct flat_cond *cond;
+
+    if (node->type != TARGET_TEST)
+	return TRUE;
+
+    test = FLAT_TEST(flat, node->value);
+    expr = FLAT_EXPR(flat, test->expr);
+    if (expr->type != EXPR_COND
+	|| FLAT_ACTION(flat, test->act_then)->type == TARGET_TEST
+	|| FLAT_ACTION(flat, test->act_else)->type == TARGET_TEST)
+	return FALSE;
+
+    /* At most one rule per element, direction and protocol, and the one of
+     * the else branch */
+    cond = FLAT_COND(flat, expr->left);
+    return cond->nb * (cond->dir == DIR_BOTH ? 2 : 1)
+	   * (cond->type == COND_PORT && cond->proto == PROTO_PORT ? 2 : 1)
+	   < INLINE_RULES ? TRUE : FALSE;
+}
+
+/*
+ * Tell wether a test branch is processed in the table of the test, rather
+ * than in a table of its own: a test, or a small user chain doing one
+ */
+static enum bool ipt_inlined(const struct ipt_gen *const gen,
+			     const unsigned action)
+{
+    const struct flat_action *const node = FLAT_ACTION(flat, action);
+
+    if (node->type == TARGET_TEST)
+	return TRUE;
+
+    return node->type == TARGET_USER && gen->inlined < INLINE_DEPTH
+	   && FLAT_ACTION(flat, FLAT_CHAIN(flat, node->value)->action)->type
+	      == TARGET_TEST
+	   && ipt_small(node->value) == TRUE ? TRUE : FALSE;
+}
+
+/*
+ * Tell wether rules can jump if an expression has the given value, the
+ * packets falling through otherwise: conditions (negated ones only if
+ * ipt_negatable() allows it), and the operands of a "||" for a true value
+ * or of a "&&" for a false one
+ */
+static enum bool ipt_direct(const unsigned expr, enum bool value)
+{
+    const struct flat_expr *const node = FLAT_EXPR(flat, expr);
+
+    if (node->not)
+	value = value == TRUE ? FALSE : TRUE;
+
+    switch (node->type) {
+    case EXPR_COND:
+	return value == TRUE
+	       || ipt_negatable(FLAT_COND(flat, node->left)) == TRUE
+	       ? TRUE : FALSE;
+
+    case EXPR_AND:
+    case EXPR_OR:
+	return (node->type == EXPR_OR) == (value == TRUE)
+	       && ipt_direct(node->left, value) == TRUE
+	       && ipt_direct(node->right, value) == TRUE ? TRUE : FALSE;
+    }
+
+    return FALSE;
+}
+
+/*
+ * Tell wether the packets not matching a condition can be caught by a few
+ * rules: a single address (a host name may have several ones, which can't
+ * be negated one by one), or ports of a single protocol fitting in one
+ * rule; the lists matched through a set are not
+ */
+static enum bool ipt_negatable(const struct flat_cond *const cond)
+{
+    struct prefix prefix;
+    const char *addr;
+
+    if (cond->nb == 0 || (set_min != 0 && cond->nb >= set_min))
+	return FALSE;
+
+    if (cond->type == COND_ADDR) {
+	addr = FLAT_ADDR(flat, cond, 0);
+	return cond->nb == 1 && (strchr(addr, ':') != NULL
+				 || string_to_prefix(addr, &prefix) == TRUE)
+	       ? TRUE : FALSE;
+    }
+
+    return cond->proto != PROTO_PORT
+	   && ipt_port_chunk(FLAT_PORT(flat, cond, 0),
+			     FLAT_PORT(flat, cond, cond->nb))
+	      == FLAT_PORT(flat, cond, cond->nb) ? TRUE : FALSE;
 }
 
 
@@ -198,44 +1449,181 @@ static const char *make_port(const struct port *const port)
  *
  */
 
+/*
+ * Render the chains of a generation context
+ */
+static void ipt_generate(struct ipt_gen *const gen)
+{
+    unsigned i;
+
+    for (i = 0; i < gen->nb_chains; i++)
+	ipt_chain(gen, gen->chain + i);
+
+    /* The tables are now looked up among all the contexts */
+    hsh_free(&gen->table, FALSE);
+}
+
+/*
+ * Decide which tables of a generation context are really output: the ones
+ * not generated yet by the previous contexts; return FALSE if the names
+ * are not the ones a processing in order would give
+ */
+static enum bool ipt_merge(struct ipt_gen *const gen,
+			   struct hsh_table *const known)
+{
+    struct shared *cur, *other;
+    unsigned long hash;
+
+    for (cur = gen->first; cur != NULL; cur = cur->list) {
+	if (cur->chain == FLAT_NONE) {
+	    /* Inside a skipped table, it isn't even looked for */
+	    if (cur->parent->skip == TRUE) {
+		cur->skip = TRUE;
+		continue;
+	    }
+
+	    /* Look for it as ipt_shared_table() would have */
+	    for (hash = cur->base; (other = find_shared(known, hash)) != NULL;
+		 hash = (hash + 1) & 0xFFFFFFFFUL)
+		if (same_shared(other, cur->action, cur->expr, cur->first,
+				cur->end, cur->tbl_then, cur->tbl_else)
+			== TRUE)
+		    break;
+	    if (other != NULL) {
+		cur->skip = TRUE;
+		continue;
+	    }
+	    if (hash != cur->hash)
+		return FALSE;
+	    if (hsh_add(known, &cur->elem, hash) == FALSE)
+		gen->rules.failed = TRUE;
+	}
+
+	/* Record it in the manifest, in order */
+	man_update(cur->name, cur->hash, cur->check);
+    }
+
+    return TRUE;
+}
+
+/*
+ * Render generation contexts, using as many threads as processors
+ */
+static void ipt_run(struct ipt_gen *const gens, const unsigned nb_gens)
+{
+#if HAVE_PTHREAD_H
+    pthread_t threads[MAX_THREADS];
+    unsigned nb_threads = 0, i;
+#ifdef _SC_NPROCESSORS_ONLN
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif /* _SC_NPROCESSORS_ONLN */
+#endif /* HAVE_PTHREAD_H */
+
+    next_gen = gens;
+    end_gen = gens + nb_gens;
+
+#if HAVE_PTHREAD_H
+#ifdef _SC_NPROCESSORS_ONLN
+    /* The current thread is one of the workers */
+    while (cpus > 1 && nb_threads + 1 < (unsigned long) cpus
+	   && nb_threads + 1 < nb_gens && nb_threads < MAX_THREADS
+	   && pthread_create(&threads[nb_threads], NULL, ipt_worker,
+			     NULL) == 0)
+	nb_threads++;
+#endif /* _SC_NPROCESSORS_ONLN */
+#endif /* HAVE_PTHREAD_H */
+
+    ipt_worker(NULL);
+
+#if HAVE_PTHREAD_H
+    for (i = 0; i < nb_threads; i++)
+	pthread_join(threads[i], NULL);
+#endif /* HAVE_PTHREAD_H */
+}
+
+/*
+ * Render generation contexts until there is none left, in each thread
+ */
+static void *ipt_worker(void *const arg)
+{
+    struct ipt_gen *gen;
+
+    (void) arg;
+    for (;;) {
+#if HAVE_PTHREAD_H
+	pthread_mutex_lock(&gen_mutex);
+#endif /* HAVE_PTHREAD_H */
+	gen = next_gen != end_gen ? next_gen++ : NULL;
+#if HAVE_PTHREAD_H
+	pthread_mutex_unlock(&gen_mutex);
+#endif /* HAVE_PTHREAD_H */
+
+	if (gen == NULL)
+	    return NULL;
+	ipt_generate(gen);
+    }
+}
+
 /*
  * Process a chain
  */
-static void ipt_chain(const struct chain *const chain)
+static void ipt_chain(struct ipt_gen *const gen, const unsigned chain)
 {
-    cur_chain = chain->name;
-    ipt_out_create(chain->name);
-    ipt_action(chain->name, chain->action);
+    const unsigned action = FLAT_CHAIN(flat, chain)->action;
+    struct shared *table;
+
+    if (format == IPT_SCRIPT)
+	out_strs(&gen->rules, "\n", NULL);
+
+    gen->cur = NULL;
+    if ((table = ipt_new_table(gen, chain, 0,
+			       ipt_hash_action(action, FLAT_BERNSTEIN),
+			       ipt_hash_action(action, FLAT_FNV))) == NULL) {
+	gen->rules.failed = TRUE;
+	return;
+    }
+    ipt_fill_begin(gen, table);
+    ipt_action(gen, table, action);
+    ipt_fill_end(gen, table);
 }
 
 /*
  * Process an action
  */
-static void ipt_action(const char *const table,
-		       const struct action *const action)
+static void ipt_action(struct ipt_gen *const gen, struct shared *const table,
+		       const unsigned action)
 {
-    switch (action->type) {
+    const struct flat_action *const node = FLAT_ACTION(flat, action);
+
+    switch (node->type) {
     case TARGET_FINAL:
-	switch (action->action.final) {
+	switch (node->value) {
 	case FINAL_ACCEPT:
-	    ipt_out_jump(table, "ACCEPT");
+	    ipt_out_jump(gen, table, "ACCEPT", node->src);
 	    break;
 
 	case FINAL_DROP:
-	    ipt_out_jump(table, "DROP");
+	    ipt_out_jump(gen, table, "DROP", node->src);
 	    break;
 
 	case FINAL_REJECT:
-	    ipt_out_jump(table, "REJECT");
+	    ipt_out_jump(gen, table, "REJECT", node->src);
 	}
 	break;
 
     case TARGET_USER:
-	ipt_out_jump(table, action->action.user->name);
+	/* A small chain is processed in place, rather than jumped to */
+	if (gen->inlined < INLINE_DEPTH && ipt_small(node->value) == TRUE) {
+	    gen->inlined++;
+	    ipt_action(gen, table, FLAT_CHAIN(flat, node->value)->action);
+	    gen->inlined--;
+	} else
+	    ipt_out_jump(gen, table, FLAT_NAME(flat, node->value), node->src);
 	break;
 
     case TARGET_TEST:
-	ipt_test(table, action->action.test);
+	if (ipt_cascade(gen, table, action) == FALSE)
+	    ipt_test(gen, table, node->value);
 	break;
     }
 }
@@ -243,99 +1631,487 @@ static void ipt_action(const char *const table,
 /*
  * Process a test
  */
-static void ipt_test(const char *const table, const struct test *const test)
+static void ipt_test(struct ipt_gen *const gen, struct shared *const table,
+		     const unsigned test)
 {
-    char *const tbl_then = ipt_new_table(test->act_then);
-    char *const tbl_else = ipt_new_table(test->act_else);
+    const struct flat_test *const node = FLAT_TEST(flat, test);
+    const unsigned act_then = ipt_resolve(node->act_then);
+    const unsigned act_else = ipt_resolve(node->act_else);
+    struct shared *fill_then = NULL, *fill_else = NULL;
+    const char *tbl_then, *tbl_else;
 
-    ipt_expr(table, tbl_then, tbl_else, test->expr);
-    ipt_action(tbl_then, test->act_then);
-    ipt_action(tbl_else, test->act_else);
+    /* A branch which can be processed in this table comes after the rules
+     * jumping to the other one, the packets left falling through to it;
+     * the then branch needs the expression to be negated */
+    if (ipt_inlined(gen, act_else) == TRUE
+	&& ipt_direct(node->expr, TRUE) == TRUE) {
+	tbl_then = ipt_branch_table(gen, act_then, &fill_then);
+	ipt_match(gen, table, tbl_then, node->expr, TRUE);
+	ipt_action(gen, table, act_else);
+    } else if (ipt_inlined(gen, act_then) == TRUE
+	       && ipt_direct(node->expr, FALSE) == TRUE) {
+	tbl_else = ipt_branch_table(gen, act_else, &fill_else);
+	ipt_match(gen, table, tbl_else, node->expr, FALSE);
+	ipt_action(gen, table, act_then);
+    } else {
+	tbl_then = ipt_branch_table(gen, act_then, &fill_then);
+	tbl_else = ipt_branch_table(gen, act_else, &fill_else);
+	ipt_expr(gen, table, tbl_then, tbl_else, node->expr);
+    }
 
-    free(tbl_else);
+    if (fill_then != NULL) {
+	ipt_fill_begin(gen, fill_then);
+	ipt_action(gen, fill_then, act_then);
+	ipt_fill_end(gen, fill_then);
+    }
+    if (fill_else != NULL) {
+	ipt_fill_begin(gen, fill_else);
+	ipt_action(gen, fill_else, act_else);
+	ipt_fill_end(gen, fill_else);
+    }
+}
+
+/*
+ * Process a cascade of tests on the same field, if it is long enough: the
+ * arm matching a packet is found by a binary search through generated
+ * tables, rather than by trying them in turn; return FALSE if the action
+ * isn't such a cascade
+ */
+static enum bool ipt_cascade(struct ipt_gen *const gen,
+			     struct shared *const table,
+			     const unsigned action)
+{
+    const struct flat_action *node = FLAT_ACTION(flat, action);
+    const struct flat_test *test;
+    const struct flat_expr *expr;
+    const struct flat_cond *cond;
+    struct cascade cascade;
+    struct shared **fills = NULL, *fill_rest;
+    struct interval *tmp;
+    unsigned rest = action, nb_arms = 0, size = 0, i;
+
+    /* Gather the arms: positive conditions on the same field (a single
+     * direction, and a single protocol for ports), with numeric values */
+    cascade.action = action;
+    cascade.cond = NULL;
+    cascade.elems = NULL;
+    cascade.nb_elems = 0;
+    cascade.targets = NULL;
+    while (node->type == TARGET_TEST) {
+	test = FLAT_TEST(flat, node->value);
+	expr = FLAT_EXPR(flat, test->expr);
+	if (expr->type != EXPR_COND || expr->not)
+	    break;
+	cond = FLAT_COND(flat, expr->left);
+	if (cond->nb == 0 || cond->dir == DIR_BOTH
+	    || cond->proto == (cond->type == COND_ADDR ? PROTO_IPV6
+						       : PROTO_PORT))
+	    break;
+	if (cascade.cond != NULL && (cond->type != cascade.cond->type
+				     || cond->proto != cascade.cond->proto
+				     || cond->dir != cascade.cond->dir))
+	    break;
+
+	if (cascade.nb_elems + cond->nb > size) {
+	    size = (cascade.nb_elems + cond->nb) * 2;
+	    if ((tmp = realloc(cascade.elems, sizeof(struct interval) * size))
+		    == NULL)
+		break;
+	    cascade.elems = tmp;
+	}
+	if (itv_get_flat(flat, cond, nb_arms,
+			 cascade.elems + cascade.nb_elems) != cond->nb)
+	    break;
+
+	cascade.cond = cond;
+	cascade.nb_elems += cond->nb;
+	nb_arms++;
+	rest = test->act_else;
+	node = FLAT_ACTION(flat, rest);
+    }
+
+    /* Long enough, with arms matching different values */
+    if (nb_arms >= CASCADE_MIN)
+	cascade.nb_elems = itv_merge(cascade.elems, cascade.nb_elems);
+    if (nb_arms < CASCADE_MIN
+	|| itv_disjoint(cascade.elems, cascade.nb_elems) == FALSE
+	|| (cascade.targets = malloc(sizeof(char *) * nb_arms)) == NULL
+	|| (fills = malloc(sizeof(struct shared *) * nb_arms)) == NULL) {
+	free(cascade.targets);
+	free(cascade.elems);
+	return FALSE;
+    }
+
+    /* Tables of the arms, and of what to do if none matches */
+    node = FLAT_ACTION(flat, action);
+    for (i = 0; i < nb_arms; i++) {
+	test = FLAT_TEST(flat, node->value);
+	cascade.targets[i] = ipt_branch_table(gen, test->act_then,
+					      &fills[i]);
+	node = FLAT_ACTION(flat, test->act_else);
+    }
+    cascade.rest = ipt_branch_table(gen, rest, &fill_rest);
+
+    /* Dispatch, then fill the new tables */
+    ipt_dispatch(gen, table, &cascade, 0, cascade.nb_elems,
+		 cascade.cond->type == COND_ADDR ? 0xFFFFFFFFUL : 65535UL);
+    node = FLAT_ACTION(flat, action);
+    for (i = 0; i < nb_arms; i++) {
+	test = FLAT_TEST(flat, node->value);
+	if (fills[i] != NULL) {
+	    ipt_fill_begin(gen, fills[i]);
+	    ipt_action(gen, fills[i], test->act_then);
+	    ipt_fill_end(gen, fills[i]);
+	}
+	node = FLAT_ACTION(flat, test->act_else);
+    }
+    if (fill_rest != NULL) {
+	ipt_fill_begin(gen, fill_rest);
+	ipt_action(gen, fill_rest, rest);
+	ipt_fill_end(gen, fill_rest);
+    }
+
+    free(fills);
+    free(cascade.targets);
+    free(cascade.elems);
+    return TRUE;
+}
+
+/*
+ * Output the rules of a table dispatching some intervals of a cascade, all
+ * of the values tested in it being at most upper: the upper half of the
+ * intervals is handed to another table, the lower one is split in the
+ * same way, until few enough intervals are left to be tried in turn
+ */
+static void ipt_dispatch(struct ipt_gen *const gen, struct shared *const table,
+			 const struct cascade *const cascade,
+			 const unsigned first, unsigned end,
+			 unsigned long upper)
+{
+    /* Each split halves the number of intervals, which fits in 32 bits */
+    const unsigned src = FLAT_ACTION(flat, cascade->action)->src;
+    struct shared *nodes[32];
+    unsigned long uppers[32];
+    unsigned nb = 0, mid, i;
+    enum bool known;
+
+    while (end - first > CASCADE_LEAF) {
+	mid = first + (end - first) / 2;
+	if ((nodes[nb] = ipt_node_table(gen, cascade->action, mid, end,
+					&known)) == NULL)
+	    return;
+	ipt_out_range(gen, table, cascade->cond, cascade->elems[mid].from,
+		      upper, nodes[nb]->name, src);
+	uppers[nb] = upper;
+	if (known == FALSE)
+	    nb++;
+	upper = cascade->elems[mid].from - 1;
+	end = mid;
+    }
+
+    for (i = first; i < end; i++)
+	ipt_out_range(gen, table, cascade->cond, cascade->elems[i].from,
+		      cascade->elems[i].to,
+		      cascade->targets[cascade->elems[i].arm],
+		      cascade->elems[i].src);
+    ipt_out_jump(gen, table, cascade->rest, src);
+
+    for (i = 0; i < nb; i++) {
+	ipt_fill_begin(gen, nodes[i]);
+	ipt_dispatch(gen, nodes[i], cascade, nodes[i]->first, nodes[i]->end,
+		     uppers[i]);
+	ipt_fill_end(gen, nodes[i]);
+    }
 }
 
 /*
  * Process an expression
  */
-static void ipt_expr(const char *const table,
+static void ipt_expr(struct ipt_gen *const gen, struct shared *const table,
 		     const char *tbl_then, const char *tbl_else,
-		     const struct expr *const expr)
+		     const unsigned expr)
 {
-    char *inter;
+    const struct flat_expr *const node = FLAT_EXPR(flat, expr);
+    const struct flat_expr *left;
+    struct shared *inter;
+    enum bool known;
 
-    if (expr->not) {
+    if (node->not) {
 	const char *const tmp = tbl_then;
 	tbl_then = tbl_else;
 	tbl_else = tmp;
     }
 
-    if (expr->type == EXPR_COND)
-	ipt_cond(table, tbl_then, tbl_else, expr->sub.cond);
-    else {
-	inter = ipt_new_table(NULL);
+    if (node->type == EXPR_COND) {
+	ipt_cond(gen, table, tbl_then, tbl_else, FLAT_COND(flat, node->left));
+	return;
+    }
+    left = FLAT_EXPR(flat, node->left);
 
-	switch (expr->type) {
-	case EXPR_AND:
-	    ipt_expr(table, inter, tbl_else, expr->sub.expr.left);
-	    break;
+    /* If the left operand is a condition whose match alone decides the
+     * result (positive in a "||", negated in a "&&"), its rules jump to
+     * the outcome and the right operand is evaluated in the same table */
+    if (left->type == EXPR_COND
+	&& (node->type == EXPR_OR) == (left->not == FALSE)) {
+	ipt_cond_rules(gen, table,
+		       node->type == EXPR_OR ? tbl_then : tbl_else,
+		       FLAT_COND(flat, left->left));
+	ipt_expr(gen, table, tbl_then, tbl_else, node->right);
+	return;
+    }
 
-	case EXPR_OR:
-	    ipt_expr(table, tbl_then, inter, expr->sub.expr.left);
+    /* Otherwise, the right operand gets its own table, which is shared with
+     * the identical expressions already processed */
+    if ((inter = ipt_shared_table(gen, FLAT_NONE, node->right, tbl_then,
+				  tbl_else, &known)) == NULL)
+	return;
 
-	case EXPR_COND:
-	    break;
-	}
-	ipt_expr(inter, tbl_then, tbl_else, expr->sub.expr.right);
+    switch (node->type) {
+    case EXPR_AND:
+	ipt_expr(gen, table, inter->name, tbl_else, node->left);
+	break;
 
-	free(inter);
+    case EXPR_OR:
+	ipt_expr(gen, table, tbl_then, inter->name, node->left);
+
+    case EXPR_COND:
+	break;
     }
+    if (known == FALSE) {
+	ipt_fill_begin(gen, inter);
+	ipt_expr(gen, inter, tbl_then, tbl_else, node->right);
+	ipt_fill_end(gen, inter);
+    }
+}
+
+/*
+ * Output the rules jumping to a target if an expression has the given
+ * value, the packets falling through otherwise (see ipt_direct())
+ */
+static void ipt_match(struct ipt_gen *const gen, struct shared *const table,
+		      const char *const target, const unsigned expr,
+		      enum bool value)
+{
+    const struct flat_expr *const node = FLAT_EXPR(flat, expr);
+
+    if (node->not)
+	value = value == TRUE ? FALSE : TRUE;
+
+    if (node->type != EXPR_COND) {
+	ipt_match(gen, table, target, node->left, value);
+	ipt_match(gen, table, target, node->right, value);
+    } else if (value == TRUE)
+	ipt_cond_rules(gen, table, target, FLAT_COND(flat, node->left));
+    else
+	ipt_cond_negated(gen, table, target, FLAT_COND(flat, node->left));
 }
 
 /*
  * Process a condition
  */
-static void ipt_cond(const char *const table,
+static void ipt_cond(struct ipt_gen *const gen, struct shared *const table,
 		     const char *const tbl_then, const char *const tbl_else,
-		     const struct condition *const cond)
-{
-    const struct addr *addr;
-    const struct port *port;
-
-    switch (cond->type) {
-    case COND_ADDR:
-	for (addr = cond->cond.addr; addr != NULL; addr = addr->next) {
-	    if (cond->dir == DIR_BOTH || cond->dir == DIR_SRC)
-		fprintf(out_file, "%s -A %s -s %s -j %s\n",
-			ipt_exe, table, addr->string, tbl_then);
-	    if (cond->dir == DIR_BOTH || cond->dir == DIR_DST)
-		fprintf(out_file, "%s -A %s -d %s -j %s\n",
-			ipt_exe, table, addr->string, tbl_then);
+		     const struct flat_cond *const cond)
+{
+    ipt_cond_rules(gen, table, tbl_then, cond);
+    ipt_out_jump(gen, table, tbl_else, cond->src);
+}
+
+/*
+ * Output the rules jumping to a target if a condition matches
+ */
+static void ipt_cond_rules(struct ipt_gen *const gen,
+			   struct shared *const table,
+			   const char *const target,
+			   const struct flat_cond *const cond)
+{
+    struct out_sink *const buf = &gen->rules;
+    const struct flat_port *port, *end, *last;
+    const char *addr;
+    unsigned nb = 0, i;
+
+    /* The sets of an unchanged table are still matched, so they are kept */
+    if (table->changed == FALSE) {
+	if (set_min != 0 && cond->nb >= set_min
+	    && ipt_new_set(gen, table, cond) == NULL)
+	    gen->rules.failed = TRUE;
+	return;
+    }
+
+    /* Long lists are matched through a set, in a few rules */
+    if (set_min != 0 && cond->nb >= set_min)
+	nb = ipt_cond_set(gen, table, target, cond);
+    else
+	switch (cond->type) {
+	case COND_ADDR:
+	    for (i = 0; i < cond->nb; i++) {
+		addr = FLAT_ADDR(flat, cond, i);
+		if (cond->dir == DIR_BOTH || cond->dir == DIR_SRC) {
+		    ipt_out_append(buf, table->name, cond->src);
+		    out_strs(buf, " -s ", addr, NULL);
+		    ipt_out_target(buf, target);
+		    nb++;
+		}
+		if (cond->dir == DIR_BOTH || cond->dir == DIR_DST) {
+		    ipt_out_append(buf, table->name, cond->src);
+		    out_strs(buf, " -d ", addr, NULL);
+		    ipt_out_target(buf, target);
+		    nb++;
+		}
+	    }
+	    break;
+
+	case COND_PORT:
+	    last = FLAT_PORT(flat, cond, cond->nb);
+	    for (port = FLAT_PORT(flat, cond, 0); port != last; port = end) {
+		end = ipt_port_chunk(port, last);
+		if (cond->proto == PROTO_PORT || cond->proto == PROTO_TCP)
+		    nb += ipt_cond_ports(buf, table->name, "tcp", cond->dir,
+					 port, end, target, cond->src);
+		if (cond->proto == PROTO_PORT || cond->proto == PROTO_UDP)
+		    nb += ipt_cond_ports(buf, table->name, "udp", cond->dir,
+					 port, end, target, cond->src);
+	    }
 	}
-	break;
 
-    case COND_PORT:
-	for (port = cond->cond.port; port != NULL; port = port->next) {
-	    if (cond->proto == PROTO_PORT || cond->proto == PROTO_TCP) {
-		if (cond->dir == DIR_BOTH || cond->dir == DIR_SRC)
-		    fprintf(out_file, "%s -A %s -p tcp --sport %s -j %s\n",
-			    ipt_exe, table, make_port(port), tbl_then);
-		if (cond->dir == DIR_BOTH || cond->dir == DIR_DST)
-		    fprintf(out_file, "%s -A %s -p tcp --dport %s -j %s\n",
-			    ipt_exe, table, make_port(port), tbl_then);
+    table->nb_rules += nb;
+    if (ipt_is_jump(target) == TRUE)
+	table->nb_jumps += nb;
+}
+
+/*
+ * Output the rules jumping to a target if a condition does not match (see
+ * ipt_negatable()); for ports, the packets of other protocols jump first,
+ * then the non-first fragments, which no port match accepts even negated
+ */
+static void ipt_cond_negated(struct ipt_gen *const gen,
+			     struct shared *const table,
+			     const char *const target,
+			     const struct flat_cond *const cond)
+{
+    struct out_sink *const buf = &gen->rules;
+    const struct flat_port *first, *end;
+    const char *addr, *proto;
+    unsigned nb = 1;
+
+    if (table->changed == FALSE)
+	return;
+
+    ipt_out_append(buf, table->name, cond->src);
+    if (cond->type == COND_ADDR) {
+	addr = FLAT_ADDR(flat, cond, 0);
+	if (cond->dir == DIR_BOTH || cond->dir == DIR_SRC)
+	    out_strs(buf, " ! -s ", addr, NULL);
+	if (cond->dir == DIR_BOTH || cond->dir == DIR_DST)
+	    out_strs(buf, " ! -d ", addr, NULL);
+    } else {
+	first = FLAT_PORT(flat, cond, 0);
+	end = FLAT_PORT(flat, cond, cond->nb);
+	proto = cond->proto == PROTO_TCP ? "tcp" : "udp";
+	out_strs(buf, " ! -p ", proto, NULL);
+	ipt_out_target(buf, target);
+	ipt_out_append(buf, table->name, cond->src);
+	out_strs(buf, " -p ", proto, " -f", NULL);
+	ipt_out_target(buf, target);
+	nb++;
+
+	/* Both directions at once: none of them matches */
+	ipt_out_append(buf, table->name, cond->src);
+	out_strs(buf, " -p ", proto, NULL);
+	if (first + 1 != end) {
+	    out_strs(buf, " -m multiport ! --",
+		     cond->dir == DIR_SRC ? "sports "
+		     : cond->dir == DIR_DST ? "dports " : "ports ", NULL);
+	    ipt_out_list(buf, first, end);
+	} else {
+	    if (cond->dir == DIR_BOTH || cond->dir == DIR_SRC) {
+		out_str(buf, " ! --sport ");
+		ipt_out_list(buf, first, end);
 	    }
-	    if (cond->proto == PROTO_PORT || cond->proto == PROTO_UDP) {
-		if (cond->dir == DIR_BOTH || cond->dir == DIR_SRC)
-		    fprintf(out_file, "%s -A %s -p udp --sport %s -j %s\n",
-			    ipt_exe, table, make_port(port), tbl_then);
-		if (cond->dir == DIR_BOTH || cond->dir == DIR_DST)
-		    fprintf(out_file, "%s -A %s -p udp --dport %s -j %s\n",
-			    ipt_exe, table, make_port(port), tbl_then);
+	    if (cond->dir == DIR_BOTH || cond->dir == DIR_DST) {
+		out_str(buf, " ! --dport ");
+		ipt_out_list(buf, first, end);
 	    }
 	}
+	nb++;
+    }
+    ipt_out_target(buf, target);
+
+    table->nb_rules += nb;
+    if (ipt_is_jump(target) == TRUE)
+	table->nb_jumps += nb;
+}
+
+/*
+ * Output the rules matching some ports of a protocol in a direction; a
+ * multiport match checks both directions at once; return the number of
+ * output rules
+ */
+static unsigned ipt_cond_ports(struct out_sink *const buf,
+			       const char *const table,
+			       const char *const proto,
+			       const enum direction dir,
+			       const struct flat_port *const first,
+			       const struct flat_port *const end,
+			       const char *const target, const unsigned src)
+{
+    unsigned nb = 0;
+
+    if (dir == DIR_BOTH && first + 1 != end) {
+	ipt_out_ports(buf, table, proto, "port", first, end, target, src);
+	return 1;
+    }
+
+    if (dir == DIR_BOTH || dir == DIR_SRC) {
+	ipt_out_ports(buf, table, proto, "sport", first, end, target, src);
+	nb++;
+    }
+    if (dir == DIR_BOTH || dir == DIR_DST) {
+	ipt_out_ports(buf, table, proto, "dport", first, end, target, src);
+	nb++;
+    }
+    return nb;
+}
+
+/*
+ * Output the rules jumping to a target if a list matched through a set
+ * matches; return the number of output rules
+ */
+static unsigned ipt_cond_set(struct ipt_gen *const gen,
+			     const struct shared *const table,
+			     const char *const target,
+			     const struct flat_cond *const cond)
+{
+    static const char *const protos[2] = { "tcp", "udp" };
+    const char *set, *proto;
+    unsigned nb = 0, i;
+
+    if ((set = ipt_new_set(gen, table, cond)) == NULL) {
+	gen->rules.failed = TRUE;
+	return 0;
+    }
+
+    /* A single pass for addresses, TCP then UDP for ports */
+    for (i = 0; i < 2; i++) {
+	if (cond->type == COND_ADDR ? i != 0
+	    : cond->proto != PROTO_PORT
+	      && cond->proto != (i == 0 ? PROTO_TCP : PROTO_UDP))
+	    continue;
+	proto = cond->type == COND_ADDR ? NULL : protos[i];
+
+	if (cond->dir == DIR_BOTH || cond->dir == DIR_SRC) {
+	    ipt_out_set(&gen->rules, table->name, proto, set, "src", target,
+			cond->src);
+	    nb++;
+	}
+	if (cond->dir == DIR_BOTH || cond->dir == DIR_DST) {
+	    ipt_out_set(&gen->rules, table->name, proto, set, "dst", target,
+			cond->src);
+	    nb++;
+	}
     }
 
-    ipt_out_jump(table, tbl_else);
+    return nb;
 }
 
 /* End of File */
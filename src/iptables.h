@@ -41,8 +41,16 @@ extern "C" {
 /* System headers */
 #include <stdio.h> /* FILE * */
 
-/* IPTables-related functions */
-void ipt_config(const struct chain *config, const char *exe, FILE *out);
+/* Output formats */
+enum ipt_format {
+    IPT_SCRIPT, /* Shellscript calling the IPTables executable */
+    IPT_RESTORE /* Input file for iptables-restore             */
+};
+
+/* IPTables-related functions (the configuration being flattened) */
+enum bool ipt_config(const struct flat *config, const char *exe,
+		     enum ipt_format fmt, FILE *out);
+void ipt_sets(unsigned min, FILE *file);
 
 /* C++ protection */
 #ifdef __cplusplus
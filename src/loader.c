@@ -0,0 +1,746 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/loader.c
+ *
+ * Description: Parallel Configuration Loading
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* ./configure result */
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+/* System headers */
+#include <stdlib.h> /* NULL, malloc(), free(), qsort(), bsearch() */
+#include <stdio.h>  /* fprintf()                                            */
+#include <string.h> /* strlen(), strrchr(), strcmp(), strcpy()              */
+#if HAVE_PTHREAD_H
+#include <unistd.h>  /* sysconf()                              */
+#include <pthread.h> /* pthread_create(), pthread_cond_wait() */
+#endif /* HAVE_PTHREAD_H */
+
+/* Local headers */
+#include "structs.h"
+#include "memory.h"
+#include "hashtab.h"
+#include "symtab.h"
+#include "loader.h"
+#include "stats.h"
+
+
+/*****************************************************************************
+ *
+ * Local Datatypes and Variables
+ *
+ */
+
+/* Maximum number of parsing threads */
+#define MAX_THREADS 16
+
+/* Jobs waiting to be parsed (queue) */
+static struct job *queue = NULL, *queue_tail = NULL;
+
+/* Parsed jobs, kept until free_files() */
+static struct job *jobs = NULL;
+
+/* Number of queued or running jobs */
+static unsigned pending = 0;
+
+/* Names of the parsed files, by index (see number_files()) */
+static const char **sources = NULL;
+static unsigned nb_sources = 0;
+
+#if HAVE_PTHREAD_H
+/* Protection of the queue, signaled when a job is queued or all are done */
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+#endif /* HAVE_PTHREAD_H */
+
+/* Link state of a chain */
+struct state {
+    struct hsh_elem elem;                     /* Hash table element */
+    struct chain *chain;                      /* Chain              */
+    enum { ST_TODO, ST_BUSY, ST_DONE } state; /* Link progress      */
+};
+
+/* Link context: the chains being linked and the linked configuration */
+struct link {
+    struct hsh_table states;     /* Link states, by chain name     */
+    struct chain *config, *tail; /* Chains linked so far, in order */
+};
+
+
+/*****************************************************************************
+ *
+ * Local Functions
+ *
+ */
+
+/*
+ * Build a full filename relative to a reference
+ */
+static char *make_rel_name(const char *const ref, const char *const name)
+{
+    const char *file;
+    unsigned dirlen;
+    char *res;
+
+    /* If absolute or reference has no directory part, it remains the same */
+    if (name[0] == '/' || ref == NULL || (file = strrchr(ref, '/')) == NULL) {
+	if ((res = malloc(strlen(name) + 1)) != NULL)
+	    strcpy(res, name);
+	return res;
+    }
+
+    /* Get the directory length */
+    dirlen = (unsigned) ((unsigned long) file - (unsigned long) ref);
+
+    /* Make the filename */
+    if ((res = malloc(dirlen + strlen(name) + 2)) != NULL) {
+	memcpy(res, ref, dirlen);
+	res[dirlen] = '/';
+	strcpy(res + dirlen + 1, name);
+    }
+
+    return res;
+}
+
+/*
+ * Create a job and queue it
+ */
+static struct job *new_job(char *const name, struct job *const parent)
+{
+    struct job *job;
+
+    if ((job = malloc(sizeof(struct job))) == NULL) {
+	free(name);
+	return NULL;
+    }
+
+    job->next = NULL;
+    job->parent = parent;
+    job->includes = job->last = job->sibling = NULL;
+    job->position = parent != NULL ? parent->nb_chains : 0;
+    job->name = name;
+    job->config = job->tail = NULL;
+    job->nb_chains = 0;
+    job->failed = FALSE;
+    job->base = NULL;
+    job->size = 0;
+    job->tokens = 0;
+    job->file = 0;
+
+    /* Included files are linked in order to their parent */
+    if (parent != NULL) {
+	if (parent->last == NULL)
+	    parent->includes = job;
+	else
+	    parent->last->sibling = job;
+	parent->last = job;
+    }
+
+#if HAVE_PTHREAD_H
+    pthread_mutex_lock(&queue_mutex);
+#endif /* HAVE_PTHREAD_H */
+    if (queue_tail == NULL)
+	queue = job;
+    else
+	queue_tail->next = job;
+    queue_tail = job;
+    pending++;
+#if HAVE_PTHREAD_H
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_mutex);
+#endif /* HAVE_PTHREAD_H */
+
+    return job;
+}
+
+/*
+ * Release the parsed jobs down to a given one (excluded), with their input
+ * buffers
+ */
+static void free_jobs(const struct job *const done)
+{
+    struct job *next;
+
+    for (; jobs != done; jobs = next) {
+	next = jobs->next;
+	free_input(jobs);
+	free(jobs->name);
+	free(jobs);
+    }
+}
+
+/*
+ * Parse the queued jobs until there is none left, in each thread; the
+ * argument is NULL for the main thread, which keeps its memory arena
+ */
+static void *run_jobs(void *const arg)
+{
+    struct job *job;
+
+    if (arg != NULL && mem_thread_begin() == FALSE)
+	return NULL;
+
+    for (;;) {
+#if HAVE_PTHREAD_H
+	pthread_mutex_lock(&queue_mutex);
+	while (queue == NULL && pending != 0)
+	    pthread_cond_wait(&queue_cond, &queue_mutex);
+#endif /* HAVE_PTHREAD_H */
+	if ((job = queue) == NULL) {
+	    /* Everything is parsed */
+#if HAVE_PTHREAD_H
+	    pthread_mutex_unlock(&queue_mutex);
+#endif /* HAVE_PTHREAD_H */
+	    break;
+	}
+	if ((queue = job->next) == NULL)
+	    queue_tail = NULL;
+#if HAVE_PTHREAD_H
+	pthread_mutex_unlock(&queue_mutex);
+#endif /* HAVE_PTHREAD_H */
+
+	/* Parse the file, included ones being queued meanwhile */
+	job->failed = parse_job(job) == TRUE ? FALSE : TRUE;
+
+#if HAVE_PTHREAD_H
+	pthread_mutex_lock(&queue_mutex);
+#endif /* HAVE_PTHREAD_H */
+	job->next = jobs;
+	jobs = job;
+	if (--pending == 0) {
+#if HAVE_PTHREAD_H
+	    pthread_cond_broadcast(&queue_cond);
+#endif /* HAVE_PTHREAD_H */
+	}
+#if HAVE_PTHREAD_H
+	pthread_mutex_unlock(&queue_mutex);
+#endif /* HAVE_PTHREAD_H */
+    }
+
+    if (arg != NULL)
+	mem_thread_end();
+    return NULL;
+}
+
+/*
+ * Parse all the queued jobs, using as many threads as processors
+ */
+static void run_all(void)
+{
+#if HAVE_PTHREAD_H
+    pthread_t threads[MAX_THREADS];
+    unsigned nb_threads = 0, i;
+#ifdef _SC_NPROCESSORS_ONLN
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    /* The current thread is one of the workers */
+    while (cpus > 1 && nb_threads + 1 < (unsigned long) cpus
+	   && nb_threads < MAX_THREADS
+	   && pthread_create(&threads[nb_threads], NULL, run_jobs,
+			     threads) == 0)
+	nb_threads++;
+#endif /* _SC_NPROCESSORS_ONLN */
+#endif /* HAVE_PTHREAD_H */
+
+    run_jobs(NULL);
+
+#if HAVE_PTHREAD_H
+    for (i = 0; i < nb_threads; i++)
+	pthread_join(threads[i], NULL);
+#endif /* HAVE_PTHREAD_H */
+}
+
+/*
+ * Compare two file names, for qsort() and bsearch()
+ */
+static int cmp_name(const void *const a, const void *const b)
+{
+    return strcmp(*(const char *const *) a, *(const char *const *) b);
+}
+
+/*
+ * Give each parsed file its index, in the order of the compiled
+ * configuration cache: the given files in order, then the included ones,
+ * sorted by name and each one once
+ */
+static enum bool number_files(struct job *const top,
+			      const struct job *const done)
+{
+    struct job *job;
+    const char **found;
+    unsigned nb_tops = 0, nb = 0, i, j, k;
+
+    for (job = jobs; job != done; job = job->next)
+	nb++;
+    if ((sources = malloc(sizeof(char *) * (nb + 1))) == NULL)
+	return FALSE;
+
+    for (job = top; job != NULL; job = job->sibling) {
+	job->file = nb_tops;
+	sources[nb_tops++] = job->name != NULL ? job->name : "-";
+    }
+    for (nb = nb_tops, job = jobs; job != done; job = job->next)
+	if (job->parent != NULL)
+	    sources[nb++] = job->name;
+    qsort(sources + nb_tops, nb - nb_tops, sizeof(char *), cmp_name);
+
+    /* Drop the duplicates, and the given files included again */
+    for (i = j = nb_tops; i < nb; i++) {
+	if (j != nb_tops && strcmp(sources[i], sources[j - 1]) == 0)
+	    continue;
+	for (k = 0; k < nb_tops; k++)
+	    if (strcmp(sources[i], sources[k]) == 0)
+		break;
+	if (k == nb_tops)
+	    sources[j++] = sources[i];
+    }
+    nb_sources = j;
+
+    for (job = jobs; job != done; job = job->next)
+	if (job->parent != NULL) {
+	    found = bsearch(&job->name, sources + nb_tops,
+			    nb_sources - nb_tops, sizeof(char *), cmp_name);
+	    if (found != NULL)
+		job->file = (unsigned) (found - sources);
+	    else
+		for (job->file = 0; job->file < nb_tops; job->file++)
+		    if (strcmp(job->name, sources[job->file]) == 0)
+			break;
+	}
+
+    return TRUE;
+}
+
+/*
+ * Add the index of its file to the source IDs of an expression
+ */
+static void set_file_expr(struct expr *const expr, const unsigned file)
+{
+    expr->src = SRC_ID(file, expr->src);
+    if (expr->type == EXPR_COND)
+	expr->sub.cond->src = SRC_ID(file, expr->sub.cond->src);
+    else {
+	set_file_expr(expr->sub.expr.left, file);
+	set_file_expr(expr->sub.expr.right, file);
+    }
+}
+
+/*
+ * Add the index of its file to the source IDs of an action, following the
+ * "else" branches in a loop
+ */
+static void set_file_action(struct action *action, const unsigned file)
+{
+    struct test *test;
+
+    for (;; action = test->act_else) {
+	action->src = SRC_ID(file, action->src);
+	if (action->type != TARGET_TEST)
+	    return;
+
+	test = action->action.test;
+	test->src = SRC_ID(file, test->src);
+	set_file_expr(test->expr, file);
+	set_file_action(test->act_then, file);
+    }
+}
+
+/*
+ * Put the chains of a job in one list, each included file taking place
+ * where it was included; return the new tail of the list
+ */
+static struct chain **splice_job(struct job *const job, struct chain **tail)
+{
+    struct job *include = job->includes;
+    struct chain *chain, *next;
+    unsigned position = 0;
+
+    for (chain = job->config;; chain = next, position++) {
+	/* Included files before this chain */
+	for (; include != NULL && include->position == position;
+	     include = include->sibling)
+	    tail = splice_job(include, tail);
+
+	if (chain == NULL)
+	    break;
+	next = chain->next;
+	chain->next = NULL;
+	chain->src = SRC_ID(job->file, chain->src);
+	set_file_action(chain->action, job->file);
+	*tail = chain;
+	tail = &chain->next;
+    }
+
+    return tail;
+}
+
+/*
+ * Check if a link state is the one of a chain
+ */
+static enum bool is_state_of(const struct hsh_elem *const elem,
+			     const void *const chain)
+{
+    return ((const struct state *) elem)->chain == chain ? TRUE : FALSE;
+}
+
+/*
+ * Find the link state of a chain
+ */
+static struct state *find_state(const struct link *const link,
+				const struct chain *const chain)
+{
+    return (struct state *) hsh_find(&link->states,
+				     hash_string(HASH_SEED, chain->name),
+				     is_state_of, chain);
+}
+
+/* Link a chain (see below) */
+static enum bool link_chain(struct link *link, const struct chain *chain);
+
+/*
+ * Replace the chain references of an action by their definitions, linking
+ * the referenced chains first
+ */
+static enum bool link_action(struct link *const link,
+			     struct action *const action)
+{
+    const struct chain *chain;
+
+    if (action == NULL)
+	return TRUE;
+
+    switch (action->type) {
+    case TARGET_FINAL:
+	break;
+
+    case TARGET_USER:
+	/* Reference (chain without action) */
+	if (action->action.user->action == NULL) {
+	    if ((chain = sym_find(action->action.user->name)) == NULL) {
+		fprintf(stderr, "Error: undefined chain \"%s\".\n",
+			action->action.user->name);
+		return FALSE;
+	    }
+	    mem_free((void *) action->action.user);
+	    action->action.user = chain;
+	}
+	return link_chain(link, action->action.user);
+
+    case TARGET_TEST:
+	if (action->action.test == NULL)
+	    break;
+	return link_action(link, action->action.test->act_then) == TRUE
+	       && link_action(link, action->action.test->act_else) == TRUE
+	       ? TRUE : FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Link a chain (once), and add it to the configuration after the chains it
+ * refers to
+ */
+static enum bool link_chain(struct link *const link,
+			    const struct chain *const chain)
+{
+    struct state *const state = find_state(link, chain);
+
+    switch (state->state) {
+    case ST_DONE:
+	return TRUE;
+
+    case ST_BUSY:
+	fprintf(stderr, "Error: chain \"%s\" jumps to itself.\n",
+		chain->name);
+	return FALSE;
+
+    case ST_TODO:
+	break;
+    }
+
+    state->state = ST_BUSY;
+    if (link_action(link, state->chain->action) == FALSE)
+	return FALSE;
+    state->state = ST_DONE;
+
+    if (link->tail == NULL)
+	link->config = state->chain;
+    else
+	link->tail->next = state->chain;
+    link->tail = state->chain;
+    return TRUE;
+}
+
+/*
+ * Link the parsed chains together: each name is bound to its definition
+ * and the chains are ordered so that a chain comes after the ones it jumps
+ * to, as the original order when there are only backward references; the
+ * symbols only serve this link, so that each configuration stands alone
+ */
+static struct chain *link_config(struct chain *const list)
+{
+    struct link link = { { NULL, 0, 0 }, NULL, NULL };
+    struct chain *chain, **order;
+    struct state *states;
+    unsigned long nb_chains = 0, i;
+    enum bool res = TRUE;
+
+    if (list == NULL) {
+	fputs("Error: no chain defined.\n", stderr);
+	return NULL;
+    }
+
+    /* Register the chains */
+    for (chain = list; chain != NULL; chain = chain->next, nb_chains++) {
+	if (sym_find(chain->name) != NULL) {
+	    fprintf(stderr, "Error: chain \"%s\" defined twice.\n",
+		    chain->name);
+	    sym_free();
+	    return NULL;
+	}
+	if (sym_add(chain) == FALSE) {
+	    sym_free();
+	    return NULL;
+	}
+    }
+
+    /* Create the link states, and keep the original order since the list
+     * is rebuilt */
+    states = malloc(sizeof(struct state) * nb_chains);
+    order = malloc(sizeof(struct chain *) * nb_chains);
+    if (states == NULL || order == NULL) {
+	free(states);
+	free(order);
+	sym_free();
+	return NULL;
+    }
+    for (chain = list, i = 0; chain != NULL; chain = chain->next, i++) {
+	states[i].chain = chain;
+	states[i].state = ST_TODO;
+	if (hsh_add(&link.states, &states[i].elem,
+		    hash_string(HASH_SEED, chain->name)) == FALSE)
+	    res = FALSE;
+	order[i] = chain;
+    }
+
+    /* Link them in order */
+    for (i = 0; i < nb_chains; i++)
+	order[i]->next = NULL;
+    for (i = 0; i < nb_chains && res == TRUE; i++)
+	res = link_chain(&link, order[i]);
+
+    hsh_free(&link.states, FALSE);
+    sym_free();
+    free(order);
+    free(states);
+    return res == TRUE ? link.config : NULL;
+}
+
+
+/*****************************************************************************
+ *
+ * Global Functions
+ *
+ */
+
+/*
+ * Queue a file included by the file of a job, the name being relative to
+ * the latter
+ */
+enum bool load_include(struct job *const job, const char *const name)
+{
+    struct job *ancestor;
+    char *full;
+
+    if ((full = make_rel_name(job->name, name)) == NULL)
+	return FALSE;
+
+    /* Check for recursive inclusion */
+    for (ancestor = job; ancestor != NULL; ancestor = ancestor->parent)
+	if (ancestor->name != NULL && strcmp(ancestor->name, full) == 0) {
+	    fprintf(stderr, "Error: file \"%s\" includes itself.\n", full);
+	    free(full);
+	    return FALSE;
+	}
+
+    return new_job(full, job) != NULL ? TRUE : FALSE;
+}
+
+/*
+ * Parse several configuration files ("-" for standard input) in parallel,
+ * along with the files they include, and link them together; on failure,
+ * only what this call allocated is released, the configurations parsed
+ * before remaining valid
+ */
+struct chain *parse_files(const char *const *const names, const unsigned nb)
+{
+    struct job *const done = jobs, *top = NULL, *last = NULL, *job;
+    struct mem_arena *const mark = mem_mark();
+    const char **const old_sources = sources;
+    const unsigned old_nb_sources = nb_sources;
+    struct chain *list = NULL, **tail = &list, *res;
+    enum bool failed = FALSE;
+    char *name;
+    unsigned i;
+
+    /* The main thread parses in its own arena too, so that the nodes of
+     * this configuration can be released alone */
+    if (mem_thread_begin() == FALSE) {
+	mem_thread_end();
+	mem_free_since(mark);
+	return NULL;
+    }
+
+    /* Queue the given files */
+    for (i = 0; i < nb && failed == FALSE; i++) {
+	if (names[i][0] == '-' && names[i][1] == '\0')
+	    name = NULL;
+	else if ((name = make_rel_name(NULL, names[i])) == NULL) {
+	    failed = TRUE;
+	    break;
+	}
+	if ((job = new_job(name, NULL)) == NULL) {
+	    failed = TRUE;
+	    break;
+	}
+	if (last == NULL)
+	    top = job;
+	else
+	    last->sibling = job;
+	last = job;
+    }
+
+    /* Parse them, included ones too */
+    sta_begin(STA_PARSE);
+    run_all();
+    sta_end(STA_PARSE);
+    for (job = jobs; job != done; job = job->next) {
+	if (job->failed == TRUE)
+	    failed = TRUE;
+	sta_add(STA_FILES, 1);
+	sta_add(STA_BYTES, job->size);
+	sta_add(STA_TOKENS, job->tokens);
+    }
+
+    /* Link all the chains together */
+    if (failed == FALSE && number_files(top, done) == TRUE) {
+	sta_begin(STA_LINK);
+	for (job = top; job != NULL; job = job->sibling)
+	    tail = splice_job(job, tail);
+	res = link_config(list);
+	sta_end(STA_LINK);
+	if (res != NULL) {
+	    mem_thread_end();
+	    free(old_sources);
+	    return res;
+	}
+    }
+
+    mem_thread_end();
+    if (sources != old_sources)
+	free(sources);
+    sources = old_sources;
+    nb_sources = old_nb_sources;
+    free_jobs(done);
+    mem_free_since(mark);
+    return NULL;
+}
+
+/*
+ * Parse a single configuration file, or standard input if filename is "-"
+ */
+struct chain *parse_config(const char *const filename)
+{
+    return parse_files(&filename, 1);
+}
+
+/*
+ * Call a function with the name of each parsed file, standard input
+ * excepted, until it returns FALSE
+ */
+enum bool list_files(enum bool (*const func)(const char *name, void *data),
+		     void *const data)
+{
+    const struct job *job;
+
+    for (job = jobs; job != NULL; job = job->next)
+	if (job->name != NULL && func(job->name, data) == FALSE)
+	    return FALSE;
+    return TRUE;
+}
+
+/*
+ * Give the name of a parsed file from its index in the source IDs, NULL if
+ * there is no such file
+ */
+const char *get_source(const unsigned file)
+{
+    return file < nb_sources ? sources[file] : NULL;
+}
+
+/*
+ * Set the names of the parsed files, when the configuration isn't parsed
+ * but loaded from the compiled cache; the names are not copied
+ */
+enum bool set_sources(const char *const *const names, const unsigned nb)
+{
+    unsigned i;
+
+    free(sources);
+    nb_sources = 0;
+    if ((sources = malloc(sizeof(char *) * (nb + 1))) == NULL)
+	return FALSE;
+
+    for (i = 0; i < nb; i++)
+	sources[i] = names[i];
+    nb_sources = nb;
+    return TRUE;
+}
+
+/*
+ * Release all the input buffers, once the parsed strings aren't used anymore
+ */
+void free_files(void)
+{
+    free(sources);
+    sources = NULL;
+    nb_sources = 0;
+
+    free_jobs(NULL);
+}
+
+/* End of File */
@@ -0,0 +1,83 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/loader.h
+ *
+ * Description: Configuration Loader Header
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/* Process only once */
+#ifndef LOADER_H
+#define LOADER_H
+
+/* C++ protection */
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* System headers */
+#include <stddef.h> /* size_t */
+
+/* Parsing job: one file, parsed on its own (possibly in its own thread),
+ * included files being other jobs */
+struct job {
+    struct job *next;              /* Next job (queue, then all jobs)     */
+    struct job *parent;            /* Including job, NULL for a top one   */
+    struct job *includes, *last;   /* Included files, in order            */
+    struct job *sibling;           /* Next file included by the parent    */
+    unsigned position;             /* Parent chains before the include    */
+    char *name;                    /* File name, NULL for standard input  */
+    struct chain *config, *tail;   /* Parsed chains (linked list)         */
+    unsigned nb_chains;            /* Number of parsed chains             */
+    enum bool failed;              /* Wether parsing failed               */
+    char *base;                    /* Input buffer, see lexer.l           */
+    size_t size;                   /* Size of the input                   */
+    enum bool mapped;              /* Wether the input is mapped          */
+    unsigned long tokens;          /* Number of scanned tokens            */
+    unsigned file;                 /* Index in the source IDs             */
+};
+
+/* Defined in loader.c, for the lexer */
+enum bool load_include(struct job *job, const char *name);
+
+/* Defined in parser.y */
+enum bool parse_job(struct job *job);
+
+/* Defined in lexer.l */
+enum bool begin_file(struct job *job, void **scanner);
+void end_file(void *scanner);
+unsigned get_line(void *scanner);
+const char *get_text(void *scanner);
+void free_input(struct job *job);
+
+/* C++ protection */
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !LOADER_H */
+
+/* End of File */
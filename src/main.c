@@ -36,7 +36,7 @@
  */
 
 /* System headers */
-#include <stdlib.h> /* NULL, malloc(), free()               */
+#include <stdlib.h> /* NULL, malloc(), free(), strtoul()     */
 #include <stdio.h>  /* puts(), fputs(), printf(), fprintf() */
 #include <string.h> /* strcmp()                             */
 
@@ -47,8 +47,19 @@
 
 /* Local headers */
 #include "structs.h"
+#include "flat.h"
 #include "iptables.h"
+#include "nftables.h"
+#include "optimize.h"
+#include "profile.h"
+#include "attrib.h"
+#include "manifest.h"
 #include "memory.h"
+#include "symtab.h"
+#include "services.h"
+#include "resolve.h"
+#include "astcache.h"
+#include "stats.h"
 
 
 /*****************************************************************************
@@ -70,29 +81,74 @@ static void usage(const char *exe);
  */
 static void usage(const char *const exe)
 {
-    /* Cut in two, because ISO C compilers are required to accept strings of
-     * only 509 bytes at least */
+    /* Cut in pieces, because ISO C compilers are required to accept strings
+     * of only 509 bytes at least */
     printf("Syntax: %s [options...] [files...]\n"
 	   "\n"
-	   "Available options:\n"
-	   "    -c/--color:         use colors for the dump\n"
-	   "    -d/--dump:          dump the configuration structures\n"
-	   "    -e/--exe:           IPTables executable name (\"iptables\" by"
-		   " default)\n"
-	   "    -h/--help:          display this help message\n"
-	   "    -i/--iptables:      generate an IPTables shellscript\n"
-	   "    -n/--no-color:      don't use colors for the dump\n"
-	   "    -o/--output <file>: output filename\n"
-	   "    -v/--version:       display the program version\n"
-	   "\n", exe);
-    puts("You can specify any number of files in the command line, Use "
-		 "\"-\" for the\n"
-	 "standard input as long as chain names are all different.  If no "
-		 "filename is\n"
-	 "given, the standard input is read.\n"
-	 "\n"
-	 "If an option is given more than once, the last one takes "
-		 "precedence.\n"
+	   "Available options:\n", exe);
+    fputs("    -a/--resolve:       replace the host names by their addresses\n"
+	  "    --attribute <file>: report the counters of this \"iptables-save"
+		  " -c\" output\n"
+	  "                        by source line, for rules generated with"
+		  " --comments\n"
+	  "    -c/--color:         use colors for the dump\n", stdout);
+    fputs("    --comments:         tag the IPTables rules with their source"
+		  " lines\n"
+	  "    -d/--dump:          dump the configuration structures\n"
+	  "    -e/--exe:           IPTables executable name (\"iptables\" by"
+		  " default)\n"
+	  "    -h/--help:          display this help message\n"
+	  "    --hosts <file>:     resolve the host names with this hosts file"
+		  " only\n"
+	  "    -i/--iptables:      generate an IPTables shellscript\n",
+	  stdout);
+    fputs("    --ipset <size>:     match the lists of at least this size"
+		  " through IPSets\n"
+	  "    --ipset-file <file>: define the sets in this file (for \"ipset"
+		  " restore\n"
+	  "                        -exist\"), rather than in the script\n",
+	  stdout);
+    fputs("    -k/--compiled:      keep the parsed configuration in a binary"
+		  " cache, and\n"
+	  "                        use it while no file changes\n"
+	  "    -m/--manifest <file>: write the manifest of the generated"
+		  " chains\n"
+	  "    -n/--no-color:      don't use colors for the dump\n"
+	  "    -o/--output <file>: output filename\n"
+	  "    -p/--previous <file>: only output the chains changed since this"
+		  " manifest\n", stdout);
+    fputs("    --profile <file>:   reorder the tests by the packet counters"
+		  " of this\n"
+	  "                        \"iptables-save -c\" output (implies"
+		  " --reorder)\n"
+	  "    --reorder:          put the most likely deciding tests first\n"
+	  "    --resolve-cache <file>: keep the resolved host names in this"
+		  " file\n"
+	  "    -r/--restore:       generate an iptables-restore input file\n"
+	  "    -s/--services <file>: read the port names from this file"
+		  " (/etc/services\n"
+	  "                        by default)\n", stdout);
+    fputs("    --stats:            write timings and counters to the error"
+		  " output\n"
+	  "    --stats-json:       same, as a JSON object\n"
+	  "    -t/--nftables:      generate an NFTables script (nft -f), the "
+	  "input, forward\n"
+	  "                        and output chains being hooked\n"
+	  "    -v/--version:       display the program version\n"
+	  "\n", stdout);
+    fputs("You can specify any number of files in the command line, Use "
+		  "\"-\" for the\n"
+	  "standard input as long as chain names are all different.  If no "
+		  "filename is\n"
+	  "given, the standard input is read.\n"
+	  "\n"
+	  "If an option is given more than once, the last one takes "
+		  "precedence.\n"
+	  "\n", stdout);
+    puts("Manifests record the content hash of each IPTables chain, so that "
+		 "the next run\n"
+	 "with -p/--previous only creates, refills or deletes the chains that "
+		 "changed.\n"
 	 "\n"
 	 "Note about colors: by default, colors are used if the IPTables "
 		 "script isn't\n"
@@ -109,9 +165,6 @@ static void usage(const char *const exe)
  *
  */
 
-/* Defined in parser.y */
-extern struct chain *parse_config(const char *const filename);
-
 /*
  * Main function
  */
@@ -121,20 +174,32 @@ int main(const int argc, const char *const *const argv)
     const char **const files
 	    = malloc(sizeof(char *) * (argc > 1 ? argc - 1 : 1));
     unsigned nb_files = 0;
-    const char *out_file = NULL;
-    FILE *output;
-    struct chain *config, *last;
+    const char *out_file = NULL, *manifest_file = NULL, *previous_file = NULL;
+    const char *services_file = NULL, *hosts_file = NULL, *cache_file = NULL;
+    const char *ipset_min = NULL, *ipset_file = NULL, *profile_file = NULL;
+    const char *attribute_file = NULL;
+    const char **arg = NULL;
+    FILE *output, *manifest, *services, *hosts, *cache, *ipset = NULL;
+    FILE *profile, *counters;
+    struct chain *config = NULL;
+    struct flat *flat;
     const char *exe = "iptables";
+    enum ipt_format format = IPT_SCRIPT;
 
     /* Command line options */
     enum {
 	COLORS_DEFAULT, COLORS_FALSE, COLORS_TRUE
     } use_colors = COLORS_DEFAULT;
-    enum bool do_dump = FALSE, do_iptables = FALSE, do_usage = FALSE;
-    enum bool do_version = FALSE, do_output = FALSE, do_exe = FALSE;
+    enum bool do_dump = FALSE, do_iptables = FALSE, do_nftables = FALSE;
+    enum bool do_resolve = FALSE, do_usage = FALSE, use_cache = FALSE;
+    enum bool do_version = FALSE, do_stats = FALSE, stats_json = FALSE;
+    enum bool do_reorder = FALSE, do_comments = FALSE, written = TRUE;
 
     /* Counters */
-    unsigned i, j;
+    unsigned long min = 0;
+    unsigned i, j, leaked = 0;
+    char *end;
+    int error;
 
     if (files == NULL) {
 	fputs("Not enough memory! Aborting.\n", stderr);
@@ -143,28 +208,64 @@ int main(const int argc, const char *const *const argv)
 
     /* Parse options */
     for (i = 1; i < (unsigned) argc; i++) {
-	if (do_output == TRUE) {
-	    do_output = FALSE;
-	    out_file = argv[i];
-	} else if (do_exe == TRUE) {
-	    do_exe = FALSE;
-	    exe = argv[i];
+	if (arg != NULL) {
+	    *arg = argv[i];
+	    arg = NULL;
 	} else if (argv[i][0] == '-') {
 	    if (argv[i][1] == '-') {
-		if (strcmp(argv[i] + 2, "color") == 0)
+		if (strcmp(argv[i] + 2, "resolve") == 0)
+		    do_resolve = TRUE;
+		else if (strcmp(argv[i] + 2, "resolve-cache") == 0)
+		    arg = &cache_file;
+		else if (strcmp(argv[i] + 2, "attribute") == 0)
+		    arg = &attribute_file;
+		else if (strcmp(argv[i] + 2, "color") == 0)
 		    use_colors = COLORS_TRUE;
+		else if (strcmp(argv[i] + 2, "comments") == 0)
+		    do_comments = TRUE;
+		else if (strcmp(argv[i] + 2, "compiled") == 0)
+		    use_cache = TRUE;
 		else if (strcmp(argv[i] + 2, "dump") == 0)
 		    do_dump = COLORS_TRUE;
 		else if (strcmp(argv[i] + 2, "exe") == 0)
-		    do_exe = TRUE;
+		    arg = &exe;
 		else if (strcmp(argv[i] + 2, "help") == 0)
 		    do_usage = TRUE;
-		else if (strcmp(argv[i] + 2, "iptables") == 0)
+		else if (strcmp(argv[i] + 2, "hosts") == 0)
+		    arg = &hosts_file;
+		else if (strcmp(argv[i] + 2, "ipset") == 0)
+		    arg = &ipset_min;
+		else if (strcmp(argv[i] + 2, "ipset-file") == 0)
+		    arg = &ipset_file;
+		else if (strcmp(argv[i] + 2, "iptables") == 0) {
+		    do_iptables = TRUE;
+		    do_nftables = FALSE;
+		    format = IPT_SCRIPT;
+		} else if (strcmp(argv[i] + 2, "manifest") == 0)
+		    arg = &manifest_file;
+		else if (strcmp(argv[i] + 2, "nftables") == 0) {
+		    do_nftables = TRUE;
+		    do_iptables = FALSE;
+		} else if (strcmp(argv[i] + 2, "restore") == 0) {
 		    do_iptables = TRUE;
-		else if (strcmp(argv[i] + 2, "no-color") == 0)
+		    do_nftables = FALSE;
+		    format = IPT_RESTORE;
+		} else if (strcmp(argv[i] + 2, "no-color") == 0)
 		    use_colors = COLORS_FALSE;
 		else if (strcmp(argv[i] + 2, "output") == 0)
-		    do_output = TRUE;
+		    arg = &out_file;
+		else if (strcmp(argv[i] + 2, "previous") == 0)
+		    arg = &previous_file;
+		else if (strcmp(argv[i] + 2, "profile") == 0)
+		    arg = &profile_file;
+		else if (strcmp(argv[i] + 2, "reorder") == 0)
+		    do_reorder = TRUE;
+		else if (strcmp(argv[i] + 2, "stats") == 0)
+		    do_stats = TRUE;
+		else if (strcmp(argv[i] + 2, "stats-json") == 0)
+		    do_stats = stats_json = TRUE;
+		else if (strcmp(argv[i] + 2, "services") == 0)
+		    arg = &services_file;
 		else if (strcmp(argv[i] + 2, "version") == 0)
 		    do_version = TRUE;
 		else {
@@ -176,6 +277,10 @@ int main(const int argc, const char *const *const argv)
 	    } else {
 		for (j = 1; argv[i][j] != '\0'; j++)
 		    switch (argv[i][j]) {
+		    case 'a':
+			do_resolve = TRUE;
+			break;
+
 		    case 'c':
 			use_colors = COLORS_TRUE;
 			break;
@@ -185,12 +290,21 @@ int main(const int argc, const char *const *const argv)
 			break;
 
 		    case 'e':
-			if (do_output == TRUE) {
-			    fputs("Error: cannot use \"-e\" and \"-o\" at the"
+		    case 'm':
+		    case 'o':
+		    case 'p':
+		    case 's':
+			if (arg != NULL) {
+			    fputs("Error: only one of \"-e\", \"-m\", \"-o\","
+				  " \"-p\" and \"-s\" can be used at the"
 				  " same time.\n", stderr);
 			    return 2;
 			}
-			do_exe = TRUE;
+			arg = argv[i][j] == 'e' ? &exe
+			      : argv[i][j] == 'm' ? &manifest_file
+			      : argv[i][j] == 'o' ? &out_file
+			      : argv[i][j] == 'p' ? &previous_file
+			      : &services_file;
 			break;
 
 		    case 'h':
@@ -199,19 +313,27 @@ int main(const int argc, const char *const *const argv)
 
 		    case 'i':
 			do_iptables = TRUE;
+			do_nftables = FALSE;
+			format = IPT_SCRIPT;
+			break;
+
+		    case 'k':
+			use_cache = TRUE;
 			break;
 
 		    case 'n':
 			use_colors = COLORS_FALSE;
 			break;
 
-		    case 'o':
-			if (do_exe == TRUE) {
-			    fputs("Error: cannot use \"-e\" and \"-o\" at the"
-				  " same time.\n", stderr);
-			    return 2;
-			}
-			do_output = TRUE;
+		    case 'r':
+			do_iptables = TRUE;
+			do_nftables = FALSE;
+			format = IPT_RESTORE;
+			break;
+
+		    case 't':
+			do_nftables = TRUE;
+			do_iptables = FALSE;
 			break;
 
 		    case 'v':
@@ -244,19 +366,146 @@ int main(const int argc, const char *const *const argv)
     }
 
     /* Check is at least one action has been given */
-    if (do_dump == FALSE && do_iptables == FALSE) {
+    if (do_dump == FALSE && do_iptables == FALSE && do_nftables == FALSE
+	&& attribute_file == NULL) {
 	fputs("Error: no action selected.  Use -d/--dump and/or "
-	      "-i/--iptables, or -h/--help\nfor a full list of options.\n",
+	      "-i/--iptables, -r/--restore\nor -t/--nftables, or -h/--help "
+	      "for a full list of options.\n", stderr);
+	return 2;
+    }
+    if (attribute_file != NULL
+	&& (do_dump == TRUE || do_iptables == TRUE || do_nftables == TRUE)) {
+	fputs("Error: --attribute can't be used with another action.\n",
 	      stderr);
 	return 2;
     }
 
-    /* Check for output file */
-    if (do_output == TRUE) {
-	fputs("Error: -o/--output option used, but no file specified.\n",
-	      stderr);
+    /* Check for option arguments */
+    if (arg != NULL) {
+	fprintf(stderr, "Error: \"%s\" option used, but no argument "
+		"specified.\n", argv[argc - 1]);
 	return 2;
     }
+
+    /* Check the IPSet options */
+    if (ipset_min != NULL) {
+	min = strtoul(ipset_min, &end, 10);
+	if (*ipset_min == '\0' || *end != '\0' || min == 0
+	    || (unsigned) min != min) {
+	    fprintf(stderr, "Error: invalid set size \"%s\".\n", ipset_min);
+	    return 2;
+	}
+    }
+    if (ipset_file != NULL && min == 0) {
+	fputs("Error: --ipset-file used without --ipset.\n", stderr);
+	return 2;
+    }
+    if (min != 0 && do_nftables == TRUE) {
+	fputs("Error: IPSets can't be used with -t/--nftables, which matches "
+	      "lists through\nits own sets.\n", stderr);
+	return 2;
+    }
+    if ((manifest_file != NULL || previous_file != NULL)
+	&& do_nftables == TRUE) {
+	fputs("Error: -m/--manifest and -p/--previous can't be used with "
+	      "-t/--nftables,\nwhich always outputs the whole "
+	      "configuration.\n", stderr);
+	return 2;
+    }
+    if (min != 0 && format == IPT_RESTORE && ipset_file == NULL) {
+	fputs("Error: an iptables-restore input file can't define sets, use "
+	      "--ipset-file.\n", stderr);
+	return 2;
+    }
+
+    /* Read the previous manifest */
+    if (previous_file != NULL) {
+	if ((manifest = fopen(previous_file, "r")) == NULL) {
+	    fprintf(stderr, "Error: cannot read file \"%s\": ",
+		    previous_file);
+	    perror(NULL);
+	    return 3;
+	}
+	if (man_read(manifest) == FALSE) {
+	    fprintf(stderr, "Error: invalid manifest \"%s\".\n",
+		    previous_file);
+	    return 3;
+	}
+	fclose(manifest);
+    }
+
+    /* Read the packet counters of the deployed rules */
+    if (profile_file != NULL) {
+	if ((profile = fopen(profile_file, "r")) == NULL) {
+	    fprintf(stderr, "Error: cannot read file \"%s\": ",
+		    profile_file);
+	    perror(NULL);
+	    return 3;
+	}
+	if (prf_read(profile) == FALSE) {
+	    fputs("Error: not enough memory to read the profile.\n", stderr);
+	    return 3;
+	}
+	fclose(profile);
+	do_reorder = TRUE;
+    }
+
+    /* Read the counters to attribute to the source lines */
+    if (attribute_file != NULL) {
+	if ((counters = fopen(attribute_file, "r")) == NULL) {
+	    fprintf(stderr, "Error: cannot read file \"%s\": ",
+		    attribute_file);
+	    perror(NULL);
+	    return 3;
+	}
+	if (atr_read(counters) == FALSE) {
+	    fputs("Error: not enough memory to read the counters.\n",
+		  stderr);
+	    return 3;
+	}
+	fclose(counters);
+    }
+
+    /* Read the service names, instead of the default ones */
+    if (services_file != NULL) {
+	if ((services = fopen(services_file, "r")) == NULL) {
+	    fprintf(stderr, "Error: cannot read file \"%s\": ",
+		    services_file);
+	    perror(NULL);
+	    return 3;
+	}
+	if (srv_read(services) == FALSE) {
+	    fputs("Error: not enough memory to read the service names.\n",
+		  stderr);
+	    return 3;
+	}
+	fclose(services);
+    }
+
+    /* Read the hosts file and the resolver cache */
+    if (hosts_file != NULL) {
+	if ((hosts = fopen(hosts_file, "r")) == NULL) {
+	    fprintf(stderr, "Error: cannot read file \"%s\": ", hosts_file);
+	    perror(NULL);
+	    return 3;
+	}
+	if (res_hosts(hosts) == FALSE) {
+	    fputs("Error: not enough memory to read the hosts file.\n",
+		  stderr);
+	    return 3;
+	}
+	fclose(hosts);
+    }
+    if (cache_file != NULL && (cache = fopen(cache_file, "r")) != NULL) {
+	if (res_read(cache) == FALSE) {
+	    fprintf(stderr, "Error: invalid resolver cache \"%s\".\n",
+		    cache_file);
+	    return 3;
+	}
+	fclose(cache);
+    }
+
+    /* Check for output file */
     if (out_file == NULL || (out_file[0] == '-' && out_file[1] == '\0'))
 	output = stdout;
     else if ((output = fopen(out_file, "w")) == NULL) {
@@ -265,9 +514,17 @@ int main(const int argc, const char *const *const argv)
 	return 3;
     }
 
+    /* Check for the sets file */
+    if (ipset_file != NULL && do_iptables == TRUE
+	&& (ipset = fopen(ipset_file, "w")) == NULL) {
+	fprintf(stderr, "Error: cannot write to file \"%s\": ", ipset_file);
+	perror(NULL);
+	return 3;
+    }
+
     /* Enable colors if desired */
     if (use_colors == COLORS_DEFAULT)
-	use_colors = do_iptables ? COLORS_FALSE : COLORS_TRUE;
+	use_colors = do_iptables || do_nftables ? COLORS_FALSE : COLORS_TRUE;
 
     /* Parse files */
     if (nb_files == 0) {
@@ -275,50 +532,174 @@ int main(const int argc, const char *const *const argv)
 	files[0] = "-";
 	nb_files = 1;
     }
-    if ((last = config = parse_config(files[0])) == NULL)
-	return 4;
-    for (i = 1; i < nb_files; i++) {
-	/* Look for the last chain */
-	while (last->next != NULL)
-	    last = last->next;
-
-	/* Append the new read chains to the list */
-	if ((last->next = parse_config(files[i])) == NULL)
+    if (use_cache == TRUE) {
+	sta_begin(STA_CACHE);
+	config = ast_load(files, nb_files);
+	sta_end(STA_CACHE);
+    }
+    if (config == NULL) {
+	if ((config = parse_files(files, nb_files)) == NULL)
 	    return 4;
+	sta_begin(STA_CACHE);
+	if (use_cache == TRUE && ast_save(config, files, nb_files) == FALSE)
+	    fprintf(stderr, "Warning: cannot write the cache \"%s%s\".\n",
+		    files[0], AST_SUFFIX);
+	sta_end(STA_CACHE);
+    }
+    if (do_stats == TRUE) {
+	sta_config(config);
+	sta_add(STA_AREAS, mem_get_count());
+	sta_add(STA_ARENA, mem_get_size());
     }
 
     /* Free some memory */
     free(files);
 
-    /* Header, for IPTables script */
-    if (do_iptables == TRUE) {
-	fputs("#!/bin/sh\n\n"
-	      "# This script has been generated by RuleWall.\n\n", output);
+    /* Header, for IPTables script, iptables-restore or NFTables file */
+    if (do_iptables == TRUE || do_nftables == TRUE) {
+	if (do_nftables == TRUE)
+	    fputs("#!/usr/sbin/nft -f\n\n"
+		  "# This script has been generated by RuleWall.\n\n",
+		  output);
+	else if (format == IPT_SCRIPT)
+	    fputs("#!/bin/sh\n\n"
+		  "# This script has been generated by RuleWall.\n\n",
+		  output);
+	else
+	    fputs("# This file has been generated by RuleWall.\n"
+		  "# Load it with: iptables-restore --noflush <file>\n\n",
+		  output);
 	if (do_dump == TRUE) {
 	    fputs("# Here is a dump of the full configuration:\n#\n", output);
 	}
     }
 
     /* Dump */
-    if (do_dump == TRUE)
-	dump_config(config, output, do_iptables == TRUE ? "# " : NULL,
-		    !do_iptables, use_colors == COLORS_TRUE ? TRUE : FALSE);
+    if (do_dump == TRUE) {
+	sta_begin(STA_DUMP);
+	if ((flat = flat_config(config, FALSE)) == NULL) {
+	    fputs("Not enough memory! Aborting.\n", stderr);
+	    return 10;
+	}
+	if (dump_config(flat, output,
+			do_iptables || do_nftables ? "# " : NULL,
+			!do_iptables && !do_nftables,
+			use_colors == COLORS_TRUE ? TRUE : FALSE) == FALSE) {
+	    fputs("Error: cannot write the dump.\n", stderr);
+	    written = FALSE;
+	}
+	flat_free(flat);
+	sta_end(STA_DUMP);
+    }
 
-    /* Create IPTables script */
-    if (do_iptables == TRUE)
-	ipt_config(config, exe, output);
+    /* Report the counters by source line, the files being parsed */
+    if (attribute_file != NULL)
+	atr_report(output);
+
+    /* Resolve the host names, so that the rules load fast */
+    if (do_resolve == TRUE && (do_iptables == TRUE || do_nftables == TRUE)) {
+	sta_begin(STA_RESOLVE);
+	if (res_config(config) == FALSE)
+	    return 5;
+	sta_end(STA_RESOLVE);
+	if (cache_file != NULL) {
+	    if ((cache = fopen(cache_file, "w")) == NULL) {
+		fprintf(stderr, "Error: cannot write to file \"%s\": ",
+			cache_file);
+		perror(NULL);
+		return 3;
+	    }
+	    res_write(cache);
+	    fclose(cache);
+	}
+    }
+
+    /* Simplify the expressions before generating rules */
+    if (do_iptables == TRUE || do_nftables == TRUE) {
+	sta_begin(STA_OPTIMIZE);
+	opt_config(config);
+	if (do_reorder == TRUE)
+	    prf_config(config);
+	sta_end(STA_OPTIMIZE);
+    }
+
+    /* Create IPTables or NFTables script; the IPTables rules are generated
+     * from the flat configuration, the linked one being released first with
+     * everything it points into: arena, input buffers and cache (the areas
+     * it leaks being counted before) */
+    sta_begin(STA_GENERATE);
+    if (do_iptables == TRUE) {
+	if ((flat = flat_config(config, do_comments)) == NULL) {
+	    fputs("Not enough memory! Aborting.\n", stderr);
+	    return 10;
+	}
+	free_chain(config);
+	config = NULL;
+	leaked = mem_get_count();
+	free_files();
+	ast_free();
+	mem_free_all();
+	ipt_sets((unsigned) min, ipset);
+	if (ipt_config(flat, exe, format, output) == FALSE)
+	    written = FALSE;
+	flat_free(flat);
+	if (ipset != NULL && fclose(ipset) != 0 && written == TRUE) {
+	    fputs("Error: cannot write the sets.\n", stderr);
+	    written = FALSE;
+	}
+    } else if (do_nftables == TRUE && nft_config(config, output) == FALSE)
+	written = FALSE;
+    sta_end(STA_GENERATE);
+
+    /* Everything has to be written before the manifest tells the chains
+     * are up to date */
+    error = ferror(output);
+    if ((fclose(output) != 0 || error != 0) && written == TRUE) {
+	fputs("Error: cannot write the output.\n", stderr);
+	written = FALSE;
+    }
+
+    /* Write the manifest of the generated chains */
+    if (manifest_file != NULL && do_iptables == TRUE && written == TRUE) {
+	if ((manifest = fopen(manifest_file, "w")) == NULL) {
+	    fprintf(stderr, "Error: cannot write to file \"%s\": ",
+		    manifest_file);
+	    perror(NULL);
+	    return 3;
+	}
+	man_write(manifest);
+	error = ferror(manifest);
+	if (fclose(manifest) != 0 || error != 0) {
+	    fprintf(stderr, "Error: cannot write to file \"%s\".\n",
+		    manifest_file);
+	    return 3;
+	}
+    }
 
-    /* Close files and free all this stuff */
-    fclose(output);
+    /* Statistics, on the error output not to mix them with the rules */
+    if (do_stats == TRUE)
+	sta_write(stderr, stats_json);
+
+    /* Free all this stuff */
+    man_free();
+    prf_free();
+    atr_free();
+    sym_free();
+    srv_free();
+    res_free();
     free_chain(config);
+    free_files();
+    ast_free();
 
     /* Check memory allocation */
-    if (mem_get_count() != 0)
+    leaked += mem_get_count();
+    if (leaked != 0)
 	fprintf(stderr, "Warning: %u remaining memory areas (not freed)!\n",
-		mem_get_count());
+		leaked);
+    mem_free_all();
 
     /* Finally, it's done! */
-    return 0;
+    return written == TRUE ? 0 : 3;
 }
 
 /* End of File */
@@ -0,0 +1,279 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/manifest.c
+ *
+ * Description: Build Manifest (Generated Chains and their Content Hash)
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* System headers */
+#include <stdlib.h> /* NULL, malloc(), free()             */
+#include <stdio.h>  /* FILE *, fgets(), fprintf(), sscanf() */
+#include <string.h> /* strcmp(), strdup()                   */
+
+/* Local headers */
+#include "structs.h"
+#include "hashtab.h"
+#include "manifest.h"
+
+
+/*****************************************************************************
+ *
+ * Local Datatypes and Variables
+ *
+ */
+
+/* Maximum length of a manifest line */
+#define LINE_SIZE 256
+
+/* Chain (or IPSet) known by the manifest */
+struct entry {
+    struct hsh_elem elem;                /* Hash table element              */
+    struct entry *list;                  /* Next entry in insertion order   */
+    char *name;                          /* Chain or set name               */
+    enum bool set;                       /* Wether it is a set (no hashes)  */
+    unsigned long prev_hash, prev_check; /* Content hashes, previous build  */
+    unsigned long cur_hash, cur_check;   /* Content hashes, current build   */
+    enum bool in_prev;                   /* Chain present in previous build */
+    enum bool in_cur;                    /* Chain present in current build  */
+};
+
+/* Hash table */
+static struct hsh_table entries = { NULL, 0, 0 };
+
+/* Insertion-ordered list */
+static struct entry *first = NULL, *last = NULL;
+
+
+/*****************************************************************************
+ *
+ * Local Functions
+ *
+ */
+
+/*
+ * Check if an entry is the one of a chain
+ */
+static enum bool has_name(const struct hsh_elem *const elem,
+			  const void *const name)
+{
+    return strcmp(((const struct entry *) elem)->name, (const char *) name)
+	   == 0 ? TRUE : FALSE;
+}
+
+/*
+ * Find the entry of a chain, NULL if there is none
+ */
+static struct entry *find_entry(const char *const name)
+{
+    return (struct entry *) hsh_find(&entries, hash_string(HASH_SEED, name),
+				     has_name, name);
+}
+
+/*
+ * Find the entry of a chain, creating it if needed
+ */
+static struct entry *get_entry(const char *const name)
+{
+    struct entry *ent;
+
+    if ((ent = find_entry(name)) != NULL)
+	return ent;
+
+    if ((ent = malloc(sizeof(struct entry))) == NULL)
+	return NULL;
+    if ((ent->name = strdup(name)) == NULL) {
+	free(ent);
+	return NULL;
+    }
+    if (hsh_add(&entries, &ent->elem, hash_string(HASH_SEED, name)) == FALSE) {
+	free(ent->name);
+	free(ent);
+	return NULL;
+    }
+    ent->prev_hash = ent->prev_check = ent->cur_hash = ent->cur_check = 0;
+    ent->set = ent->in_prev = ent->in_cur = FALSE;
+    ent->list = NULL;
+    if (last == NULL)
+	first = ent;
+    else
+	last->list = ent;
+    last = ent;
+
+    return ent;
+}
+
+
+/*****************************************************************************
+ *
+ * Global Functions
+ *
+ */
+
+/*
+ * Read a previous build manifest (a set being given as "@name"); return
+ * FALSE on syntax error or if there is not enough memory
+ */
+enum bool man_read(FILE *const in)
+{
+    char line[LINE_SIZE], name[LINE_SIZE];
+    unsigned long hash = 0, check = 0;
+    struct entry *ent;
+
+    while (fgets(line, LINE_SIZE, in) != NULL) {
+	if (line[0] == '#' || line[0] == '\n')
+	    continue;
+	if (line[0] == '@' ? sscanf(line + 1, "%255s", name) != 1
+	    : sscanf(line, "%255s %lx %lx", name, &hash, &check) != 3)
+	    return FALSE;
+	if ((ent = get_entry(name)) == NULL)
+	    return FALSE;
+	ent->set = line[0] == '@' ? TRUE : FALSE;
+	ent->prev_hash = hash;
+	ent->prev_check = check;
+	ent->in_prev = TRUE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Write the manifest of the current build
+ */
+void man_write(FILE *const out)
+{
+    const struct entry *ent;
+
+    fputs("# RuleWall build manifest: chain name and content hashes, or "
+	  "@set name\n", out);
+    for (ent = first; ent != NULL; ent = ent->list)
+	if (ent->in_cur == TRUE && ent->set == TRUE)
+	    fprintf(out, "@%s\n", ent->name);
+	else if (ent->in_cur == TRUE)
+	    fprintf(out, "%s %08lx %08lx\n", ent->name, ent->cur_hash,
+		    ent->cur_check);
+}
+
+/*
+ * Record a chain of the current build with two independent hashes of its
+ * content; without memory, it is just not recorded, so that it will be
+ * regenerated next time
+ */
+void man_update(const char *const name, const unsigned long hash,
+		const unsigned long check)
+{
+    struct entry *const ent = get_entry(name);
+
+    if (ent == NULL)
+	return;
+
+    ent->cur_hash = hash;
+    ent->cur_check = check;
+    ent->in_cur = TRUE;
+}
+
+/*
+ * Record a set matched by the current build; without memory, it is just
+ * not recorded, so that it won't be destroyed next time
+ */
+void man_update_set(const char *const name)
+{
+    struct entry *const ent = get_entry(name);
+
+    if (ent == NULL)
+	return;
+
+    ent->set = TRUE;
+    ent->in_cur = TRUE;
+}
+
+/*
+ * Tell what has to be done for a chain compared to the previous build
+ * (both hashes have to be the same for it to be left alone), without
+ * recording anything; it can be called from several threads at the same
+ * time
+ */
+enum man_state man_lookup(const char *const name, const unsigned long hash,
+			  const unsigned long check)
+{
+    const struct entry *const ent = find_entry(name);
+
+    if (ent == NULL || ent->in_prev == FALSE)
+	return MAN_NEW;
+    return ent->prev_hash == hash && ent->prev_check == check
+	   ? MAN_SAME : MAN_CHANGED;
+}
+
+/*
+ * Call a function for each chain of the previous build which has been
+ * removed in the current one
+ */
+void man_removed(void (*const func)(const char *name))
+{
+    const struct entry *ent;
+
+    for (ent = first; ent != NULL; ent = ent->list)
+	if (ent->set == FALSE && ent->in_prev == TRUE && ent->in_cur == FALSE)
+	    func(ent->name);
+}
+
+/*
+ * Call a function for each set of the previous build which is not matched
+ * anymore in the current one
+ */
+void man_removed_sets(void (*const func)(const char *name))
+{
+    const struct entry *ent;
+
+    for (ent = first; ent != NULL; ent = ent->list)
+	if (ent->set == TRUE && ent->in_prev == TRUE && ent->in_cur == FALSE)
+	    func(ent->name);
+}
+
+/*
+ * Forget everything
+ */
+void man_free(void)
+{
+    struct entry *ent, *next;
+
+    for (ent = first; ent != NULL; ent = next) {
+	next = ent->list;
+	free(ent->name);
+	free(ent);
+    }
+
+    hsh_free(&entries, FALSE);
+    first = last = NULL;
+}
+
+/* End of File */
@@ -0,0 +1,69 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/manifest.h
+ *
+ * Description: Build Manifest Header
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/* Process only once */
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+/* C++ protection */
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* System headers */
+#include <stdio.h> /* FILE * */
+
+/* What to do with a chain compared to the previous build */
+enum man_state {
+    MAN_NEW,     /* Not in the previous build: create it  */
+    MAN_CHANGED, /* Different content: flush and refill it */
+    MAN_SAME     /* Same content: leave it alone          */
+};
+
+/* Manifest functions */
+enum bool man_read(FILE *in);
+void man_write(FILE *out);
+void man_update(const char *name, unsigned long hash, unsigned long check);
+void man_update_set(const char *name);
+enum man_state man_lookup(const char *name, unsigned long hash,
+			  unsigned long check);
+void man_removed(void (*func)(const char *name));
+void man_removed_sets(void (*func)(const char *name));
+void man_free(void);
+
+/* C++ protection */
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !MANIFEST_H */
+
+/* End of File */
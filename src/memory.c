@@ -35,12 +35,21 @@
  *
  */
 
+/* ./configure result */
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
 /* System headers */
 #include <stdlib.h> /* NULL, malloc(), free() */
 #include <stddef.h> /* size_t                 */
 #include <string.h> /* strlen(), strcpy()     */
+#if HAVE_PTHREAD_H
+#include <pthread.h> /* pthread_key_create(), pthread_mutex_lock() */
+#endif /* HAVE_PTHREAD_H */
 
 /* Local headers */
+#include "structs.h"
 #include "memory.h"
 
 
@@ -50,67 +59,142 @@
  *
  */
 
-/* Memory area structure (back and forward linked list) */
-struct mem_area {
-    struct mem_area *prev, *next; /* Previous and next element in list */
+/* Usual size of a memory chunk; bigger areas are given their own chunk */
+#define CHUNK_SIZE 65536
+
+/* Type with the strictest alignment requirements */
+union align {
+    long l;
+    double d;
+    void *p;
+};
+
+/* Round a size up to the alignment */
+#define ALIGN(size) (((size) + sizeof(union align) - 1) \
+		     / sizeof(union align) * sizeof(union align))
+
+/* Memory chunk, areas being carved out from it sequentially */
+struct mem_chunk {
+    struct mem_chunk *next; /* Next chunk (linked list) */
+    size_t size, used;      /* Total and used sizes     */
+};
+
+/* Size of the chunk header, keeping the dataspace aligned */
+#define HEADER_SIZE ALIGN(sizeof(struct mem_chunk))
+
+/* Memory arena: the chunks used by one thread, so that the files can be
+ * parsed in parallel without locking */
+struct mem_arena {
+    struct mem_arena *next;  /* Next arena (linked list)              */
+    struct mem_chunk *first; /* Current chunk (head of the chunk list) */
+    unsigned count;          /* Memory area count                      */
 };
 
-/* First element of the memory area linked list */
-static struct mem_area *first = NULL;
+/* Arena of the main thread, head of the arena list */
+static struct mem_arena main_arena = { NULL, NULL, 0 };
 
-/* Memory area count */
-static unsigned count = 0;
+#if HAVE_PTHREAD_H
+/* Arena of the current thread, if not the main one */
+static pthread_key_t arena_key;
+static pthread_once_t arena_once = PTHREAD_ONCE_INIT;
+
+/* Protection of the arena list */
+static pthread_mutex_t arena_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Create the arena key, once */
+static void arena_init(void)
+{
+    pthread_key_create(&arena_key, NULL);
+}
+#else /* HAVE_PTHREAD_H */
+/* Arena in use, if not the main one */
+static struct mem_arena *current = NULL;
+#endif /* HAVE_PTHREAD_H */
 
 
 /*****************************************************************************
  *
- * Flobal Functions
+ * Local Functions
  *
  */
 
 /*
- * Allocate memory and register the area in the linked list
+ * Get the arena of the current thread
  */
-void *mem_alloc(const size_t size)
+static struct mem_arena *get_arena(void)
 {
-    /* Allocate memory */
-    struct mem_area *const mem = malloc(sizeof(struct mem_area) + size);
-
-    /* No more memory... */
-    if (mem == NULL)
-	return NULL;
-
-    /* Initialize and link with the preceding one */
-    if (first != NULL)
-	first->prev = mem;
-    mem->next = first;
-    mem->prev = NULL;
-    first = mem;
-
-    /* Count it and return the actual reserved dataspace */
-    count++;
-    return mem + 1;
+#if HAVE_PTHREAD_H
+    struct mem_arena *arena;
+
+    pthread_once(&arena_once, arena_init);
+    if ((arena = pthread_getspecific(arena_key)) != NULL)
+	return arena;
+#else /* HAVE_PTHREAD_H */
+    if (current != NULL)
+	return current;
+#endif /* HAVE_PTHREAD_H */
+    return &main_arena;
 }
 
+
+/*****************************************************************************
+ *
+ * Global Functions
+ *
+ */
+
 /*
- * Free a previously allocated dataspace
+ * Allocate memory from the current chunk, getting a new one if needed
+ */
+void *mem_alloc(size_t size)
+{
+    struct mem_arena *const arena = get_arena();
+    struct mem_chunk *chunk, *first = arena->first;
+
+    size = ALIGN(size == 0 ? 1 : size);
+
+    if (first == NULL || first->size - first->used < size) {
+	if (size > CHUNK_SIZE / 4) {
+	    /* Big area: give it its own chunk, behind the current one so that
+	     * the remaining space of the latter isn't wasted */
+	    if ((chunk = malloc(HEADER_SIZE + size)) == NULL)
+		return NULL;
+	    chunk->size = chunk->used = size;
+	    if (first != NULL) {
+		chunk->next = first->next;
+		first->next = chunk;
+	    } else {
+		chunk->next = NULL;
+		arena->first = chunk;
+	    }
+
+	    arena->count++;
+	    return (char *) chunk + HEADER_SIZE;
+	}
+
+	/* Get a new chunk */
+	if ((chunk = malloc(HEADER_SIZE + CHUNK_SIZE)) == NULL)
+	    return NULL;
+	chunk->size = CHUNK_SIZE;
+	chunk->used = 0;
+	chunk->next = first;
+	arena->first = first = chunk;
+    }
+
+    /* Count it and return the reserved dataspace */
+    first->used += size;
+    arena->count++;
+    return (char *) first + HEADER_SIZE + first->used - size;
+}
+
+/*
+ * Free a previously allocated dataspace; the memory is actually released
+ * along with its whole chunk, by mem_free_all()
  */
 void mem_free(void *const pointer)
 {
-    /* Pointer to actual memory area */
-    struct mem_area *const mem = (struct mem_area *) pointer - 1;
-
-    /* Unlink from the list */
-    if (mem->prev != NULL)
-	mem->prev->next = mem->next;
-    else
-	first = mem->next;
-    if (mem->next != NULL)
-	mem->next->prev = mem->prev;
-
-    /* Free the area and retire it from the counter */
-    free(mem);
-    count--;
+    if (pointer != NULL)
+	get_arena()->count--;
 }
 
 /*
@@ -118,16 +202,27 @@ void mem_free(void *const pointer)
  */
 void mem_free_all(void)
 {
-    struct mem_area *cur;
+    struct mem_arena *arena, *next_arena;
+    struct mem_chunk *cur, *next;
 
-    /* Walk throuth the linked list and free all memory */
-    for (cur = first; cur != NULL; cur = cur->next) {
-	free(cur);
-	count--;
+    for (arena = &main_arena; arena != NULL; arena = next_arena) {
+	/* Walk throuth the chunk list and free them */
+	for (cur = arena->first; cur != NULL; cur = next) {
+	    next = cur->next;
+	    free(cur);
+	}
+	next_arena = arena->next;
+	if (arena != &main_arena)
+	    free(arena);
     }
 
     /* Reinitialize list head */
-    first = NULL;
+    main_arena.next = NULL;
+    main_arena.first = NULL;
+    main_arena.count = 0;
+#if !HAVE_PTHREAD_H
+    current = NULL;
+#endif /* !HAVE_PTHREAD_H */
 }
 
 /*
@@ -135,9 +230,102 @@ void mem_free_all(void)
  */
 unsigned mem_get_count(void)
 {
+    struct mem_arena *arena;
+    unsigned count = 0;
+
+    /* Areas may be freed by another thread than the allocating one, the
+     * (unsigned) sum is right anyway */
+    for (arena = &main_arena; arena != NULL; arena = arena->next)
+	count += arena->count;
     return count;
 }
 
+/*
+ * Get the size of the memory reserved from the system, chunk headers included
+ */
+size_t mem_get_size(void)
+{
+    const struct mem_arena *arena;
+    const struct mem_chunk *chunk;
+    size_t size = 0;
+
+    for (arena = &main_arena; arena != NULL; arena = arena->next)
+	for (chunk = arena->first; chunk != NULL; chunk = chunk->next)
+	    size += HEADER_SIZE + chunk->size;
+    return size;
+}
+
+/*
+ * Give the current thread its own arena; the memory allocated by the thread
+ * remains valid after it ends, until mem_free_all() or mem_free_since() is
+ * called
+ */
+enum bool mem_thread_begin(void)
+{
+    struct mem_arena *arena;
+
+    if ((arena = malloc(sizeof(struct mem_arena))) == NULL)
+	return FALSE;
+    arena->first = NULL;
+    arena->count = 0;
+
+    /* Add it behind the main arena */
+#if HAVE_PTHREAD_H
+    pthread_once(&arena_once, arena_init);
+    pthread_mutex_lock(&arena_mutex);
+#endif /* HAVE_PTHREAD_H */
+    arena->next = main_arena.next;
+    main_arena.next = arena;
+#if HAVE_PTHREAD_H
+    pthread_mutex_unlock(&arena_mutex);
+
+    if (pthread_setspecific(arena_key, arena) != 0)
+	return FALSE;
+#else /* HAVE_PTHREAD_H */
+    current = arena;
+#endif /* HAVE_PTHREAD_H */
+    return TRUE;
+}
+
+/*
+ * Stop using the arena of the current thread
+ */
+void mem_thread_end(void)
+{
+#if HAVE_PTHREAD_H
+    pthread_setspecific(arena_key, NULL);
+#else /* HAVE_PTHREAD_H */
+    current = NULL;
+#endif /* HAVE_PTHREAD_H */
+}
+
+/*
+ * Get a mark of the thread arenas created so far, for mem_free_since()
+ */
+struct mem_arena *mem_mark(void)
+{
+    return main_arena.next;
+}
+
+/*
+ * Free the thread arenas created since a mark, with all their memory; none
+ * of them may be in use anymore
+ */
+void mem_free_since(struct mem_arena *const mark)
+{
+    struct mem_arena *arena;
+    struct mem_chunk *cur, *next;
+
+    while ((arena = main_arena.next) != mark) {
+	for (cur = arena->first; cur != NULL; cur = next) {
+	    next = cur->next;
+	    free(cur);
+	}
+	main_arena.next = arena->next;
+	free(arena);
+    }
+}
+
 /*
  * Duplicate a string by allocating space for it and copying it
  */
@@ -41,12 +41,20 @@ extern "C" {
 /* System headers */
 #include <stddef.h> /* size_t */
 
+/* Memory arena (opaque) */
+struct mem_arena;
+
 /* Memory management functions */
 void *mem_alloc(size_t size);
 void mem_free(void *pointer);
 void mem_free_all(void);
 unsigned mem_get_count(void);
+size_t mem_get_size(void);
 char *mem_strdup(const char *string);
+enum bool mem_thread_begin(void);
+void mem_thread_end(void);
+struct mem_arena *mem_mark(void);
+void mem_free_since(struct mem_arena *mark);
 
 /* C++ protection */
 #ifdef __cplusplus
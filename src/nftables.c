@@ -0,0 +1,665 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/nftables.c
+ *
+ * Description: NFTables Rules Generation Functions
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* System headers */
+#include <stdlib.h> /* NULL, malloc(), realloc(), free() */
+#include <stdio.h>  /* FILE *, fputs(), sprintf()       */
+#include <string.h> /* strcmp(), strncmp(), strcpy()    */
+
+/* Local headers */
+#include "structs.h"
+#include "flat.h"
+#include "output.h"
+#include "interval.h"
+#include "nftables.h"
+#include "stats.h"
+
+
+/*****************************************************************************
+ *
+ * Prototypes and Local Variables
+ *
+ */
+
+/* Generated table name and family */
+#define NFT_TABLE "inet rulewall"
+
+/* Priority of the base chains (the one of the filter hooks) */
+#define NFT_PRIORITY "0"
+
+/* Base chain: a chain of the configuration named after a hook, which the
+ * packets reach */
+struct hook {
+    const char *chain; /* Chain name */
+    const char *hook;  /* Hook name  */
+};
+
+/* Hooked chain names, as NFTables or IPTables name them */
+static const struct hook hooks[] = {
+    { "input",   "input"   }, { "INPUT",   "input"   },
+    { "forward", "forward" }, { "FORWARD", "forward" },
+    { "output",  "output"  }, { "OUTPUT",  "output"  }
+};
+
+/* Verdict prefix used to call another chain */
+#define NFT_JUMP     "jump "
+#define NFT_JUMP_LEN (sizeof(NFT_JUMP) - 1)
+#define NFT_IS_JUMP(verdict) (strncmp(verdict, NFT_JUMP, NFT_JUMP_LEN) == 0)
+
+/* Auxiliary functions */
+static void nft_out_create(const char *table);
+static char *nft_new_table(const struct action *action);
+static void nft_out_rule(const char *table);
+static void nft_out_verdict(const char *table, const char *verdict);
+static void nft_out_match(const struct condition *cond, enum direction dir);
+static void nft_out_element(const struct condition *cond,
+			    const struct interval *elem);
+static void nft_out_set(const struct condition *cond);
+
+/* Local functions */
+static void nft_chain(const struct chain *chain);
+static void nft_action(const char *table, const struct action *action);
+static void nft_test(const char *table, const struct test *test);
+static enum bool nft_vmap(const char *table, const struct test *test);
+static void nft_expr(const char *table,
+		     const char *v_then, const char *v_else,
+		     const struct expr *expr);
+static void nft_cond(const char *table,
+		     const char *v_then, const char *v_else,
+		     const struct condition *cond);
+static void nft_cond_rules(const char *table, const char *verdict,
+			   const struct condition *cond);
+
+/* Local variables */
+static struct out_sink output;
+static enum bool emit_chains, emit_flush, emit_rules;
+static unsigned table_count;
+static char *open_table;
+
+/* Output chains and rules, and rules jumping to a chain */
+static unsigned long nb_chains, nb_rules, nb_jumps;
+
+
+/*****************************************************************************
+ *
+ * Global Functions
+ *
+ */
+
+/*
+ * Generate an NFTables script corresponding to a configuration, to be loaded
+ * in one transaction with "nft -f"; the chains named after the input,
+ * forward and output hooks are hooked there, and the other chains of the
+ * table are left alone; return FALSE if the script could not be written
+ */
+enum bool nft_config(const struct chain *const config, FILE *const out)
+{
+    const struct chain *chain;
+    enum bool written;
+
+    out_open(&output, out == NULL ? stdout : out);
+    nb_chains = nb_rules = nb_jumps = 0;
+
+    /* Declare all the chains, including generated ones, before any rule
+     * can jump to them (the table and chains are created if needed);
+     * generated names only depend on the walk order */
+    out_str(&output, "table " NFT_TABLE " {\n");
+    table_count = 0;
+    emit_chains = TRUE;
+    emit_flush = emit_rules = FALSE;
+    for (chain = config; chain != NULL; chain = chain->next)
+	nft_chain(chain);
+    out_str(&output, "}\n\n");
+
+    /* Empty them, the previous rules being replaced */
+    table_count = 0;
+    emit_flush = TRUE;
+    emit_chains = emit_rules = FALSE;
+    for (chain = config; chain != NULL; chain = chain->next)
+	nft_chain(chain);
+
+    /* Then output the rules */
+    out_str(&output, "\ntable " NFT_TABLE " {\n");
+    table_count = 0;
+    emit_rules = TRUE;
+    emit_chains = emit_flush = FALSE;
+    for (chain = config; chain != NULL; chain = chain->next)
+	nft_chain(chain);
+    if (open_table != NULL) {
+	out_str(&output, "\t}\n");
+	free(open_table);
+	open_table = NULL;
+    }
+    out_str(&output, "}\n");
+
+    if ((written = out_close(&output)) == FALSE)
+	fputs("Error: cannot write the rules.\n", stderr);
+    sta_add(STA_OUT_CHAINS, nb_chains);
+    sta_add(STA_OUT_RULES, nb_rules);
+    sta_add(STA_OUT_JUMPS, nb_jumps);
+    return written;
+}
+
+
+/*****************************************************************************
+ *
+ * Auxiliary Functions
+ *
+ */
+
+/*
+ * Output an NFTables chain declaration, hooking it if named after a hook,
+ * or the command emptying it
+ */
+static void nft_out_create(const char *const table)
+{
+    unsigned i;
+
+    if (emit_flush == TRUE)
+	out_strs(&output, "flush chain " NFT_TABLE " ", table, "\n", NULL);
+    if (emit_chains == FALSE)
+	return;
+
+    out_strs(&output, "\tchain ", table, " {\n", NULL);
+    for (i = 0; i < sizeof(hooks) / sizeof(*hooks); i++)
+	if (strcmp(table, hooks[i].chain) == 0) {
+	    out_strs(&output, "\t\ttype filter hook ", hooks[i].hook,
+		     " priority " NFT_PRIORITY "; policy accept;\n", NULL);
+	    break;
+	}
+    out_str(&output, "\t}\n");
+    nb_chains++;
+}
+
+/*
+ * Create an NFTables chain for later use and return the verdict jumping to
+ * it, or directly the verdict corresponding to the action if possible
+ */
+static char *nft_new_table(const struct action *const action)
+{
+    unsigned digits = table_count, nb = 0;
+    char *res;
+
+    if (action != NULL)
+	switch (action->type) {
+	case TARGET_FINAL:
+	    switch (action->action.final) {
+	    case FINAL_ACCEPT:
+		return strdup("accept");
+	    case FINAL_DROP:
+		return strdup("drop");
+	    case FINAL_REJECT:
+		return strdup("reject");
+	    }
+	    break;
+
+	case TARGET_USER:
+	    if ((res = malloc(NFT_JUMP_LEN
+			      + strlen(action->action.user->name) + 1))
+		    != NULL) {
+		strcpy(res, NFT_JUMP);
+		strcpy(res + NFT_JUMP_LEN, action->action.user->name);
+	    }
+	    return res;
+
+	default:
+	    break;
+	}
+
+    /* Count the number of digits */
+    do {
+	digits /= 10;
+	nb++;
+    } while (digits != 0);
+
+    /* Allocate memory and build string */
+    if ((res = malloc(NFT_JUMP_LEN + nb + 5)) != NULL)
+	sprintf(res, NFT_JUMP "__RW%u", table_count++);
+
+    /* Output and return the result */
+    nft_out_create(res + NFT_JUMP_LEN);
+    return res;
+}
+
+/*
+ * Output the beginning of a rule, opening the chain block if needed
+ */
+static void nft_out_rule(const char *const table)
+{
+    if (open_table == NULL || strcmp(open_table, table) != 0) {
+	if (open_table != NULL) {
+	    out_str(&output, "\t}\n");
+	    free(open_table);
+	}
+	out_strs(&output, "\tchain ", table, " {\n", NULL);
+	open_table = strdup(table);
+    }
+
+    out_str(&output, "\t\t");
+    nb_rules++;
+}
+
+/*
+ * Output an unconditional verdict rule
+ */
+static void nft_out_verdict(const char *const table,
+			    const char *const verdict)
+{
+    if (emit_rules == FALSE)
+	return;
+
+    nft_out_rule(table);
+    out_strs(&output, verdict, "\n", NULL);
+    if (NFT_IS_JUMP(verdict))
+	nb_jumps++;
+}
+
+/*
+ * Output the packet field matched by a condition, for the given direction
+ */
+static void nft_out_match(const struct condition *const cond,
+			  const enum direction dir)
+{
+    const char *const addr = dir == DIR_DST ? "daddr" : "saddr";
+    const char *const port = dir == DIR_DST ? "dport" : "sport";
+
+    if (cond->type == COND_ADDR)
+	out_strs(&output, cond->proto == PROTO_IPV6 ? "ip6 " : "ip ", addr,
+		 " ", NULL);
+    else
+	switch (cond->proto) {
+	case PROTO_TCP:
+	    out_strs(&output, "tcp ", port, " ", NULL);
+	    break;
+
+	case PROTO_UDP:
+	    out_strs(&output, "udp ", port, " ", NULL);
+	    break;
+
+	default:
+	    out_strs(&output, "meta l4proto { tcp, udp } th ", port, " ",
+		     NULL);
+	}
+}
+
+/*
+ * Output a set element: a port or port range, an address, a network prefix
+ * or an address range
+ */
+static void nft_out_element(const struct condition *const cond,
+			    const struct interval *const elem)
+{
+    unsigned len;
+
+    if (cond->type == COND_PORT) {
+	out_number(&output, elem->from);
+	if (elem->from != elem->to) {
+	    out_char(&output, '-');
+	    out_number(&output, elem->to);
+	}
+	return;
+    }
+
+    itv_out_ipv4(&output, elem->from);
+    if (itv_prefix(elem->from, elem->to, &len) == TRUE) {
+	/* Network prefix */
+	if (len < 32) {
+	    out_char(&output, '/');
+	    out_number(&output, (unsigned long) len);
+	}
+    } else {
+	/* Address range */
+	out_char(&output, '-');
+	itv_out_ipv4(&output, elem->to);
+    }
+}
+
+/*
+ * Output the value of a condition: a single element or an anonymous set;
+ * numeric elements are sorted and merged, symbolic ones (host and service
+ * names) are resolved by nft itself
+ */
+static void nft_out_set(const struct condition *const cond)
+{
+    struct interval *elems;
+    const struct addr *addr;
+    const struct port *port;
+    struct prefix prefix;
+    unsigned nb = 0, nb_sym = 0, i;
+
+    /* Get the numeric elements */
+    if (cond->type == COND_ADDR)
+	for (addr = cond->cond.addr; addr != NULL; addr = addr->next)
+	    nb++;
+    else
+	for (port = cond->cond.port; port != NULL; port = port->next)
+	    nb++;
+    if ((elems = malloc(sizeof(struct interval) * nb)) == NULL)
+	return;
+    nb = itv_merge(elems, itv_get_cond(cond, 0, elems));
+
+    /* Count the symbolic ones */
+    if (cond->type == COND_ADDR) {
+	for (addr = cond->cond.addr; addr != NULL; addr = addr->next)
+	    if (addr_to_prefix(addr, &prefix) == FALSE)
+		nb_sym++;
+    } else
+	for (port = cond->cond.port; port != NULL; port = port->next)
+	    if (port->type == PORT_NAME)
+		nb_sym++;
+
+    /* Output everything */
+    if (nb + nb_sym > 1)
+	out_str(&output, "{ ");
+    for (i = 0; i < nb; i++) {
+	if (i != 0)
+	    out_str(&output, ", ");
+	nft_out_element(cond, elems + i);
+    }
+    if (cond->type == COND_ADDR) {
+	for (addr = cond->cond.addr; addr != NULL; addr = addr->next)
+	    if (addr_to_prefix(addr, &prefix) == FALSE)
+		out_strs(&output, i++ != 0 ? ", " : "", addr->string, NULL);
+    } else
+	for (port = cond->cond.port; port != NULL; port = port->next)
+	    if (port->type == PORT_NAME)
+		out_strs(&output, i++ != 0 ? ", " : "", port->port.name,
+			 NULL);
+    if (nb + nb_sym > 1)
+	out_str(&output, " }");
+
+    free(elems);
+}
+
+/*****************************************************************************
+ *
+ * Local Functions
+ *
+ */
+
+/*
+ * Process a chain
+ */
+static void nft_chain(const struct chain *const chain)
+{
+    nft_out_create(chain->name);
+    nft_action(chain->name, chain->action);
+}
+
+/*
+ * Process an action
+ */
+static void nft_action(const char *const table,
+		       const struct action *const action)
+{
+    char *verdict;
+
+    if (action->type == TARGET_TEST)
+	nft_test(table, action->action.test);
+    else if ((verdict = nft_new_table(action)) != NULL) {
+	nft_out_verdict(table, verdict);
+	free(verdict);
+    }
+}
+
+/*
+ * Process a test
+ */
+static void nft_test(const char *const table, const struct test *const test)
+{
+    char *v_then, *v_else;
+
+    /* Try to make a verdict map from an "else if" cascade */
+    if (nft_vmap(table, test) == TRUE)
+	return;
+
+    v_then = nft_new_table(test->act_then);
+    v_else = nft_new_table(test->act_else);
+
+    nft_expr(table, v_then, v_else, test->expr);
+    if (test->act_then->type == TARGET_TEST)
+	nft_test(v_then + NFT_JUMP_LEN, test->act_then->action.test);
+    if (test->act_else->type == TARGET_TEST)
+	nft_test(v_else + NFT_JUMP_LEN, test->act_else->action.test);
+
+    free(v_then);
+    free(v_else);
+}
+
+/*
+ * Process an "else if" cascade whose arms all test the same packet field
+ * against disjoint numeric values, as a single verdict map lookup; return
+ * FALSE if the test is not such a cascade
+ */
+static enum bool nft_vmap(const char *const table,
+			  const struct test *const test)
+{
+    const struct condition *first = NULL, *cond;
+    const struct test *cur;
+    const struct action *rest = NULL;
+    const struct addr *addr;
+    const struct port *port;
+    struct interval *elems = NULL, *tmp;
+    char **verdicts;
+    unsigned nb_arms = 0, nb_elems = 0, size = 0, nb, i, j;
+    enum bool jump = FALSE;
+
+    /* Gather the arms */
+    for (cur = test; cur != NULL;
+	 cur = rest->type == TARGET_TEST ? rest->action.test : NULL) {
+	/* Leading to a verdict a map can hold: "reject" is a statement */
+	if (cur->act_then->type == TARGET_FINAL
+	    && cur->act_then->action.final == FINAL_REJECT)
+	    break;
+
+	/* Only simple positive conditions on a single field */
+	if (cur->expr->type != EXPR_COND || cur->expr->not == TRUE)
+	    break;
+	cond = cur->expr->sub.cond;
+	if (cond->dir == DIR_BOTH)
+	    break;
+	if (first != NULL && (cond->type != first->type
+			      || cond->proto != first->proto
+			      || cond->dir != first->dir))
+	    break;
+
+	/* With only numeric elements */
+	nb = 0;
+	if (cond->type == COND_ADDR)
+	    for (addr = cond->cond.addr; addr != NULL; addr = addr->next)
+		nb++;
+	else
+	    for (port = cond->cond.port; port != NULL; port = port->next)
+		nb++;
+	if (nb_elems + nb > size) {
+	    size = (nb_elems + nb) * 2;
+	    if ((tmp = realloc(elems, sizeof(struct interval) * size))
+		    == NULL)
+		break;
+	    elems = tmp;
+	}
+	if (itv_get_cond(cond, nb_arms, elems + nb_elems) != nb)
+	    break;
+
+	/* Which must not overlap with those of the previous arms */
+	for (i = nb_elems; i < nb_elems + nb; i++)
+	    for (j = 0; j < nb_elems; j++)
+		if (elems[i].from <= elems[j].to
+		    && elems[j].from <= elems[i].to)
+		    goto overlap;
+
+	first = cond;
+	nb_elems += nb;
+	nb_arms++;
+	rest = cur->act_else;
+    }
+overlap:
+
+    /* Not worth it for a single arm */
+    if (nb_arms < 2) {
+	free(elems);
+	return FALSE;
+    }
+
+    /* Get the verdicts, creating the needed chains */
+    if ((verdicts = malloc(sizeof(char *) * nb_arms)) == NULL) {
+	free(elems);
+	return FALSE;
+    }
+    for (cur = test, i = 0; i < nb_arms;
+	 cur = cur->act_else->action.test, i++)
+	verdicts[i] = nft_new_table(cur->act_then);
+
+    /* Output the map */
+    if (emit_rules == TRUE) {
+	nb_elems = itv_merge(elems, nb_elems);
+	nft_out_rule(table);
+	nft_out_match(first, first->dir);
+	out_str(&output, "vmap { ");
+	for (i = 0; i < nb_elems; i++) {
+	    if (i != 0)
+		out_str(&output, ", ");
+	    nft_out_element(first, elems + i);
+	    out_strs(&output, " : ", verdicts[elems[i].arm], NULL);
+	    if (NFT_IS_JUMP(verdicts[elems[i].arm]))
+		jump = TRUE;
+	}
+	out_str(&output, " }\n");
+	if (jump == TRUE)
+	    nb_jumps++;
+    }
+
+    /* Then what to do if nothing matched, in the same chain */
+    nft_action(table, rest);
+
+    /* And finally, the arms actions */
+    for (cur = test, i = 0; i < nb_arms;
+	 cur = cur->act_else->action.test, i++) {
+	if (cur->act_then->type == TARGET_TEST)
+	    nft_test(verdicts[i] + NFT_JUMP_LEN,
+		     cur->act_then->action.test);
+	free(verdicts[i]);
+    }
+
+    free(verdicts);
+    free(elems);
+    return TRUE;
+}
+
+/*
+ * Process an expression
+ */
+static void nft_expr(const char *const table,
+		     const char *v_then, const char *v_else,
+		     const struct expr *const expr)
+{
+    char *inter;
+
+    if (expr->not) {
+	const char *const tmp = v_then;
+	v_then = v_else;
+	v_else = tmp;
+    }
+
+    if (expr->type == EXPR_COND)
+	nft_cond(table, v_then, v_else, expr->sub.cond);
+    else if (expr->sub.expr.left->type == EXPR_COND
+	     && (expr->type == EXPR_OR)
+		== (expr->sub.expr.left->not == FALSE)) {
+	/* The left condition alone decides: go on in the same chain */
+	nft_cond_rules(table, expr->type == EXPR_OR ? v_then : v_else,
+		       expr->sub.expr.left->sub.cond);
+	nft_expr(table, v_then, v_else, expr->sub.expr.right);
+    } else {
+	inter = nft_new_table(NULL);
+
+	switch (expr->type) {
+	case EXPR_AND:
+	    nft_expr(table, inter, v_else, expr->sub.expr.left);
+	    break;
+
+	case EXPR_OR:
+	    nft_expr(table, v_then, inter, expr->sub.expr.left);
+
+	case EXPR_COND:
+	    break;
+	}
+	nft_expr(inter + NFT_JUMP_LEN, v_then, v_else, expr->sub.expr.right);
+
+	free(inter);
+    }
+}
+
+/*
+ * Process a condition: one rule per direction, matching the whole list at
+ * once
+ */
+static void nft_cond(const char *const table,
+		     const char *const v_then, const char *const v_else,
+		     const struct condition *const cond)
+{
+    nft_cond_rules(table, v_then, cond);
+    nft_out_verdict(table, v_else);
+}
+
+/*
+ * Output the rules giving a verdict if a condition matches
+ */
+static void nft_cond_rules(const char *const table,
+			   const char *const verdict,
+			   const struct condition *const cond)
+{
+    if (emit_rules == FALSE)
+	return;
+
+    if (NFT_IS_JUMP(verdict))
+	nb_jumps += cond->dir == DIR_BOTH ? 2 : 1;
+    if (cond->dir == DIR_BOTH || cond->dir == DIR_SRC) {
+	nft_out_rule(table);
+	nft_out_match(cond, DIR_SRC);
+	nft_out_set(cond);
+	out_strs(&output, " ", verdict, "\n", NULL);
+    }
+    if (cond->dir == DIR_BOTH || cond->dir == DIR_DST) {
+	nft_out_rule(table);
+	nft_out_match(cond, DIR_DST);
+	nft_out_set(cond);
+	out_strs(&output, " ", verdict, "\n", NULL);
+    }
+}
+
+/* End of File */
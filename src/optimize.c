@@ -0,0 +1,506 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/optimize.c
+ *
+ * Description: Configuration Optimization Functions
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* System headers */
+#include <stdlib.h> /* NULL, malloc(), free(), qsort() */
+#include <stdio.h>  /* sprintf()                        */
+#include <string.h> /* strlen()                         */
+
+/* Local headers */
+#include "structs.h"
+#include "memory.h"
+#include "services.h"
+#include "optimize.h"
+
+
+/*****************************************************************************
+ *
+ * Prototypes and Local Datatypes
+ *
+ */
+
+/* Space needed by an address string ("255.255.255.255/32") */
+#define ADDR_SIZE 19
+
+/* Node of the address prefix trie: the path from the root is compressed,
+ * so that a node has either two children or none */
+struct trie {
+    struct trie *child[2]; /* Children, with the next bit clear or set */
+    unsigned long net;     /* Network address                          */
+    unsigned len;          /* Prefix length                            */
+    enum bool full;        /* Wether the whole prefix is in the set    */
+};
+
+/* Local functions */
+static void opt_action(struct action *action);
+static void opt_not(struct expr *expr, enum bool not);
+static void opt_flatten(struct expr *expr);
+static void opt_sets(struct expr *expr);
+static void opt_cover(struct condition *cond);
+static void opt_ranges(struct condition *cond);
+static int cmp_range(const void *a, const void *b);
+
+/* Prefix trie functions */
+static struct trie *trie_new(unsigned long net, unsigned len,
+			     enum bool full);
+static void trie_free(struct trie *node);
+static enum bool trie_insert(struct trie *root, const struct prefix *prefix);
+static void trie_merge(struct trie *node);
+static unsigned trie_count(const struct trie *node);
+static struct addr **trie_addrs(const struct trie *node, struct addr **tail);
+
+
+/*****************************************************************************
+ *
+ * Global Functions
+ *
+ */
+
+/*
+ * Simplify a configuration before generating rules from it; the meaning of
+ * the chains is of course left unchanged
+ */
+void opt_config(struct chain *config)
+{
+    for (; config != NULL; config = config->next)
+	opt_action(config->action);
+}
+
+
+/*****************************************************************************
+ *
+ * Local Functions
+ *
+ */
+
+/*
+ * Optimize an action
+ */
+static void opt_action(struct action *const action)
+{
+    struct test *test;
+    struct action *act_then;
+
+    if (action->type != TARGET_TEST)
+	return;
+    test = action->action.test;
+
+    opt_action(test->act_then);
+    opt_action(test->act_else);
+
+    /* Nothing to test if both branches do the same */
+    if (equal_action(test->act_then, test->act_else) == TRUE) {
+	act_then = test->act_then;
+	test->act_then = NULL;
+	free_test(test);
+
+	*action = *act_then;
+	mem_free(act_then);
+	return;
+    }
+
+    /* Put the expression in a normal form: negations on the conditions
+     * only, and operator sequences as right-leaning lists */
+    opt_not(test->expr, FALSE);
+    opt_flatten(test->expr);
+    opt_sets(test->expr);
+}
+
+/*
+ * Push the negations down to the conditions, using De Morgan's laws:
+ * !(a && b) is (!a || !b) and !(a || b) is (!a && !b)
+ */
+static void opt_not(struct expr *const expr, enum bool not)
+{
+    if (expr->not == TRUE)
+	not = !not;
+
+    if (expr->type == EXPR_COND) {
+	expr->not = not;
+	return;
+    }
+
+    expr->not = FALSE;
+    if (not == TRUE)
+	expr->type = expr->type == EXPR_AND ? EXPR_OR : EXPR_AND;
+
+    opt_not(expr->sub.expr.left, not);
+    opt_not(expr->sub.expr.right, not);
+}
+
+/*
+ * Turn ((a op b) op c) into (a op (b op c)), so that a sequence of the same
+ * operator is a list whose left operands are never of that operator; the
+ * generators can then evaluate it in fewer chains
+ */
+static void opt_flatten(struct expr *expr)
+{
+    struct expr *left;
+
+    while (expr->type != EXPR_COND) {
+	while ((left = expr->sub.expr.left)->type == expr->type) {
+	    expr->sub.expr.left = left->sub.expr.left;
+	    left->sub.expr.left = left->sub.expr.right;
+	    left->sub.expr.right = expr->sub.expr.right;
+	    expr->sub.expr.right = left;
+	}
+
+	opt_flatten(left);
+	expr = expr->sub.expr.right;
+    }
+}
+
+/*
+ * Normalize the address and port lists of the conditions of an expression
+ */
+static void opt_sets(struct expr *const expr)
+{
+    if (expr->type != EXPR_COND) {
+	opt_sets(expr->sub.expr.left);
+	opt_sets(expr->sub.expr.right);
+    } else if (expr->sub.cond->type == COND_PORT)
+	opt_ranges(expr->sub.cond);
+    else if (expr->sub.cond->proto != PROTO_IPV6)
+	opt_cover(expr->sub.cond);
+}
+
+/*
+ * Replace the numeric addresses of a condition by the smallest list of
+ * network prefixes matching the same addresses: the contained prefixes are
+ * removed and the adjacent ones are merged; host names are kept after them
+ */
+static void opt_cover(struct condition *const cond)
+{
+    struct addr *addr, *next, *list = NULL, **tail, *others = NULL;
+    struct addr **others_tail = &others;
+    struct trie *root;
+    struct prefix prefix;
+    unsigned nb = 0;
+
+    if (cond->cond.addr == NULL || cond->cond.addr->next == NULL
+	|| (root = trie_new(0UL, 0U, FALSE)) == NULL)
+	return;
+
+    /* Build the trie */
+    for (addr = cond->cond.addr; addr != NULL; addr = addr->next)
+	if (addr_to_prefix(addr, &prefix) == TRUE) {
+	    if (trie_insert(root, &prefix) == FALSE) {
+		trie_free(root);
+		return;
+	    }
+	    nb++;
+	}
+    trie_merge(root);
+
+    /* Keep the list as is if nothing can be removed */
+    tail = trie_count(root) < nb ? trie_addrs(root, &list) : NULL;
+    trie_free(root);
+    if (tail == NULL) {
+	free_addr(list);
+	return;
+    }
+
+    /* Replace the numeric addresses */
+    for (addr = cond->cond.addr; addr != NULL; addr = next) {
+	next = addr->next;
+	if (addr_to_prefix(addr, &prefix) == TRUE)
+	    mem_free(addr);
+	else {
+	    *others_tail = addr;
+	    others_tail = &addr->next;
+	}
+    }
+    *others_tail = NULL;
+    *tail = others;
+    cond->cond.addr = list;
+}
+
+
+/*
+ * Replace the port names of a condition by their numbers, then sort its
+ * ranges and merge the overlapping or adjacent ones; unknown names are kept
+ * after them
+ */
+static void opt_ranges(struct condition *const cond)
+{
+    struct port *port, *next, **tail = &cond->cond.port, *names = NULL;
+    struct port **names_tail = &names;
+    struct one_port *ranges;
+    unsigned short number;
+    unsigned nb = 0, i, last;
+
+    /* Resolve the names */
+    for (port = cond->cond.port; port != NULL; port = port->next) {
+	if (port->type == PORT_NAME
+	    && srv_find(port->port.name, cond->proto, &number) == TRUE) {
+	    port->type = PORT_NUMERIC;
+	    port->port.range.from = port->port.range.to = number;
+	}
+	if (port->type == PORT_NUMERIC)
+	    nb++;
+    }
+    if (nb == 0 || (ranges = malloc(sizeof(struct one_port) * nb)) == NULL)
+	return;
+
+    /* Sort and merge the ranges */
+    for (nb = 0, port = cond->cond.port; port != NULL; port = port->next)
+	if (port->type == PORT_NUMERIC) {
+	    ranges[nb] = port->port.range;
+	    if (ranges[nb].from > ranges[nb].to) {
+		ranges[nb].from = port->port.range.to;
+		ranges[nb].to = port->port.range.from;
+	    }
+	    nb++;
+	}
+    qsort(ranges, nb, sizeof(struct one_port), cmp_range);
+    for (i = 1, last = 0; i < nb; i++)
+	if ((unsigned long) ranges[i].from
+		<= (unsigned long) ranges[last].to + 1) {
+	    if (ranges[i].to > ranges[last].to)
+		ranges[last].to = ranges[i].to;
+	} else
+	    ranges[++last] = ranges[i];
+
+    /* Put them back in the list, the names being kept after them */
+    for (i = 0, port = cond->cond.port; port != NULL; port = next) {
+	next = port->next;
+	if (port->type == PORT_NAME) {
+	    *names_tail = port;
+	    names_tail = &port->next;
+	} else if (i <= last) {
+	    port->port.range = ranges[i++];
+	    *tail = port;
+	    tail = &port->next;
+	} else
+	    mem_free(port);
+    }
+    *names_tail = NULL;
+    *tail = names;
+
+    free(ranges);
+}
+
+/*
+ * Sort port ranges by their first port
+ */
+static int cmp_range(const void *const a, const void *const b)
+{
+    const struct one_port *const range_a = a, *const range_b = b;
+
+    return range_a->from < range_b->from ? -1
+	   : range_a->from > range_b->from ? 1 : 0;
+}
+
+/*****************************************************************************
+ *
+ * Prefix Trie Functions
+ *
+ */
+
+/* Bit following the first len ones of an address, and mask of a prefix */
+#define TRIE_BIT(net, len) (((net) >> (31 - (len))) & 1)
+#define TRIE_MASK(len) \
+    ((len) == 0 ? 0UL : (0xFFFFFFFFUL << (32 - (len))) & 0xFFFFFFFFUL)
+
+/*
+ * Create a trie node
+ */
+static struct trie *trie_new(const unsigned long net, const unsigned len,
+			     const enum bool full)
+{
+    struct trie *node;
+
+    if ((node = malloc(sizeof(struct trie))) != NULL) {
+	node->child[0] = node->child[1] = NULL;
+	node->net = net;
+	node->len = len;
+	node->full = full;
+    }
+    return node;
+}
+
+/*
+ * Free a trie node and its children
+ */
+static void trie_free(struct trie *const node)
+{
+    if (node == NULL)
+	return;
+
+    trie_free(node->child[0]);
+    trie_free(node->child[1]);
+    free(node);
+}
+
+/*
+ * Add a network prefix to a trie
+ */
+static enum bool trie_insert(struct trie *node,
+			     const struct prefix *const prefix)
+{
+    struct trie *child, *split;
+    unsigned bit, len;
+    unsigned long diff;
+
+    for (;;) {
+	/* Already in the set */
+	if (node->full == TRUE)
+	    return TRUE;
+
+	/* The node itself: its children are contained in it */
+	if (prefix->len == node->len) {
+	    trie_free(node->child[0]);
+	    trie_free(node->child[1]);
+	    node->child[0] = node->child[1] = NULL;
+	    node->full = TRUE;
+	    return TRUE;
+	}
+
+	/* No child on this side yet */
+	bit = (unsigned) TRIE_BIT(prefix->net, node->len);
+	if ((child = node->child[bit]) == NULL)
+	    return (node->child[bit] = trie_new(prefix->net, prefix->len,
+						TRUE)) != NULL ? TRUE : FALSE;
+
+	/* Length of the prefix common to the child and the new one */
+	diff = prefix->net ^ child->net;
+	for (len = node->len + 1; len < child->len && len < prefix->len
+	     && (diff & (0x80000000UL >> len)) == 0; len++)
+	    ;
+
+	/* Go down if the child contains the new prefix */
+	if (len == child->len) {
+	    node = child;
+	    continue;
+	}
+
+	/* Replace the child if the new prefix contains it */
+	if (len == prefix->len) {
+	    if ((split = trie_new(prefix->net, prefix->len, TRUE)) == NULL)
+		return FALSE;
+	    trie_free(child);
+	    node->child[bit] = split;
+	    return TRUE;
+	}
+
+	/* Otherwise, split the path where they differ */
+	if ((split = trie_new(prefix->net & TRIE_MASK(len), len, FALSE))
+		== NULL)
+	    return FALSE;
+	bit = (unsigned) TRIE_BIT(prefix->net, len);
+	if ((split->child[bit] = trie_new(prefix->net, prefix->len, TRUE))
+		== NULL) {
+	    free(split);
+	    return FALSE;
+	}
+	split->child[!bit] = child;
+	node->child[(unsigned) TRIE_BIT(prefix->net, node->len)] = split;
+	return TRUE;
+    }
+}
+
+/*
+ * Merge the adjacent prefixes: a node whose two halves are full is full
+ */
+static void trie_merge(struct trie *const node)
+{
+    struct trie *const zero = node->child[0], *const one = node->child[1];
+
+    if (node->full == TRUE)
+	return;
+
+    if (zero != NULL)
+	trie_merge(zero);
+    if (one != NULL)
+	trie_merge(one);
+    if (zero != NULL && one != NULL && zero->full == TRUE && one->full == TRUE
+	&& zero->len == node->len + 1 && one->len == node->len + 1) {
+	trie_free(zero);
+	trie_free(one);
+	node->child[0] = node->child[1] = NULL;
+	node->full = TRUE;
+    }
+}
+
+/*
+ * Count the prefixes of a trie
+ */
+static unsigned trie_count(const struct trie *const node)
+{
+    if (node == NULL)
+	return 0;
+    if (node->full == TRUE)
+	return 1;
+
+    return trie_count(node->child[0]) + trie_count(node->child[1]);
+}
+
+/*
+ * Append the prefixes of a trie to an address list, in address order;
+ * return the new end of the list, or NULL if there is not enough memory
+ */
+static struct addr **trie_addrs(const struct trie *const node,
+				struct addr **tail)
+{
+    struct addr *addr;
+
+    if (node == NULL)
+	return tail;
+
+    if (node->full == FALSE) {
+	if ((tail = trie_addrs(node->child[0], tail)) == NULL)
+	    return NULL;
+	return trie_addrs(node->child[1], tail);
+    }
+
+    /* The string is allocated with the structure, to be freed with it */
+    if ((addr = mem_alloc(sizeof(struct addr) + ADDR_SIZE)) == NULL)
+	return NULL;
+    addr->next = NULL;
+    addr->string = (char *) (addr + 1);
+    sprintf(addr->string, "%lu.%lu.%lu.%lu", (node->net >> 24) & 0xFF,
+	    (node->net >> 16) & 0xFF, (node->net >> 8) & 0xFF,
+	    node->net & 0xFF);
+    if (node->len < 32)
+	sprintf(addr->string + strlen(addr->string), "/%u", node->len);
+
+    *tail = addr;
+    return &addr->next;
+}
+
+/* End of File */
@@ -0,0 +1,334 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/output.c
+ *
+ * Description: Output Sink
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* ./configure result */
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+/* System headers */
+#include <stdlib.h> /* NULL, malloc(), realloc(), free() */
+#include <stdio.h>  /* FILE *, fflush(), fileno()         */
+#include <string.h> /* strlen(), memcpy(), memset()       */
+#include <stdarg.h> /* va_list, va_start(), va_arg()      */
+#include <errno.h>  /* errno, EINTR                       */
+#include <limits.h> /* IOV_MAX                            */
+#include <unistd.h> /* write()                            */
+#if HAVE_SYS_UIO_H
+#include <sys/uio.h> /* writev(), struct iovec */
+#endif /* HAVE_SYS_UIO_H */
+
+/* Local headers */
+#include "structs.h"
+#include "output.h"
+
+
+/*****************************************************************************
+ *
+ * Local Datatypes and Variables
+ *
+ */
+
+/* Size of the buffer of a file sink (written when full) */
+#define SINK_SIZE 1048576
+
+/* Initial size of a memory sink */
+#define MEMORY_SIZE 1024
+
+/* Maximum number of pieces written at once */
+#ifdef IOV_MAX
+# define MAX_PIECES IOV_MAX
+#else
+# define MAX_PIECES 16
+#endif /* IOV_MAX */
+
+
+/*****************************************************************************
+ *
+ * Local Functions
+ *
+ */
+
+/*
+ * Write some text to a file descriptor, even if it takes several calls
+ */
+static enum bool write_all(const int fd, const char *data, size_t len)
+{
+    ssize_t nb;
+
+    while (len != 0) {
+	if ((nb = write(fd, data, len)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return FALSE;
+	}
+	data += nb;
+	len -= (size_t) nb;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Make room for some text in the buffer of a sink; return FALSE if it has
+ * to be written directly
+ */
+static enum bool reserve(struct out_sink *const sink, const size_t len)
+{
+    size_t max;
+    char *data;
+
+    if (sink->fd >= 0) {
+	/* File sink: write what is buffered when full */
+	if (sink->len + len > sink->max)
+	    out_flush(sink);
+	if (len > sink->max)
+	    return FALSE;
+	if (sink->data == NULL
+	    && (sink->data = malloc(sink->max)) == NULL)
+	    return FALSE;
+	return TRUE;
+    }
+
+    /* Memory sink: grow */
+    if (sink->len + len <= sink->max)
+	return TRUE;
+    for (max = sink->max != 0 ? sink->max : MEMORY_SIZE;
+	 sink->len + len > max; max *= 2)
+	;
+    if ((data = realloc(sink->data, max)) == NULL) {
+	sink->failed = TRUE;
+	return FALSE;
+    }
+    sink->data = data;
+    sink->max = max;
+    return TRUE;
+}
+
+
+/*****************************************************************************
+ *
+ * Global Functions
+ *
+ */
+
+/*
+ * Initialize a sink writing to a file; the file must not be used through
+ * the standard I/O functions until the sink is closed
+ */
+void out_open(struct out_sink *const sink, FILE *const file)
+{
+    fflush(file);
+    sink->data = NULL;
+    sink->len = 0;
+    sink->max = SINK_SIZE;
+    sink->fd = fileno(file);
+    sink->failed = FALSE;
+}
+
+/*
+ * Initialize a sink keeping everything in memory
+ */
+void out_memory(struct out_sink *const sink)
+{
+    sink->data = NULL;
+    sink->len = sink->max = 0;
+    sink->fd = -1;
+    sink->failed = FALSE;
+}
+
+/*
+ * Write what is buffered and release the sink; return FALSE if some text
+ * could not be output
+ */
+enum bool out_close(struct out_sink *const sink)
+{
+    out_flush(sink);
+    free(sink->data);
+    sink->data = NULL;
+    sink->len = 0;
+
+    return sink->failed == TRUE ? FALSE : TRUE;
+}
+
+/*
+ * Write what is buffered (nothing is done for a memory sink)
+ */
+void out_flush(struct out_sink *const sink)
+{
+    if (sink->fd < 0 || sink->len == 0)
+	return;
+
+    if (write_all(sink->fd, sink->data, sink->len) == FALSE)
+	sink->failed = TRUE;
+    sink->len = 0;
+}
+
+/*
+ * Output some text
+ */
+void out_text(struct out_sink *const sink, const char *const data,
+	      const size_t len)
+{
+    if (reserve(sink, len) == TRUE) {
+	memcpy(sink->data + sink->len, data, len);
+	sink->len += len;
+    } else if (sink->fd >= 0 && write_all(sink->fd, data, len) == FALSE)
+	sink->failed = TRUE;
+}
+
+/*
+ * Output a string
+ */
+void out_str(struct out_sink *const sink, const char *const string)
+{
+    out_text(sink, string, strlen(string));
+}
+
+/*
+ * Output several strings, the last argument being a NULL pointer
+ */
+void out_strs(struct out_sink *const sink, ...)
+{
+    const char *string;
+    va_list args;
+
+    va_start(args, sink);
+    while ((string = va_arg(args, const char *)) != NULL)
+	out_text(sink, string, strlen(string));
+    va_end(args);
+}
+
+/*
+ * Output a character
+ */
+void out_char(struct out_sink *const sink, const int c)
+{
+    if (sink->len < sink->max && sink->data != NULL)
+	sink->data[sink->len++] = (char) c;
+    else {
+	const char tmp = (char) c;
+	out_text(sink, &tmp, 1);
+    }
+}
+
+/*
+ * Output a character several times
+ */
+void out_fill(struct out_sink *const sink, const int c, const unsigned nb)
+{
+    if (reserve(sink, nb) == TRUE) {
+	memset(sink->data + sink->len, c, nb);
+	sink->len += nb;
+    } else {
+	unsigned i;
+
+	for (i = 0; i < nb; i++)
+	    out_char(sink, c);
+    }
+}
+
+/*
+ * Output a decimal number
+ */
+void out_number(struct out_sink *const sink, unsigned long number)
+{
+    char digits[3 * sizeof(unsigned long)];
+    unsigned pos = sizeof(digits);
+
+    do {
+	digits[--pos] = (char) ('0' + number % 10);
+	number /= 10;
+    } while (number != 0);
+
+    out_text(sink, digits + pos, sizeof(digits) - pos);
+}
+
+/*
+ * Output several pieces of text; a file sink writes them at once
+ */
+void out_pieces(struct out_sink *const sink,
+		const struct out_piece *pieces, unsigned nb)
+{
+#if HAVE_SYS_UIO_H
+    struct iovec iov[MAX_PIECES > 1024 ? 1024 : MAX_PIECES];
+    unsigned count, i;
+    size_t total;
+    ssize_t done;
+
+    if (sink->fd >= 0) {
+	out_flush(sink);
+	while (nb != 0) {
+	    count = nb < sizeof(iov) / sizeof(*iov)
+		    ? nb : sizeof(iov) / sizeof(*iov);
+	    for (i = 0, total = 0; i < count; i++) {
+		iov[i].iov_base = (void *) pieces[i].data;
+		iov[i].iov_len = pieces[i].len;
+		total += pieces[i].len;
+	    }
+
+	    if ((done = writev(sink->fd, iov, (int) count)) < 0) {
+		if (errno == EINTR)
+		    continue;
+		sink->failed = TRUE;
+		return;
+	    }
+
+	    /* Partial write: finish the piece being written */
+	    if ((size_t) done < total) {
+		for (i = 0; (size_t) done >= pieces[i].len; i++)
+		    done -= (ssize_t) pieces[i].len;
+		if (write_all(sink->fd, pieces[i].data + done,
+			      pieces[i].len - (size_t) done) == FALSE) {
+		    sink->failed = TRUE;
+		    return;
+		}
+		count = i + 1;
+	    }
+	    pieces += count;
+	    nb -= count;
+	}
+	return;
+    }
+#endif /* HAVE_SYS_UIO_H */
+
+    for (; nb != 0; nb--, pieces++)
+	out_text(sink, pieces->data, pieces->len);
+}
+
+/* End of File */
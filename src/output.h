@@ -0,0 +1,82 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/output.h
+ *
+ * Description: Output Sink Header
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+
+/* Process only once */
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+/* C++ protection */
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* System headers */
+#include <stddef.h> /* size_t */
+#include <stdio.h>  /* FILE * */
+
+/* Output sink: an append buffer, either kept in memory or written to a
+ * file with large write() calls once it is full */
+struct out_sink {
+    char *data;       /* Buffered text                        */
+    size_t len, max;  /* Used and allocated sizes             */
+    int fd;           /* File descriptor, -1 for memory only  */
+    enum bool failed; /* Wether some text could not be output */
+};
+
+/* Piece of text written by out_pieces() */
+struct out_piece {
+    const char *data; /* Text (not NUL-terminated) */
+    size_t len;       /* Length of the text        */
+};
+
+/* Output sink functions */
+void out_open(struct out_sink *sink, FILE *file);
+void out_memory(struct out_sink *sink);
+enum bool out_close(struct out_sink *sink);
+void out_flush(struct out_sink *sink);
+void out_text(struct out_sink *sink, const char *data, size_t len);
+void out_str(struct out_sink *sink, const char *string);
+void out_strs(struct out_sink *sink, ...);
+void out_char(struct out_sink *sink, int c);
+void out_fill(struct out_sink *sink, int c, unsigned nb);
+void out_number(struct out_sink *sink, unsigned long number);
+void out_pieces(struct out_sink *sink, const struct out_piece *pieces,
+		unsigned nb);
+
+/* C++ protection */
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !OUTPUT_H */
+
+/* End of File */
@@ -42,9 +42,7 @@
 
 #include "structs.h"
 #include "memory.h"
-
-/* The first defined chain */
-struct chain *config;
+#include "loader.h"
 
 
 /*****************************************************************************
@@ -53,24 +51,28 @@ struct chain *config;
  *
  */
 
-/* Yacc needs yylex() to be defined */
-extern int yylex(void);
-
 /* Yacc needs this... */
 #ifdef __GNUC__
 #define UNUSED __attribute__((__unused__))
 #else
 #define UNUSED
 #endif
-static void yyerror(char *string UNUSED)
+static void yyerror(void *scanner UNUSED, struct job *job UNUSED,
+		    const char *string UNUSED)
 {}
 
 %}
 
+/* The parser is reentrant: each file is parsed by its own job, possibly at
+ * the same time as other ones */
+%define api.pure
+%parse-param {void *scanner}
+%parse-param {struct job *job}
+%lex-param {void *scanner}
+
 /* The union used to return values from symbols */
 %union {
     struct chain       *chain_val;     /* Chain          */
-    const struct chain *chain_cval;    /* Constant chain */
     struct action      *action_val;    /* Action         */
     struct test        *test_val;      /* Test           */
     struct expr        *expr_val;      /* Expression     */
@@ -82,10 +84,19 @@ static void yyerror(char *string UNUSED)
     enum direction      dir_val;       /* Direction      */
     struct one_port     port_val;      /* Just one port  */
     char               *string;        /* Simple string  */
+    unsigned            src_val;       /* Source line    */
 }
 
+%{
+/* Yacc needs yylex() to be defined (in lexer.l) */
+extern int yylex(YYSTYPE *lvalp, void *scanner);
+
+/* Count the scanned tokens, for the statistics */
+#define yylex(lvalp, scanner) (job->tokens++, yylex(lvalp, scanner))
+%}
+
 /* Non terminal symbols */
-%type <chain_val> configuration chain
+%type <chain_val> chain
 %type <action_val> action
 %type <test_val> test
 %type <expr_val> expr
@@ -99,7 +110,7 @@ static void yyerror(char *string UNUSED)
 %token ASSIGN
 %token <final_val> FINAL
 %token <string> NEWCHAIN
-%token <chain_cval> USERCHAIN
+%token <string> USERCHAIN
 
 /* if/then/else keywords */
 %token IF THEN ELSE
@@ -122,7 +133,8 @@ static void yyerror(char *string UNUSED)
 %token <port_val> PORT
 %token <string> PORTNAME
 
-/* A simple malloc()'ed string, returned by several terminal symbols */
+/* A string pointing inside the input buffer, returned by several terminal
+ * symbols */
 %token <string> ADDR
 
 /* Invalid token */
@@ -140,25 +152,29 @@ static void yyerror(char *string UNUSED)
  *
  */
 
-/* A configuration: a chain ensemble */
+/* A configuration: a chain ensemble, possibly empty (includes only) */
 configuration:
-    chain configuration {
-	$1->next = $2;
-	$$ = $1;
-    } | chain {
-	$$ = $1;
-    };
+    configuration chain {
+	if ($2 != NULL) {
+	    if (job->tail == NULL)
+		job->config = $2;
+	    else
+		job->tail->next = $2;
+	    job->tail = $2;
+	    job->nb_chains++;
+	}
+    } | ;
 
-/* A chain definition */
+/* A chain definition; the source IDs get the line of the first token of
+ * a construct, which is the last scanned one when nothing else needs to be
+ * read to reduce it (see loader.c for the file) */
 chain:
-    NEWCHAIN ASSIGN action CHAINSEP {
+    NEWCHAIN { $<src_val>$ = get_line(scanner); } ASSIGN action CHAINSEP {
 	if (($$ = mem_alloc(sizeof(struct chain))) != NULL) {
 	    $$->next = NULL;
 	    $$->name = $1;
-	    $$->action = $3;
-
-	    if (config == NULL)
-		config = $$;
+	    $$->action = $4;
+	    $$->src = $<src_val>2;
 	}
     };
 
@@ -169,28 +185,41 @@ action:
 	if (($$ = mem_alloc(sizeof(struct action))) != NULL) {
 	    $$->type = TARGET_FINAL;
 	    $$->action.final = $1;
+	    $$->src = get_line(scanner);
 	}
     } | USERCHAIN { /* Extension */
-	/* User-defined action chain */
-	if (($$ = mem_alloc(sizeof(struct action))) != NULL) {
+	/* User-defined action chain: the chain may be defined later or in
+	 * another file, so only its name is known yet; this chain without
+	 * action is replaced by the definition when the files are linked */
+	struct chain *ref;
+
+	if (($$ = mem_alloc(sizeof(struct action))) != NULL
+	    && (ref = mem_alloc(sizeof(struct chain))) != NULL) {
+	    ref->next = NULL;
+	    ref->name = $1;
+	    ref->action = NULL;
 	    $$->type = TARGET_USER;
-	    $$->action.user = $1;
+	    $$->action.user = ref;
+	    $$->src = get_line(scanner);
 	}
     } | test {
 	/* Conditional actions */
 	if (($$ = mem_alloc(sizeof(struct action))) != NULL) {
 	    $$->type = TARGET_TEST;
 	    $$->action.test = $1;
+	    $$->src = $1->src;
 	}
     };
 
 /* An if/then/else test */
 test:
-    IF expr test_then action ELSE action {
+    IF { $<src_val>$ = get_line(scanner); }
+    expr test_then action ELSE action {
 	if (($$ = mem_alloc(sizeof(struct test))) != NULL) {
-	    $$->expr = $2;
-	    $$->act_then = $4;
-	    $$->act_else = $6;
+	    $$->expr = $3;
+	    $$->act_then = $5;
+	    $$->act_else = $7;
+	    $$->src = $<src_val>2;
 	}
     };
 test_then: THEN | ;
@@ -208,6 +237,7 @@ expr:
 	    $$->type = EXPR_AND;
 	    $$->sub.expr.left = $1;
 	    $$->sub.expr.right = $3;
+	    $$->src = $1->src;
 	}
     } | expr OP_OR expr {
 	if (($$ = mem_alloc(sizeof(struct expr))) != NULL) {
@@ -215,30 +245,34 @@ expr:
 	    $$->type = EXPR_OR;
 	    $$->sub.expr.left = $1;
 	    $$->sub.expr.right = $3;
+	    $$->src = $1->src;
 	}
     } | condition {
 	if (($$ = mem_alloc(sizeof(struct expr))) != NULL) {
 	    $$->not = FALSE;
 	    $$->type = EXPR_COND;
 	    $$->sub.cond = $1;
+	    $$->src = $1->src;
 	}
     };
 
 /* A simple condition */
 condition:
-    IP direction addrs {
+    IP { $<src_val>$ = get_line(scanner); } direction addrs {
 	if (($$ = mem_alloc(sizeof(struct condition))) != NULL) {
 	    $$->type = COND_ADDR;
 	    $$->proto = $1;
-	    $$->dir = $2;
-	    $$->cond.addr = $3;
+	    $$->dir = $3;
+	    $$->cond.addr = $4;
+	    $$->src = $<src_val>2;
 	}
-    } | PROTO direction ports {
+    } | PROTO { $<src_val>$ = get_line(scanner); } direction ports {
 	if (($$ = mem_alloc(sizeof(struct condition))) != NULL) {
 	    $$->type = COND_PORT;
 	    $$->proto = $1;
-	    $$->dir = $2;
-	    $$->cond.port = $3;
+	    $$->dir = $3;
+	    $$->cond.port = $4;
+	    $$->src = $<src_val>2;
 	}
     };
 
@@ -256,16 +290,19 @@ addrs:
 	$1->next = NULL;
 	$$ = $1;
     } | LIST_BEGIN addrlist LIST_END {
-	$$ = $2;
+	$$ = $2->next;
+	$2->next = NULL;
     };
 
-/* An address list */
+/* An address list: its last element, the list being circular until it is
+ * complete (left recursion keeps long lists off the parser stack) */
 addrlist:
-    addr LIST_SEP addrlist {
+    addrlist LIST_SEP addr {
+	$3->next = $1->next;
 	$1->next = $3;
-	$$ = $1;
+	$$ = $3;
     } | addr {
-	$1->next = NULL;
+	$1->next = $1;
 	$$ = $1;
     };
 
@@ -283,16 +320,19 @@ ports:
 	$1->next = NULL;
 	$$ = $1;
     } | LIST_BEGIN portlist LIST_END {
-	$$ = $2;
+	$$ = $2->next;
+	$2->next = NULL;
     };
 
-/* A port list */
+/* A port list: its last element, the list being circular until it is
+ * complete (left recursion keeps long lists off the parser stack) */
 portlist:
-    port LIST_SEP portlist {
+    portlist LIST_SEP port {
+	$3->next = $1->next;
 	$1->next = $3;
-	$$ = $1;
+	$$ = $3;
     } | port {
-	$1->next = NULL;
+	$1->next = $1;
 	$$ = $1;
     };
 
@@ -319,35 +359,29 @@ port:
  *
  */
 
-/* Lex text buffer, defined in lexer.l */
-extern char *yytext;
-
-/* Extern functions defined in lexer.l */
-extern enum bool begin_file(const char *name);
-extern const char *get_file(void);
-extern unsigned get_line(void);
-
 /*
- * Parse a configuration file, or standard input if filename is NULL
+ * Parse the file of a job (see loader.c), or standard input if it has no
+ * name; the chains are stored in the job
  */
-struct chain *parse_config(const char *const filename)
+enum bool parse_job(struct job *const job)
 {
-    if (begin_file(filename) == FALSE)
-	return NULL;
+    void *scanner;
 
-    /* Initialize variables */
-    config = NULL;
+    if (begin_file(job, &scanner) == FALSE)
+	return FALSE;
 
     /* Parse input/file */
-    if (yyparse() != 0) {
+    if (yyparse(scanner, job) != 0) {
 	fprintf(stderr,
-		"Parsing error: file \"%s\", line %d, near \"%s\".\n",
-		get_file(), get_line(), yytext);
-	mem_free_all();
-	return NULL;
+		"Parsing error: file \"%s\", line %u, near \"%s\".\n",
+		job->name != NULL ? job->name : "-", get_line(scanner),
+		get_text(scanner));
+	end_file(scanner);
+	return FALSE;
     }
 
-    return config;
+    end_file(scanner);
+    return TRUE;
 }
 
 /* End of File */
@@ -0,0 +1,747 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/profile.c
+ *
+ * Description: Profile-Guided Reordering of the Tests
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* System headers */
+#include <stdlib.h> /* NULL, malloc(), free(), strtoul(), qsort() */
+#include <stdio.h>  /* FILE *                                        */
+#include <string.h> /* strcmp()                                      */
+
+/* Local headers */
+#include "structs.h"
+#include "hashtab.h"
+#include "counters.h"
+#include "profile.h"
+
+
+/*****************************************************************************
+ *
+ * Local Datatypes and Variables
+ *
+ */
+
+/* Number of port values */
+#define PORT_SPACE 65536.0
+
+/* Value counted by the profile: a network prefix (the network address and
+ * its length) or a port range (the first and last ports) */
+struct entry {
+    struct hsh_elem elem;   /* Hash table element                */
+    enum cond_type type;    /* Address or port                   */
+    enum direction dir;     /* Matched direction                 */
+    unsigned long from, to; /* Value                             */
+    double packets;         /* Packets counted by matching rules */
+};
+
+/* Matching options of the saved rules */
+struct option {
+    const char *name;    /* Option name      */
+    enum cond_type type; /* Value type       */
+    enum direction dir;  /* Value direction  */
+};
+
+/* List element, expression operand or cascade arm to be sorted */
+struct item {
+    void *ptr;      /* Element, operand or arm expression     */
+    void *aux;      /* Action taken by an arm                 */
+    double share;   /* Estimated share of the matched packets */
+    unsigned index; /* Original position, for a stable sort   */
+};
+
+/* Range of values matched by an arm of a cascade */
+struct interval { unsigned long from, to; };
+
+/* Options giving the values, as written by iptables-save */
+static const struct option options[] = {
+    { "-s",                  COND_ADDR, DIR_SRC  },
+    { "--source",            COND_ADDR, DIR_SRC  },
+    { "-d",                  COND_ADDR, DIR_DST  },
+    { "--destination",       COND_ADDR, DIR_DST  },
+    { "--sport",             COND_PORT, DIR_SRC  },
+    { "--source-port",       COND_PORT, DIR_SRC  },
+    { "--sports",            COND_PORT, DIR_SRC  },
+    { "--source-ports",      COND_PORT, DIR_SRC  },
+    { "--dport",             COND_PORT, DIR_DST  },
+    { "--destination-port",  COND_PORT, DIR_DST  },
+    { "--dports",            COND_PORT, DIR_DST  },
+    { "--destination-ports", COND_PORT, DIR_DST  },
+    { "--ports",             COND_PORT, DIR_BOTH }
+};
+
+/* Hash table */
+static struct hsh_table entries = { NULL, 0, 0 };
+
+/* Packets of the most used rule, taken as the whole traffic */
+static double total = 0;
+
+/* Profile functions */
+static enum bool add_rule(double packets, double bytes, char **tokens);
+static unsigned long hash_value(enum cond_type type, enum direction dir,
+				unsigned long from, unsigned long to);
+static enum bool same_value(const struct hsh_elem *elem, const void *key);
+static struct entry *find_entry(enum cond_type type, enum direction dir,
+				unsigned long from, unsigned long to);
+static enum bool add_packets(enum cond_type type, enum direction dir,
+			     unsigned long from, unsigned long to,
+			     double packets);
+static enum bool add_value(const struct option *option, char *value,
+			   double packets);
+static double get_share(enum cond_type type, enum direction dir,
+			unsigned long from, unsigned long to, double space);
+
+/* Reordering functions */
+static void prf_action(struct action *action);
+static unsigned prf_cascade(struct action *action);
+static double prf_expr(struct expr *expr);
+static double prf_cond(struct condition *cond);
+
+/* Auxiliary functions */
+static const struct condition *arm_cond(const struct action *action,
+					const struct condition *first);
+static unsigned get_intervals(const struct condition *cond,
+			      struct interval *ints);
+static double addr_share(const struct condition *cond,
+			 const struct addr *addr);
+static double port_share(const struct condition *cond,
+			 const struct port *port);
+static int cmp_interval(const void *a, const void *b);
+static int cmp_desc(const void *a, const void *b);
+static int cmp_asc(const void *a, const void *b);
+
+
+/*****************************************************************************
+ *
+ * Global Functions
+ *
+ */
+
+/*
+ * Read the packet counters of the rules, from the output of "iptables-save
+ * -c"; the counters of a rule are added to each address or port it matches,
+ * so that they can be found back from the conditions whichever chain the
+ * rule is in.  Return FALSE if there is not enough memory.
+ */
+enum bool prf_read(FILE *const in)
+{
+    return cnt_read(in, add_rule);
+}
+
+/*
+ * Reorder the tests of the configuration, without changing its meaning:
+ * the most frequently matching list elements, OR operands and cascade arms
+ * first, and the least frequently matching AND operands first; the
+ * frequencies come from the profile read with prf_read(), or are estimated
+ * from the sizes of the ranges for the values it doesn't count
+ */
+void prf_config(struct chain *config)
+{
+    for (; config != NULL; config = config->next)
+	prf_action(config->action);
+}
+
+/*
+ * Forget the profile
+ */
+void prf_free(void)
+{
+    hsh_free(&entries, TRUE);
+    total = 0;
+}
+
+
+/*****************************************************************************
+ *
+ * Profile Functions
+ *
+ */
+
+/*
+ * Add the packets of a saved rule to each value it matches, the negated
+ * ones being ignored
+ */
+static enum bool add_rule(const double packets, const double bytes,
+			  char **tokens)
+{
+    const struct option *option;
+    enum bool negated = FALSE;
+    unsigned i;
+
+    (void) bytes;
+    if (packets <= 0)
+	return TRUE;
+    if (packets > total)
+	total = packets;
+
+    for (; *tokens != NULL; tokens++) {
+	if (strcmp(*tokens, "!") == 0) {
+	    negated = TRUE;
+	    continue;
+	}
+
+	for (i = 0, option = NULL;
+	     i < sizeof(options) / sizeof(struct option); i++)
+	    if (strcmp(*tokens, options[i].name) == 0) {
+		option = &options[i];
+		break;
+	    }
+	if (option != NULL && *++tokens != NULL && negated == FALSE
+	    && add_value(option, *tokens, packets) == FALSE)
+	    return FALSE;
+	if (*tokens == NULL)
+	    break;
+	negated = FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Compute the hash value of a counted value
+ */
+static unsigned long hash_value(const enum cond_type type,
+				const enum direction dir,
+				const unsigned long from,
+				const unsigned long to)
+{
+    unsigned long hash = HASH_SEED;
+
+    hash = HASH_MIX(hash, (unsigned long) type * 3 + (unsigned long) dir);
+    hash = HASH_MIX(hash, from);
+    return HASH_MIX(hash, to);
+}
+
+/*
+ * Check if an entry counts the same value as another one
+ */
+static enum bool same_value(const struct hsh_elem *const elem,
+			    const void *const key)
+{
+    const struct entry *const a = (const struct entry *) elem;
+    const struct entry *const b = key;
+
+    return a->type == b->type && a->dir == b->dir && a->from == b->from
+	   && a->to == b->to ? TRUE : FALSE;
+}
+
+/*
+ * Find the entry of a value, NULL if there is none
+ */
+static struct entry *find_entry(const enum cond_type type,
+				const enum direction dir,
+				const unsigned long from,
+				const unsigned long to)
+{
+    struct entry key;
+
+    key.type = type;
+    key.dir = dir;
+    key.from = from;
+    key.to = to;
+    return (struct entry *) hsh_find(&entries,
+				     hash_value(type, dir, from, to),
+				     same_value, &key);
+}
+
+/*
+ * Add packets to the counter of a value, creating it if needed
+ */
+static enum bool add_packets(const enum cond_type type,
+			     const enum direction dir,
+			     const unsigned long from, const unsigned long to,
+			     const double packets)
+{
+    struct entry *ent;
+
+    if ((ent = find_entry(type, dir, from, to)) != NULL) {
+	ent->packets += packets;
+	return TRUE;
+    }
+
+    if ((ent = malloc(sizeof(struct entry))) == NULL)
+	return FALSE;
+    ent->type = type;
+    ent->dir = dir;
+    ent->from = from;
+    ent->to = to;
+    ent->packets = packets;
+    if (hsh_add(&entries, &ent->elem, hash_value(type, dir, from, to))
+	    == FALSE) {
+	free(ent);
+	return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Count the packets of a rule for the value of one of its options: an
+ * address, or a comma-separated list of ports and port ranges ("a:b");
+ * values not generated from a condition (host names...) are ignored
+ */
+static enum bool add_value(const struct option *const option,
+			   char *value, const double packets)
+{
+    struct prefix prefix;
+    unsigned long from, to;
+    char *end;
+
+    if (option->type == COND_ADDR)
+	return string_to_prefix(value, &prefix) == FALSE ? TRUE
+	       : add_packets(COND_ADDR, option->dir, prefix.net,
+			     (unsigned long) prefix.len, packets);
+
+    for (;;) {
+	from = to = strtoul(value, &end, 10);
+	if (end != value && *end == ':')
+	    to = strtoul(value = end + 1, &end, 10);
+	if (end == value || (*end != ',' && *end != '\0')
+	    || from > to || to > 65535)
+	    return TRUE;
+	if (add_packets(COND_PORT, option->dir, from, to, packets) == FALSE)
+	    return FALSE;
+	if (*end == '\0')
+	    return TRUE;
+	value = end + 1;
+    }
+}
+
+/*
+ * Give the share of the packets matching a value: from the profile if it
+ * counted the value, relative to the most used rule, or else the given
+ * share of the possible values it covers
+ */
+static double get_share(const enum cond_type type, const enum direction dir,
+			const unsigned long from, const unsigned long to,
+			const double space)
+{
+    const struct entry *ent;
+    double packets = 0;
+
+    if (dir == DIR_BOTH) {
+	if ((ent = find_entry(type, DIR_SRC, from, to)) != NULL)
+	    packets += ent->packets;
+	if ((ent = find_entry(type, DIR_DST, from, to)) != NULL)
+	    packets += ent->packets;
+    }
+    if ((ent = find_entry(type, dir, from, to)) != NULL)
+	packets += ent->packets;
+
+    if (packets > 0)
+	return packets >= total ? 1.0 : packets / total;
+    return dir == DIR_BOTH ? space * 2 : space;
+}
+
+
+/*****************************************************************************
+ *
+ * Reordering Functions
+ *
+ */
+
+/*
+ * Reorder the tests of an action, following the "else" branches in a loop
+ * so that long cascades don't use the stack
+ */
+static void prf_action(struct action *action)
+{
+    struct test *test;
+    unsigned done = 0;
+
+    for (; action->type == TARGET_TEST; action = test->act_else) {
+	test = action->action.test;
+
+	/* The arms of a cascade have their expressions reordered with it */
+	if (done == 0)
+	    done = prf_cascade(action);
+	if (done == 0)
+	    prf_expr(test->expr);
+	else
+	    done--;
+
+	prf_action(test->act_then);
+    }
+}
+
+/*
+ * Reorder the arms of a cascade "if a then x else if b then y else ...",
+ * when a, b... are conditions on the same value which no packet can match
+ * together; return the number of arms of the cascade, their expressions
+ * being reordered, or zero if it has less than two of them
+ */
+static unsigned prf_cascade(struct action *const action)
+{
+    const struct condition *first = NULL, *cond;
+    struct interval *ints;
+    struct item *items;
+    struct action *arm;
+    unsigned nb = 0, nb_ints = 0, i;
+    unsigned long last = 0;
+    enum bool disjoint = TRUE;
+
+    for (arm = action; arm->type == TARGET_TEST
+			&& (cond = arm_cond(arm, first)) != NULL;
+	 arm = arm->action.test->act_else) {
+	if (first == NULL)
+	    first = cond;
+	nb_ints += get_intervals(cond, NULL);
+	nb++;
+    }
+    if (nb < 2)
+	return 0;
+
+    if ((items = malloc(sizeof(struct item) * nb)) != NULL)
+	for (i = 0, arm = action; i < nb;
+	     i++, arm = arm->action.test->act_else) {
+	    items[i].ptr = arm->action.test->expr;
+	    items[i].aux = arm->action.test->act_then;
+	    items[i].share = prf_expr(arm->action.test->expr);
+	    items[i].index = i;
+	}
+    else {
+	for (i = 0, arm = action; i < nb;
+	     i++, arm = arm->action.test->act_else)
+	    prf_expr(arm->action.test->expr);
+	return nb;
+    }
+
+    /* Check that the values of different arms never overlap */
+    if ((ints = malloc(sizeof(struct interval) * nb_ints)) == NULL)
+	disjoint = FALSE;
+    else {
+	for (i = 0, nb_ints = 0, arm = action; i < nb;
+	     i++, arm = arm->action.test->act_else)
+	    nb_ints += get_intervals(arm->action.test->expr->sub.cond,
+				     ints + nb_ints);
+	qsort(ints, nb_ints, sizeof(struct interval), cmp_interval);
+	for (i = 0; i < nb_ints && disjoint == TRUE; i++) {
+	    if (i > 0 && ints[i].from <= last)
+		disjoint = FALSE;
+	    if (i == 0 || ints[i].to > last)
+		last = ints[i].to;
+	}
+	free(ints);
+    }
+
+    /* Then put the most frequent arms first */
+    if (disjoint == TRUE) {
+	qsort(items, nb, sizeof(struct item), cmp_desc);
+	for (i = 0, arm = action; i < nb;
+	     i++, arm = arm->action.test->act_else) {
+	    arm->action.test->expr = items[i].ptr;
+	    arm->action.test->act_then = items[i].aux;
+	}
+    }
+
+    free(items);
+    return nb;
+}
+
+/*
+ * Reorder the operands of an expression; the operator sequences being
+ * right-leaning lists (see opt_flatten()), each list is sorted as a whole.
+ * Return the estimated share of the packets matching the expression.
+ */
+static double prf_expr(struct expr *const expr)
+{
+    struct expr *node;
+    struct item *items;
+    unsigned nb, i;
+    double share, product = 1;
+
+    if (expr->type == EXPR_COND) {
+	share = prf_cond(expr->sub.cond);
+	return expr->not == TRUE ? 1 - share : share;
+    }
+
+    /* Operands of the list, the last one being the right operand of its
+     * last node */
+    for (nb = 2, node = expr; node->sub.expr.right->type == expr->type
+			      && node->sub.expr.right->not == FALSE;
+	 node = node->sub.expr.right)
+	nb++;
+    items = malloc(sizeof(struct item) * nb);
+
+    for (i = 0, node = expr; i < nb; i++) {
+	share = prf_expr(i < nb - 1 ? node->sub.expr.left
+			 : node->sub.expr.right);
+	product *= expr->type == EXPR_AND ? share : 1 - share;
+	if (items != NULL) {
+	    items[i].ptr = i < nb - 1 ? node->sub.expr.left
+			   : node->sub.expr.right;
+	    items[i].share = share;
+	    items[i].index = i;
+	}
+	if (i < nb - 2)
+	    node = node->sub.expr.right;
+    }
+
+    /* An OR decides as soon as an operand matches, an AND as soon as one
+     * doesn't */
+    if (items != NULL) {
+	qsort(items, nb, sizeof(struct item),
+	      expr->type == EXPR_OR ? cmp_desc : cmp_asc);
+	for (i = 0, node = expr; i < nb - 1; i++) {
+	    node->sub.expr.left = items[i].ptr;
+	    if (i < nb - 2)
+		node = node->sub.expr.right;
+	}
+	node->sub.expr.right = items[nb - 1].ptr;
+	free(items);
+    }
+
+    share = expr->type == EXPR_AND ? product : 1 - product;
+    return expr->not == TRUE ? 1 - share : share;
+}
+
+/*
+ * Put the most frequently matching addresses or ports of a condition first;
+ * return the estimated share of the packets matching the condition
+ */
+static double prf_cond(struct condition *const cond)
+{
+    struct addr *addr, **addr_tail = &cond->cond.addr;
+    struct port *port, **port_tail = &cond->cond.port;
+    struct item *items;
+    unsigned nb = 0, i;
+    double share = 0, elem;
+
+    if (cond->type == COND_ADDR)
+	for (addr = cond->cond.addr; addr != NULL; addr = addr->next)
+	    nb++;
+    else
+	for (port = cond->cond.port; port != NULL; port = port->next)
+	    nb++;
+    items = nb > 1 ? malloc(sizeof(struct item) * nb) : NULL;
+
+    /* Estimate the share of each element */
+    i = 0;
+    if (cond->type == COND_ADDR)
+	for (addr = cond->cond.addr; addr != NULL; addr = addr->next, i++) {
+	    elem = addr_share(cond, addr);
+	    share += elem;
+	    if (items != NULL) {
+		items[i].ptr = addr;
+		items[i].share = elem;
+		items[i].index = i;
+	    }
+	}
+    else
+	for (port = cond->cond.port; port != NULL; port = port->next, i++) {
+	    elem = port_share(cond, port);
+	    share += elem;
+	    if (items != NULL) {
+		items[i].ptr = port;
+		items[i].share = elem;
+		items[i].index = i;
+	    }
+	}
+
+    /* Put them back in the list, sorted */
+    if (items != NULL) {
+	qsort(items, nb, sizeof(struct item), cmp_desc);
+	for (i = 0; i < nb; i++)
+	    if (cond->type == COND_ADDR) {
+		*addr_tail = items[i].ptr;
+		addr_tail = &(*addr_tail)->next;
+	    } else {
+		*port_tail = items[i].ptr;
+		port_tail = &(*port_tail)->next;
+	    }
+	if (cond->type == COND_ADDR)
+	    *addr_tail = NULL;
+	else
+	    *port_tail = NULL;
+	free(items);
+    }
+
+    return share > 1 ? 1 : share;
+}
+
+
+/*****************************************************************************
+ *
+ * Auxiliary Functions
+ *
+ */
+
+/*
+ * Give the condition of a test if it can be an arm of a cascade starting
+ * with the given condition (NULL for the first arm): a single condition
+ * with numeric values only, matching the same direction and protocol
+ */
+static const struct condition *arm_cond(const struct action *const action,
+					const struct condition *const first)
+{
+    const struct expr *const expr = action->action.test->expr;
+    const struct condition *cond;
+    const struct addr *addr;
+    const struct port *port;
+    struct prefix prefix;
+
+    if (expr->type != EXPR_COND || expr->not == TRUE)
+	return NULL;
+    cond = expr->sub.cond;
+    if (cond->dir == DIR_BOTH || (first != NULL
+				  && (cond->type != first->type
+				      || cond->dir != first->dir
+				      || cond->proto != first->proto)))
+	return NULL;
+
+    if (cond->type == COND_ADDR) {
+	if (cond->proto == PROTO_IPV6)
+	    return NULL;
+	for (addr = cond->cond.addr; addr != NULL; addr = addr->next)
+	    if (string_to_prefix(addr->string, &prefix) == FALSE)
+		return NULL;
+    } else
+	for (port = cond->cond.port; port != NULL; port = port->next)
+	    if (port->type != PORT_NUMERIC)
+		return NULL;
+
+    return cond;
+}
+
+/*
+ * Store the ranges of values matched by a numeric condition, unless ints is
+ * NULL; return their number
+ */
+static unsigned get_intervals(const struct condition *const cond,
+			      struct interval *const ints)
+{
+    const struct addr *addr;
+    const struct port *port;
+    struct prefix prefix;
+    unsigned nb = 0;
+
+    if (cond->type == COND_ADDR)
+	for (addr = cond->cond.addr; addr != NULL; addr = addr->next, nb++) {
+	    if (ints == NULL)
+		continue;
+	    string_to_prefix(addr->string, &prefix);
+	    ints[nb].from = prefix.net;
+	    ints[nb].to = prefix.len == 32 ? prefix.net
+			  : prefix.net | (0xFFFFFFFFUL >> prefix.len);
+	}
+    else
+	for (port = cond->cond.port; port != NULL; port = port->next, nb++)
+	    if (ints != NULL) {
+		ints[nb].from = port->port.range.from;
+		ints[nb].to = port->port.range.to;
+	    }
+
+    return nb;
+}
+
+/*
+ * Estimate the share of the packets matching an address of a condition;
+ * without a profile, a prefix matches its share of all addresses, and a
+ * host name a single address
+ */
+static double addr_share(const struct condition *const cond,
+			 const struct addr *const addr)
+{
+    struct prefix prefix;
+    double space = 1;
+    unsigned i;
+
+    if (cond->proto == PROTO_IPV6
+	|| string_to_prefix(addr->string, &prefix) == FALSE) {
+	for (i = 0; i < 32; i++)
+	    space /= 2;
+	return cond->dir == DIR_BOTH ? space * 2 : space;
+    }
+
+    for (i = 0; i < prefix.len; i++)
+	space /= 2;
+    return get_share(COND_ADDR, cond->dir, prefix.net,
+		     (unsigned long) prefix.len, space);
+}
+
+/*
+ * Estimate the share of the packets matching a port range of a condition;
+ * without a profile, a range matches its share of all ports, and a port
+ * name a single port
+ */
+static double port_share(const struct condition *const cond,
+			 const struct port *const port)
+{
+    if (port->type == PORT_NAME)
+	return cond->dir == DIR_BOTH ? 2 / PORT_SPACE : 1 / PORT_SPACE;
+
+    return get_share(COND_PORT, cond->dir, port->port.range.from,
+		     port->port.range.to,
+		     (port->port.range.to - port->port.range.from + 1)
+		     / PORT_SPACE);
+}
+
+/*
+ * Sort intervals by their first value
+ */
+static int cmp_interval(const void *const a, const void *const b)
+{
+    const struct interval *const int_a = a, *const int_b = b;
+
+    return int_a->from < int_b->from ? -1 : int_a->from > int_b->from ? 1 : 0;
+}
+
+/*
+ * Sort items by decreasing share, keeping the order of the equal ones
+ */
+static int cmp_desc(const void *const a, const void *const b)
+{
+    const struct item *const item_a = a, *const item_b = b;
+
+    if (item_a->share != item_b->share)
+	return item_a->share > item_b->share ? -1 : 1;
+    return item_a->index < item_b->index ? -1
+	   : item_a->index > item_b->index ? 1 : 0;
+}
+
+/*
+ * Sort items by increasing share, keeping the order of the equal ones
+ */
+static int cmp_asc(const void *const a, const void *const b)
+{
+    const struct item *const item_a = a, *const item_b = b;
+
+    if (item_a->share != item_b->share)
+	return item_a->share < item_b->share ? -1 : 1;
+    return item_a->index < item_b->index ? -1
+	   : item_a->index > item_b->index ? 1 : 0;
+}
+
+/* End of File */
@@ -0,0 +1,755 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/resolve.c
+ *
+ * Description: Host Names Resolution
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* ./configure result */
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+/* System headers */
+#include <stdlib.h> /* NULL, malloc(), realloc(), free(), qsort(), bsearch() */
+#include <stdio.h>  /* FILE *, fgets(), fprintf(), sprintf()               */
+#include <string.h> /* strlen(), strncmp(), strspn(), strcspn(), memcpy()   */
+#include <time.h>   /* time()                                              */
+#if HAVE_NETDB_H
+#include <sys/types.h>  /* size_t                      */
+#include <sys/socket.h> /* AF_INET, SOCK_STREAM        */
+#include <netinet/in.h> /* struct sockaddr_in, ntohl() */
+#include <netdb.h>      /* getaddrinfo()               */
+#endif /* HAVE_NETDB_H */
+#if HAVE_PTHREAD_H
+#include <pthread.h> /* pthread_create(), pthread_join() */
+#endif /* HAVE_PTHREAD_H */
+
+/* Local headers */
+#include "structs.h"
+#include "memory.h"
+#include "resolve.h"
+
+
+/*****************************************************************************
+ *
+ * Prototypes and Local Variables
+ *
+ */
+
+/* Maximum number of addresses of a host name */
+#define MAX_ADDRS 16
+
+/* Maximum number of names resolved at the same time */
+#define MAX_RESOLVERS 8
+
+/* Time an address stays valid, if the resolver doesn't know */
+#define DEFAULT_TTL 3600
+
+/* Maximum length of a line of a hosts or cache file */
+#define LINE_SIZE 1024
+
+/* Characters separating the fields of a line */
+#define BLANKS " \t\r\n"
+
+/* Host name and its addresses */
+struct host {
+    char *name;                     /* Host name                  */
+    unsigned long addrs[MAX_ADDRS]; /* Addresses, sorted          */
+    unsigned nb_addrs;              /* Number of addresses        */
+    unsigned long expires;          /* Time they stop being valid */
+    enum bool fresh;                /* Wether just resolved       */
+};
+
+/* Array of host names, sorted by name once complete */
+struct hosts {
+    struct host *hosts;   /* Host names                 */
+    unsigned nb, max;     /* Used and allocated entries */
+};
+
+/* Key of a host name lookup: the name may be followed by a mask */
+struct key {
+    const char *name; /* Name          */
+    size_t len;       /* Its length    */
+};
+
+/* Host names table functions */
+static struct host *add_host(struct hosts *table, const char *name,
+			     size_t len);
+static void sort_hosts(struct hosts *table);
+static struct host *find_host(const struct hosts *table, unsigned nb,
+			      const char *name, size_t len);
+static void free_hosts(struct hosts *table);
+static int cmp_host(const void *a, const void *b);
+static int cmp_key(const void *key, const void *host);
+static int cmp_addr(const void *a, const void *b);
+static void add_addrs(struct host *host, const unsigned long *addrs,
+		      unsigned nb);
+
+/* Local functions */
+static unsigned res_hosts_file(const char *name, unsigned long *addrs,
+			       unsigned max, unsigned long *ttl);
+static enum bool res_parse(const char *string, unsigned long *addr);
+static size_t res_name(const char *string);
+static void res_action(struct action *action, enum bool replace);
+static void res_expr(struct expr *expr, enum bool replace);
+static void res_cond(struct condition *cond, enum bool replace);
+static struct addr *res_addrs(const struct host *host, const char *mask,
+			      struct addr **first);
+static void res_run(void);
+static void *res_worker(void *arg);
+
+/* Resolver in use */
+static res_resolver *resolver = res_system;
+
+/* Resolved host names: the ones read from the cache file, the ones of a
+ * hosts file, and the ones of the configuration */
+static struct hosts cache, hosts_file, names;
+
+/* Wether some memory could not be allocated */
+static enum bool no_memory;
+
+/* Host names left to resolve by the threads */
+static struct host **next_host, **end_host;
+#if HAVE_PTHREAD_H
+static pthread_mutex_t host_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif /* HAVE_PTHREAD_H */
+
+
+/*****************************************************************************
+ *
+ * Global Functions
+ *
+ */
+
+/*
+ * Select the resolver used for the host names not found in the cache
+ */
+void res_set_resolver(res_resolver *const func)
+{
+    resolver = func != NULL ? func : res_system;
+}
+
+/*
+ * System resolver (hosts file, DNS, etc. as configured)
+ */
+unsigned res_system(const char *const name, unsigned long *const addrs,
+		    const unsigned max, unsigned long *const ttl)
+{
+    unsigned nb = 0;
+#if HAVE_NETDB_H
+    struct addrinfo hints, *res, *cur;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(name, NULL, &hints, &res) != 0)
+	return 0;
+
+    for (cur = res; cur != NULL && nb < max; cur = cur->ai_next)
+	if (cur->ai_family == AF_INET)
+	    addrs[nb++] = ntohl(((const struct sockaddr_in *)
+				 (const void *) cur->ai_addr)->sin_addr.s_addr)
+			  & 0xFFFFFFFFUL;
+    freeaddrinfo(res);
+#else /* HAVE_NETDB_H */
+    (void) name;
+    (void) addrs;
+    (void) max;
+#endif /* HAVE_NETDB_H */
+
+    *ttl = DEFAULT_TTL;
+    return nb;
+}
+
+/*
+ * Read a hosts file (an address followed by names on each line, "#"
+ * beginning a comment) and resolve the host names with it only; return
+ * FALSE if there is not enough memory
+ */
+enum bool res_hosts(FILE *const in)
+{
+    char line[LINE_SIZE], *pos;
+    unsigned long addr;
+    struct host *host;
+    size_t len;
+
+    resolver = res_hosts_file;
+    while (fgets(line, sizeof(line), in) != NULL) {
+	if ((pos = strchr(line, '#')) != NULL)
+	    *pos = '\0';
+
+	/* Address, then names (IPv6 addresses are ignored) */
+	pos = line + strspn(line, BLANKS);
+	len = strcspn(pos, BLANKS);
+	if (pos[len] == '\0')
+	    continue;
+	pos[len] = '\0';
+	if (res_parse(pos, &addr) == FALSE)
+	    continue;
+
+	for (pos += len + 1, pos += strspn(pos, BLANKS); *pos != '\0';
+	     pos += len, pos += strspn(pos, BLANKS)) {
+	    len = strcspn(pos, BLANKS);
+	    if ((host = add_host(&hosts_file, pos, len)) == NULL)
+		return FALSE;
+	    add_addrs(host, &addr, 1);
+	}
+    }
+
+    sort_hosts(&hosts_file);
+    return TRUE;
+}
+
+/*
+ * Read a resolver cache file; return FALSE on syntax error or if there is
+ * not enough memory
+ */
+enum bool res_read(FILE *const in)
+{
+    char line[LINE_SIZE], *pos, *end;
+    unsigned long expires, addr;
+    struct host *host;
+    size_t len;
+
+    while (fgets(line, sizeof(line), in) != NULL) {
+	if (line[0] == '#' || line[0] == '\n')
+	    continue;
+
+	/* Name and expiry time */
+	len = strcspn(line, BLANKS);
+	expires = strtoul(line + len, &end, 10);
+	if (len == 0 || end == line + len)
+	    return FALSE;
+	if ((host = add_host(&cache, line, len)) == NULL)
+	    return FALSE;
+	host->expires = expires;
+
+	/* Addresses */
+	for (pos = end + strspn(end, BLANKS); *pos != '\0';
+	     pos += strspn(pos, BLANKS)) {
+	    len = strcspn(pos, BLANKS);
+	    end = pos + len;
+	    if (*end != '\0')
+		*end++ = '\0';
+	    if (res_parse(pos, &addr) == FALSE)
+		return FALSE;
+	    add_addrs(host, &addr, 1);
+	    pos = end;
+	}
+    }
+
+    sort_hosts(&cache);
+    return TRUE;
+}
+
+/*
+ * Write the resolver cache file, without the expired entries
+ */
+void res_write(FILE *const out)
+{
+    const unsigned long now = (unsigned long) time(NULL);
+    const struct host *host;
+    unsigned i, j;
+
+    fputs("# RuleWall resolver cache: host name, expiry time and "
+	  "addresses\n", out);
+    for (i = 0, host = cache.hosts; i < cache.nb; i++, host++) {
+	if (host->expires <= now)
+	    continue;
+	fprintf(out, "%s %lu", host->name, host->expires);
+	for (j = 0; j < host->nb_addrs; j++)
+	    fprintf(out, " %lu.%lu.%lu.%lu", (host->addrs[j] >> 24) & 0xFF,
+		    (host->addrs[j] >> 16) & 0xFF,
+		    (host->addrs[j] >> 8) & 0xFF, host->addrs[j] & 0xFF);
+	putc('\n', out);
+    }
+}
+
+/*
+ * Replace the host names of the IPv4 conditions of a configuration by
+ * their addresses: each name is resolved once, the ones missing from the
+ * cache being resolved at the same time; return FALSE if a name is unknown
+ */
+enum bool res_config(struct chain *const config)
+{
+    const unsigned long now = (unsigned long) time(NULL);
+    const unsigned nb_cache = cache.nb;
+    struct host *host, *cached;
+    struct chain *chain;
+    enum bool failed = FALSE;
+    unsigned i;
+
+    /* Get the host names, only once each */
+    no_memory = FALSE;
+    for (chain = config; chain != NULL; chain = chain->next)
+	res_action(chain->action, FALSE);
+    sort_hosts(&names);
+
+    /* Take the valid ones from the cache, then resolve the others */
+    for (i = 0, host = names.hosts; i < names.nb; i++, host++) {
+	cached = find_host(&cache, nb_cache, host->name, strlen(host->name));
+	if (cached != NULL && cached->expires > now) {
+	    add_addrs(host, cached->addrs, cached->nb_addrs);
+	    host->expires = cached->expires;
+	}
+    }
+    res_run();
+
+    /* Check them, and remember the new ones */
+    for (i = 0, host = names.hosts; i < names.nb; i++, host++) {
+	if (host->nb_addrs == 0) {
+	    fprintf(stderr, "Error: cannot resolve host name \"%s\".\n",
+		    host->name);
+	    failed = TRUE;
+	    continue;
+	}
+	if (host->fresh == FALSE)
+	    continue;
+
+	host->expires += now;
+	if ((cached = find_host(&cache, nb_cache, host->name,
+				strlen(host->name))) == NULL
+	    && (cached = add_host(&cache, host->name,
+				  strlen(host->name))) == NULL)
+	    continue;
+	cached->nb_addrs = 0;
+	add_addrs(cached, host->addrs, host->nb_addrs);
+	cached->expires = host->expires;
+    }
+    sort_hosts(&cache);
+
+    /* Replace them */
+    if (failed == FALSE && no_memory == FALSE)
+	for (chain = config; chain != NULL; chain = chain->next)
+	    res_action(chain->action, TRUE);
+    if (no_memory == TRUE) {
+	fputs("Error: not enough memory to resolve the host names.\n",
+	      stderr);
+	failed = TRUE;
+    }
+
+    free_hosts(&names);
+    return failed == TRUE ? FALSE : TRUE;
+}
+
+/*
+ * Forget the cache and the hosts file
+ */
+void res_free(void)
+{
+    free_hosts(&cache);
+    free_hosts(&hosts_file);
+    resolver = res_system;
+}
+
+
+/*****************************************************************************
+ *
+ * Host Names Tables
+ *
+ */
+
+/*
+ * Append a host name to a table (which is not sorted anymore)
+ */
+static struct host *add_host(struct hosts *const table,
+			     const char *const name, const size_t len)
+{
+    struct host *host;
+    unsigned max;
+
+    if (table->nb == table->max) {
+	max = table->max != 0 ? table->max * 2 : 64;
+	if ((host = realloc(table->hosts, sizeof(struct host) * max))
+		== NULL) {
+	    no_memory = TRUE;
+	    return NULL;
+	}
+	table->hosts = host;
+	table->max = max;
+    }
+
+    host = &table->hosts[table->nb];
+    if ((host->name = malloc(len + 1)) == NULL) {
+	no_memory = TRUE;
+	return NULL;
+    }
+    memcpy(host->name, name, len);
+    host->name[len] = '\0';
+    host->nb_addrs = 0;
+    host->expires = 0;
+    host->fresh = FALSE;
+    table->nb++;
+
+    return host;
+}
+
+/*
+ * Sort a table by name, merging the addresses of a name given more than
+ * once (the latest expiry time is kept)
+ */
+static void sort_hosts(struct hosts *const table)
+{
+    struct host *last;
+    unsigned i;
+
+    if (table->nb == 0)
+	return;
+
+    qsort(table->hosts, table->nb, sizeof(struct host), cmp_host);
+    for (i = 1, last = table->hosts; i < table->nb; i++)
+	if (strcmp(table->hosts[i].name, last->name) == 0) {
+	    add_addrs(last, table->hosts[i].addrs,
+		      table->hosts[i].nb_addrs);
+	    if (table->hosts[i].expires > last->expires)
+		last->expires = table->hosts[i].expires;
+	    free(table->hosts[i].name);
+	} else
+	    *++last = table->hosts[i];
+    table->nb = (unsigned) (last - table->hosts) + 1;
+}
+
+/*
+ * Find a host name among the first (sorted) entries of a table
+ */
+static struct host *find_host(const struct hosts *const table,
+			      const unsigned nb, const char *const name,
+			      const size_t len)
+{
+    struct key key;
+
+    if (nb == 0)
+	return NULL;
+
+    key.name = name;
+    key.len = len;
+    return bsearch(&key, table->hosts, nb, sizeof(struct host), cmp_key);
+}
+
+/*
+ * Free a table of host names
+ */
+static void free_hosts(struct hosts *const table)
+{
+    unsigned i;
+
+    for (i = 0; i < table->nb; i++)
+	free(table->hosts[i].name);
+    free(table->hosts);
+    table->hosts = NULL;
+    table->nb = table->max = 0;
+}
+
+/*
+ * Sort host names
+ */
+static int cmp_host(const void *const a, const void *const b)
+{
+    return strcmp(((const struct host *) a)->name,
+		  ((const struct host *) b)->name);
+}
+
+/*
+ * Compare a lookup key with a host name
+ */
+static int cmp_key(const void *const key, const void *const host)
+{
+    const struct key *const k = key;
+    const char *const name = ((const struct host *) host)->name;
+    const int res = strncmp(k->name, name, k->len);
+
+    if (res != 0)
+	return res;
+    return name[k->len] == '\0' ? 0 : -1;
+}
+
+/*
+ * Sort addresses
+ */
+static int cmp_addr(const void *const a, const void *const b)
+{
+    const unsigned long addr_a = *(const unsigned long *) a;
+    const unsigned long addr_b = *(const unsigned long *) b;
+
+    return addr_a < addr_b ? -1 : addr_a > addr_b ? 1 : 0;
+}
+
+/*
+ * Add addresses to a host name, keeping them sorted and unique
+ */
+static void add_addrs(struct host *const host,
+		      const unsigned long *const addrs, const unsigned nb)
+{
+    unsigned i, j;
+
+    for (i = 0; i < nb && host->nb_addrs < MAX_ADDRS; i++) {
+	for (j = 0; j < host->nb_addrs; j++)
+	    if (host->addrs[j] == addrs[i])
+		break;
+	if (j == host->nb_addrs)
+	    host->addrs[host->nb_addrs++] = addrs[i];
+    }
+
+    qsort(host->addrs, host->nb_addrs, sizeof(unsigned long), cmp_addr);
+}
+
+
+/*****************************************************************************
+ *
+ * Local Functions
+ *
+ */
+
+/*
+ * Resolver using the hosts file read
+ */
+static unsigned res_hosts_file(const char *const name,
+			       unsigned long *const addrs,
+			       const unsigned max, unsigned long *const ttl)
+{
+    const struct host *const host
+	    = find_host(&hosts_file, hosts_file.nb, name, strlen(name));
+    unsigned nb;
+
+    *ttl = DEFAULT_TTL;
+    if (host == NULL)
+	return 0;
+
+    nb = host->nb_addrs < max ? host->nb_addrs : max;
+    memcpy(addrs, host->addrs, sizeof(unsigned long) * nb);
+    return nb;
+}
+
+/*
+ * Parse an IPv4 host address
+ */
+static enum bool res_parse(const char *const string,
+			   unsigned long *const addr)
+{
+    struct prefix prefix;
+
+    if (string_to_prefix(string, &prefix) == FALSE || prefix.len != 32)
+	return FALSE;
+
+    *addr = prefix.net;
+    return TRUE;
+}
+
+/*
+ * Get the length of the host name of an address string (before its mask),
+ * or zero if it is a numeric address
+ */
+static size_t res_name(const char *const string)
+{
+    const size_t len = strcspn(string, "/");
+
+    return strspn(string, "0123456789.") == len ? 0 : len;
+}
+
+/*
+ * Look for the host names of an action (or replace them)
+ */
+static void res_action(struct action *const action, const enum bool replace)
+{
+    if (action->type != TARGET_TEST)
+	return;
+
+    res_expr(action->action.test->expr, replace);
+    res_action(action->action.test->act_then, replace);
+    res_action(action->action.test->act_else, replace);
+}
+
+/*
+ * Look for the host names of an expression (or replace them)
+ */
+static void res_expr(struct expr *const expr, const enum bool replace)
+{
+    if (expr->type == EXPR_COND)
+	res_cond(expr->sub.cond, replace);
+    else {
+	res_expr(expr->sub.expr.left, replace);
+	res_expr(expr->sub.expr.right, replace);
+    }
+}
+
+/*
+ * Record the host names of an IPv4 condition, or replace them by their
+ * addresses
+ */
+static void res_cond(struct condition *const cond, const enum bool replace)
+{
+    struct addr *addr, **prev, *first, *last;
+    const struct host *host;
+    size_t len;
+
+    if (cond->type != COND_ADDR || cond->proto == PROTO_IPV6)
+	return;
+
+    for (prev = &cond->cond.addr; (addr = *prev) != NULL;
+	 prev = &addr->next) {
+	if ((len = res_name(addr->string)) == 0)
+	    continue;
+
+	if (replace == FALSE) {
+	    add_host(&names, addr->string, len);
+	    continue;
+	}
+
+	/* One address per resolved one, with the same mask; a name without
+	 * any was already reported by res_config() */
+	if ((host = find_host(&names, names.nb, addr->string, len)) == NULL) {
+	    no_memory = TRUE;
+	    return;
+	}
+	if (host->nb_addrs == 0)
+	    continue;
+	if ((last = res_addrs(host, addr->string + len, &first)) == NULL) {
+	    no_memory = TRUE;
+	    return;
+	}
+	last->next = addr->next;
+	*prev = first;
+	mem_free(addr);
+	addr = last;
+    }
+}
+
+/*
+ * Make the address list of a resolved host name, having at least one
+ * address, each one being followed by the given mask (if any); return its
+ * last element, or NULL if there is not enough memory
+ */
+static struct addr *res_addrs(const struct host *const host,
+			      const char *const mask,
+			      struct addr **const first)
+{
+    const size_t size = sizeof(struct addr) + 16 + strlen(mask);
+    struct addr *list = NULL, **tail = &list, *addr = NULL;
+    unsigned i;
+
+    for (i = 0; i < host->nb_addrs; i++) {
+	/* The string is allocated with the structure, to be freed with it */
+	if ((addr = mem_alloc(size)) == NULL) {
+	    *tail = NULL;
+	    free_addr(list);
+	    return NULL;
+	}
+	addr->string = (char *) (addr + 1);
+	sprintf(addr->string, "%lu.%lu.%lu.%lu%s",
+		(host->addrs[i] >> 24) & 0xFF, (host->addrs[i] >> 16) & 0xFF,
+		(host->addrs[i] >> 8) & 0xFF, host->addrs[i] & 0xFF, mask);
+
+	*tail = addr;
+	tail = &addr->next;
+    }
+
+    *tail = NULL;
+    *first = list;
+    return addr;
+}
+
+/*
+ * Resolve the host names not found in the cache, with a bounded number of
+ * threads
+ */
+static void res_run(void)
+{
+    struct host **pending;
+    unsigned nb = 0, i;
+#if HAVE_PTHREAD_H
+    pthread_t threads[MAX_RESOLVERS];
+    unsigned nb_threads = 0;
+#endif /* HAVE_PTHREAD_H */
+
+    if (names.nb == 0)
+	return;
+    if ((pending = malloc(sizeof(struct host *) * names.nb)) == NULL) {
+	no_memory = TRUE;
+	return;
+    }
+    for (i = 0; i < names.nb; i++)
+	if (names.hosts[i].nb_addrs == 0)
+	    pending[nb++] = &names.hosts[i];
+    next_host = pending;
+    end_host = pending + nb;
+
+#if HAVE_PTHREAD_H
+    /* The current thread is one of the workers */
+    while (nb_threads + 1 < MAX_RESOLVERS && nb_threads + 1 < nb
+	   && pthread_create(&threads[nb_threads], NULL, res_worker,
+			     NULL) == 0)
+	nb_threads++;
+#endif /* HAVE_PTHREAD_H */
+
+    res_worker(NULL);
+
+#if HAVE_PTHREAD_H
+    for (i = 0; i < nb_threads; i++)
+	pthread_join(threads[i], NULL);
+#endif /* HAVE_PTHREAD_H */
+    free(pending);
+}
+
+/*
+ * Resolve host names until there is none left, in each thread; the
+ * expiry time is relative until all of them are done
+ */
+static void *res_worker(void *const arg)
+{
+    unsigned long addrs[MAX_ADDRS], ttl;
+    struct host *host;
+    unsigned nb;
+
+    (void) arg;
+    for (;;) {
+#if HAVE_PTHREAD_H
+	pthread_mutex_lock(&host_mutex);
+#endif /* HAVE_PTHREAD_H */
+	host = next_host != end_host ? *next_host++ : NULL;
+#if HAVE_PTHREAD_H
+	pthread_mutex_unlock(&host_mutex);
+#endif /* HAVE_PTHREAD_H */
+
+	if (host == NULL)
+	    return NULL;
+	ttl = DEFAULT_TTL;
+	if ((nb = resolver(host->name, addrs, MAX_ADDRS, &ttl)) != 0) {
+	    add_addrs(host, addrs, nb);
+	    host->expires = ttl;
+	    host->fresh = TRUE;
+	}
+    }
+}
+
+/* End of File */
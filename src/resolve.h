@@ -0,0 +1,68 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/resolve.h
+ *
+ * Description: Host Names Resolution Header
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/* Process only once */
+#ifndef RESOLVE_H
+#define RESOLVE_H
+
+/* C++ protection */
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* System headers */
+#include <stdio.h> /* FILE * */
+
+/* Resolver: get at most max IPv4 addresses (in host byte order) of a host
+ * name, returning their number (zero if the name is unknown) and setting
+ * the number of seconds the result stays valid; called from several
+ * threads at the same time */
+typedef unsigned res_resolver(const char *name, unsigned long *addrs,
+			      unsigned max, unsigned long *ttl);
+
+/* Host names resolution functions */
+void res_set_resolver(res_resolver *resolver);
+unsigned res_system(const char *name, unsigned long *addrs, unsigned max,
+		    unsigned long *ttl);
+enum bool res_hosts(FILE *in);
+enum bool res_read(FILE *in);
+void res_write(FILE *out);
+enum bool res_config(struct chain *config);
+void res_free(void);
+
+/* C++ protection */
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !RESOLVE_H */
+
+/* End of File */
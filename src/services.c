@@ -0,0 +1,347 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/services.c
+ *
+ * Description: Service Names Cache
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* ./configure result */
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+/* System headers */
+#include <stdlib.h> /* NULL, malloc(), free() */
+#include <stdio.h>  /* FILE *, fopen(), fgets(), fclose() */
+#include <string.h> /* strncmp(), strspn(), strcspn(), memcpy() */
+#if HAVE_NETDB_H
+#include <netdb.h>   /* _PATH_SERVICES */
+#endif /* HAVE_NETDB_H */
+#if HAVE_PTHREAD_H
+#include <pthread.h> /* pthread_mutex_lock() */
+#endif /* HAVE_PTHREAD_H */
+
+/* Local headers */
+#include "structs.h"
+#include "hashtab.h"
+#include "services.h"
+
+
+/*****************************************************************************
+ *
+ * Local Datatypes and Variables
+ *
+ */
+
+/* Services file read if no other one was given */
+#ifdef _PATH_SERVICES
+# define SERVICES_FILE _PATH_SERVICES
+#else
+# define SERVICES_FILE "/etc/services"
+#endif /* _PATH_SERVICES */
+
+/* Maximum length of a line of a services file */
+#define LINE_SIZE 1024
+
+/* Characters separating the fields of a line */
+#define BLANKS " \t\r\n"
+
+/* Service (element of the hash table) */
+struct service {
+    struct hsh_elem elem; /* Hash table element            */
+    enum proto proto;     /* Protocol (TCP or UDP)         */
+    unsigned short port;  /* Port number                   */
+    char name[1];         /* Name, allocated with the rest */
+};
+
+/* Service looked for */
+struct key {
+    const char *name; /* Name, not ended by '\0' */
+    size_t len;       /* Its length              */
+    enum proto proto; /* Protocol                */
+};
+
+/* Hash table */
+static struct hsh_table services = { NULL, 0, 0 };
+
+/* FNV-1a and Bernstein hashes of the services registered, in order */
+static unsigned long content1 = HASH_FNV_SEED, content2 = HASH_SEED;
+
+/* Wether a services file has been read, or the default one tried, since
+ * the last srv_free() */
+static enum bool loaded = FALSE;
+#if HAVE_PTHREAD_H
+static pthread_mutex_t default_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif /* HAVE_PTHREAD_H */
+
+
+/*****************************************************************************
+ *
+ * Local Functions
+ *
+ */
+
+/*
+ * Compute the hash value of a name, for a protocol
+ */
+static unsigned long hash_name(const char *name, const size_t len,
+			       const enum proto proto)
+{
+    unsigned long hash = HASH_SEED + (unsigned long) proto;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+	hash = HASH_MIX(hash, (unsigned char) name[i]);
+
+    return hash;
+}
+
+/*
+ * Check if a service has the name and the protocol of a key
+ */
+static enum bool same_key(const struct hsh_elem *const elem,
+			  const void *const key)
+{
+    const struct service *const srv = (const struct service *) elem;
+    const struct key *const k = key;
+
+    return srv->proto == k->proto && strncmp(srv->name, k->name, k->len) == 0
+	   && srv->name[k->len] == '\0' ? TRUE : FALSE;
+}
+
+/*
+ * Find the service having a given name for a protocol
+ */
+static const struct service *find(const char *const name,
+				  const size_t len, const enum proto proto)
+{
+    struct key key;
+
+    key.name = name;
+    key.len = len;
+    key.proto = proto;
+    return (const struct service *) hsh_find(&services,
+					     hash_name(name, len, proto),
+					     same_key, &key);
+}
+
+/*
+ * Add a byte to the hashes of the content of the table
+ */
+static void hash_byte(const unsigned char byte)
+{
+    content1 = HASH_FNV_MIX(content1, byte);
+    content2 = HASH_MIX(content2, byte);
+}
+
+/*
+ * Register a service name; the first one given for a protocol is kept, as
+ * getservbyname() does
+ */
+static enum bool add(const char *const name, const size_t len,
+		     const enum proto proto, const unsigned short port)
+{
+    struct service *srv;
+    size_t i;
+
+    /* What the names resolve to depends on every service given */
+    for (i = 0; i < len; i++)
+	hash_byte((unsigned char) name[i]);
+    hash_byte('\0');
+    hash_byte((unsigned char) proto);
+    hash_byte((unsigned char) (port >> 8));
+    hash_byte((unsigned char) (port & 0xFF));
+
+    if (find(name, len, proto) != NULL)
+	return TRUE;
+
+    if ((srv = malloc(sizeof(struct service) + len)) == NULL)
+	return FALSE;
+    srv->proto = proto;
+    srv->port = port;
+    memcpy(srv->name, name, len);
+    srv->name[len] = '\0';
+    if (hsh_add(&services, &srv->elem, hash_name(name, len, proto))
+	    == FALSE) {
+	free(srv);
+	return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Read the default services file, if no other one has been read
+ */
+static void load_default(void)
+{
+    FILE *in;
+
+    if (loaded == TRUE)
+	return;
+    loaded = TRUE;
+    if ((in = fopen(SERVICES_FILE, "r")) == NULL)
+	return;
+    srv_read(in);
+    fclose(in);
+}
+
+/*
+ * Read the default services file the first time, unless another one was;
+ * the parsing threads may ask at the same time
+ */
+static void check_default(void)
+{
+#if HAVE_PTHREAD_H
+    pthread_mutex_lock(&default_mutex);
+#endif /* HAVE_PTHREAD_H */
+    load_default();
+#if HAVE_PTHREAD_H
+    pthread_mutex_unlock(&default_mutex);
+#endif /* HAVE_PTHREAD_H */
+}
+
+
+/*****************************************************************************
+ *
+ * Global Functions
+ *
+ */
+
+/*
+ * Read a services file: lines made of a name, a port number followed by
+ * "/tcp" or "/udp", and aliases, "#" beginning a comment; return FALSE if
+ * there is not enough memory
+ */
+enum bool srv_read(FILE *const in)
+{
+    char line[LINE_SIZE], *pos, *end;
+    unsigned long port;
+    enum proto proto;
+    size_t len;
+
+    loaded = TRUE;
+    while (fgets(line, sizeof(line), in) != NULL) {
+	/* Skip the rest of a line too long */
+	len = strlen(line);
+	if (len == sizeof(line) - 1 && line[len - 1] != '\n') {
+	    int c;
+
+	    while ((c = getc(in)) != EOF && c != '\n')
+		;
+	}
+	if ((pos = strchr(line, '#')) != NULL)
+	    *pos = '\0';
+
+	/* Port number and protocol, after the name */
+	pos = line + strspn(line, BLANKS);
+	end = pos + strcspn(pos, BLANKS);
+	end += strspn(end, BLANKS);
+	port = strtoul(end, &end, 10);
+	if (port > 0xFFFF || *end++ != '/')
+	    continue;
+	if (strncmp(end, "tcp", 3) == 0)
+	    proto = PROTO_TCP;
+	else if (strncmp(end, "udp", 3) == 0)
+	    proto = PROTO_UDP;
+	else
+	    continue;
+	end += 3;
+	if (*end != '\0' && strchr(BLANKS, *end) == NULL)
+	    continue;
+
+	/* Register the name and its aliases */
+	if (add(pos, strcspn(pos, BLANKS), proto, (unsigned short) port)
+		== FALSE)
+	    return FALSE;
+	for (pos = end + strspn(end, BLANKS); *pos != '\0';
+	     pos += len, pos += strspn(pos, BLANKS))
+	    if (add(pos, len = strcspn(pos, BLANKS), proto,
+		    (unsigned short) port) == FALSE)
+		return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Get the port number of a service for a port condition protocol (the same
+ * one has to be used for TCP and UDP if both are matched); the default
+ * services file is read the first time, unless another one was
+ */
+enum bool srv_find(const char *const name, const enum proto proto,
+		   unsigned short *const number)
+{
+    const struct service *srv;
+
+    check_default();
+    if (proto != PROTO_UDP) {
+	if ((srv = find(name, strlen(name), PROTO_TCP)) == NULL)
+	    return FALSE;
+	*number = srv->port;
+    }
+    if (proto != PROTO_TCP) {
+	if ((srv = find(name, strlen(name), PROTO_UDP)) == NULL
+	    || (proto != PROTO_UDP && srv->port != *number))
+	    return FALSE;
+	*number = srv->port;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Get two independent hashes of the services known, which tell whether the
+ * names would be resolved the same way; the default services file is read
+ * first, unless another one was
+ */
+void srv_hash(unsigned *const hash1, unsigned *const hash2)
+{
+    check_default();
+    *hash1 = (unsigned) content1;
+    *hash2 = (unsigned) content2;
+}
+
+/*
+ * Forget all the services, the default services file being read again when
+ * needed
+ */
+void srv_free(void)
+{
+    hsh_free(&services, TRUE);
+    loaded = FALSE;
+    content1 = HASH_FNV_SEED;
+    content2 = HASH_SEED;
+}
+
+/* End of File */
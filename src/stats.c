@@ -0,0 +1,231 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/stats.c
+ *
+ * Description: Run Statistics
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* ./configure result */
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+/* System headers */
+#include <stdio.h> /* FILE *, fprintf() */
+#include <time.h>  /* clock_gettime(), clock() */
+#if HAVE_SYS_RESOURCE_H
+#include <sys/time.h>     /* struct timeval */
+#include <sys/resource.h> /* getrusage()    */
+#endif /* HAVE_SYS_RESOURCE_H */
+
+/* Local headers */
+#include "structs.h"
+#include "stats.h"
+
+
+/*****************************************************************************
+ *
+ * Local Datatypes and Variables
+ *
+ */
+
+/* Names of the phases and of the counters, as displayed */
+static const char *const phase_names[STA_PHASES] = {
+    "cache", "parse", "link", "dump", "resolve", "optimize", "generate"
+};
+static const char *const counter_names[STA_COUNTERS] = {
+    "files", "bytes", "tokens", "chains", "actions", "tests", "expressions",
+    "conditions", "addresses", "ports", "memory_areas", "memory_bytes",
+    "generated_chains", "generated_rules", "generated_jumps"
+};
+
+/* Time spent in each phase, and beginning of the running ones (only the
+ * main thread begins and ends phases) */
+static double elapsed[STA_PHASES], started[STA_PHASES];
+
+/* Counters */
+static unsigned long counters[STA_COUNTERS];
+
+/* Prototypes */
+static double now(void);
+static void count_action(const struct action *action);
+static void count_expr(const struct expr *expr);
+
+
+/*****************************************************************************
+ *
+ * Global Functions
+ *
+ */
+
+/*
+ * Begin a phase
+ */
+void sta_begin(const enum sta_phase phase)
+{
+    started[phase] = now();
+}
+
+/*
+ * End a phase, adding its duration to the time spent in it
+ */
+void sta_end(const enum sta_phase phase)
+{
+    elapsed[phase] += now() - started[phase];
+}
+
+/*
+ * Add a value to a counter
+ */
+void sta_add(const enum sta_counter counter, const unsigned long value)
+{
+    counters[counter] += value;
+}
+
+/*
+ * Count the nodes of a configuration, by type
+ */
+void sta_config(const struct chain *config)
+{
+    for (; config != NULL; config = config->next) {
+	counters[STA_CHAINS]++;
+	count_action(config->action);
+    }
+}
+
+/*
+ * Write the statistics, human-readable or as a JSON object
+ */
+void sta_write(FILE *const out, const enum bool json)
+{
+    double total = 0.0;
+    long peak = -1;
+    unsigned i;
+#if HAVE_SYS_RESOURCE_H
+    struct rusage usage;
+
+    /* Peak resident size, in kilobytes on most systems */
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+	peak = usage.ru_maxrss;
+#endif /* HAVE_SYS_RESOURCE_H */
+
+    for (i = 0; i < STA_PHASES; i++)
+	total += elapsed[i];
+
+    if (json == TRUE) {
+	fputs("{\n  \"phases\": {\n", out);
+	for (i = 0; i < STA_PHASES; i++)
+	    fprintf(out, "    \"%s\": %.6f,\n", phase_names[i], elapsed[i]);
+	fprintf(out, "    \"total\": %.6f\n  },\n  \"counters\": {\n", total);
+	for (i = 0; i < STA_COUNTERS; i++)
+	    fprintf(out, "    \"%s\": %lu%s\n", counter_names[i], counters[i],
+		    i + 1 < STA_COUNTERS ? "," : "");
+	fprintf(out, "  },\n  \"peak_memory_kb\": %ld\n}\n", peak);
+	return;
+    }
+
+    fputs("Phases (seconds):\n", out);
+    for (i = 0; i < STA_PHASES; i++)
+	fprintf(out, "  %-18s %12.6f\n", phase_names[i], elapsed[i]);
+    fprintf(out, "  %-18s %12.6f\n", "total", total);
+    fputs("Counters:\n", out);
+    for (i = 0; i < STA_COUNTERS; i++)
+	fprintf(out, "  %-18s %12lu\n", counter_names[i], counters[i]);
+    if (peak >= 0)
+	fprintf(out, "Peak memory: %ld KB\n", peak);
+}
+
+
+/*****************************************************************************
+ *
+ * Local Functions
+ *
+ */
+
+/*
+ * Get the current time in seconds, from a monotonic clock if possible
+ * (processor time otherwise)
+ */
+static double now(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif /* CLOCK_MONOTONIC */
+    return (double) clock() / CLOCKS_PER_SEC;
+}
+
+/*
+ * Count the nodes of an action
+ */
+static void count_action(const struct action *const action)
+{
+    counters[STA_ACTIONS]++;
+    if (action->type != TARGET_TEST)
+	return;
+
+    counters[STA_TESTS]++;
+    count_expr(action->action.test->expr);
+    count_action(action->action.test->act_then);
+    count_action(action->action.test->act_else);
+}
+
+/*
+ * Count the nodes of an expression
+ */
+static void count_expr(const struct expr *const expr)
+{
+    const struct addr *addr;
+    const struct port *port;
+
+    counters[STA_EXPRS]++;
+    if (expr->type != EXPR_COND) {
+	count_expr(expr->sub.expr.left);
+	count_expr(expr->sub.expr.right);
+	return;
+    }
+
+    counters[STA_CONDS]++;
+    if (expr->sub.cond->type == COND_ADDR)
+	for (addr = expr->sub.cond->cond.addr; addr != NULL;
+	     addr = addr->next)
+	    counters[STA_ADDRS]++;
+    else
+	for (port = expr->sub.cond->cond.port; port != NULL;
+	     port = port->next)
+	    counters[STA_PORTS]++;
+}
+
+/* End of File */
@@ -0,0 +1,90 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/stats.h
+ *
+ * Description: Run Statistics Header
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/* Process only once */
+#ifndef STATS_H
+#define STATS_H
+
+/* C++ protection */
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* System headers */
+#include <stdio.h> /* FILE * */
+
+/* Timed phases of a run */
+enum sta_phase {
+    STA_CACHE,    /* Compiled configuration cache      */
+    STA_PARSE,    /* Lexing and parsing, includes too  */
+    STA_LINK,     /* Linking the chains of all files   */
+    STA_DUMP,     /* Configuration dump                */
+    STA_RESOLVE,  /* Host name resolution              */
+    STA_OPTIMIZE, /* Expression simplification         */
+    STA_GENERATE, /* IPTables or NFTables generation   */
+    STA_PHASES
+};
+
+/* Counters */
+enum sta_counter {
+    STA_FILES,      /* Parsed files                       */
+    STA_BYTES,      /* Scanned bytes                      */
+    STA_TOKENS,     /* Scanned tokens                     */
+    STA_CHAINS,     /* Chains of the configuration        */
+    STA_ACTIONS,    /* Action nodes                       */
+    STA_TESTS,      /* Test nodes                         */
+    STA_EXPRS,      /* Expression nodes                   */
+    STA_CONDS,      /* Condition nodes                    */
+    STA_ADDRS,      /* Address nodes                      */
+    STA_PORTS,      /* Port nodes                         */
+    STA_AREAS,      /* Allocated memory areas             */
+    STA_ARENA,      /* Bytes reserved by the allocator    */
+    STA_OUT_CHAINS, /* Generated chains                   */
+    STA_OUT_RULES,  /* Generated rules                    */
+    STA_OUT_JUMPS,  /* Generated rules jumping to a chain */
+    STA_COUNTERS
+};
+
+/* Statistics functions */
+void sta_begin(enum sta_phase phase);
+void sta_end(enum sta_phase phase);
+void sta_add(enum sta_counter counter, unsigned long value);
+void sta_config(const struct chain *config);
+void sta_write(FILE *out, enum bool json);
+
+/* C++ protection */
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !STATS_H */
+
+/* End of File */
@@ -37,12 +37,14 @@
 
 /* System headers */
 #include <stdlib.h> /* NULL, free()               */
-#include <string.h> /* strcmp()                   */
-#include <stdio.h>  /* putc(), fputs(), fprintf() */
+#include <string.h> /* strcmp(), strchr()         */
+#include <stdio.h>  /* FILE *, stdout         */
 
 /* Local headers */
-#include "memory.h"
 #include "structs.h"
+#include "memory.h"
+#include "output.h"
+#include "flat.h"
 
 
 /*****************************************************************************
@@ -100,8 +102,9 @@ void free_chain(struct chain *chain)
     if (chain == NULL)
 	return;
 
+    /* Note: strings point inside the input buffers, which are released at
+     * once by free_files() */
     free_chain(chain->next);
-    mem_free(chain->name);
     free_action(chain->action);
 
     mem_free(chain);
@@ -183,7 +186,6 @@ void free_addr(struct addr *addr)
 	return;
 
     free_addr(addr->next);
-    mem_free(addr->string);
 
     mem_free(addr);
 }
@@ -197,13 +199,296 @@ void free_port(struct port *port)
 	return;
 
     free_port(port->next);
-    if (port->type == PORT_NAME)
-	mem_free(port->port.name);
 
     mem_free(port);
 }
 
 
+/*****************************************************************************
+ *
+ * Comparison Functions
+ *
+ */
+
+/* Local functions */
+static unsigned long hash_condition(const struct condition *condition);
+static enum bool equal_condition(const struct condition *a,
+				 const struct condition *b);
+
+/*
+ * Add a string to a hash value
+ */
+unsigned long hash_string(unsigned long hash, const char *string)
+{
+    while (*string != '\0')
+	hash = HASH_MIX(hash, (unsigned char) *string++);
+
+    return hash;
+}
+
+/*
+ * Compute the hash value of a condition structure
+ */
+static unsigned long hash_condition(const struct condition *const condition)
+{
+    unsigned long hash = HASH_SEED;
+    const struct addr *addr;
+    const struct port *port;
+
+    hash = HASH_MIX(hash, condition->type);
+    hash = HASH_MIX(hash, condition->dir);
+    hash = HASH_MIX(hash, condition->proto);
+
+    switch (condition->type) {
+    case COND_ADDR:
+	for (addr = condition->cond.addr; addr != NULL; addr = addr->next)
+	    hash = hash_string(HASH_MIX(hash, ','), addr->string);
+	break;
+
+    case COND_PORT:
+	for (port = condition->cond.port; port != NULL; port = port->next)
+	    if (port->type == PORT_NAME)
+		hash = hash_string(HASH_MIX(hash, ','), port->port.name);
+	    else {
+		hash = HASH_MIX(hash, port->port.range.from);
+		hash = HASH_MIX(hash, port->port.range.to);
+	    }
+    }
+
+    return hash;
+}
+
+/*
+ * Compute the hash value of an action structure
+ */
+unsigned long hash_action(const struct action *const action)
+{
+    unsigned long hash = HASH_MIX(HASH_SEED, action->type);
+
+    switch (action->type) {
+    case TARGET_FINAL:
+	return HASH_MIX(hash, action->action.final);
+
+    case TARGET_USER:
+	return hash_string(hash, action->action.user->name);
+
+    case TARGET_TEST:
+	hash = HASH_MIX(hash, hash_expr(action->action.test->expr));
+	hash = HASH_MIX(hash, hash_action(action->action.test->act_then));
+	return HASH_MIX(hash, hash_action(action->action.test->act_else));
+    }
+
+    return hash;
+}
+
+/*
+ * Compute the hash value of an expr structure
+ */
+unsigned long hash_expr(const struct expr *const expr)
+{
+    unsigned long hash = HASH_MIX(HASH_SEED, expr->type);
+
+    hash = HASH_MIX(hash, expr->not);
+    if (expr->type == EXPR_COND)
+	return HASH_MIX(hash, hash_condition(expr->sub.cond));
+
+    hash = HASH_MIX(hash, hash_expr(expr->sub.expr.left));
+    return HASH_MIX(hash, hash_expr(expr->sub.expr.right));
+}
+
+/*
+ * Check if two action structures are identical
+ */
+enum bool equal_action(const struct action *const a,
+		       const struct action *const b)
+{
+    if (a == b)
+	return TRUE;
+    if (a->type != b->type)
+	return FALSE;
+
+    switch (a->type) {
+    case TARGET_FINAL:
+	return a->action.final == b->action.final ? TRUE : FALSE;
+
+    case TARGET_USER:
+	return a->action.user == b->action.user ? TRUE : FALSE;
+
+    case TARGET_TEST:
+	return equal_expr(a->action.test->expr, b->action.test->expr)
+	       && equal_action(a->action.test->act_then,
+			       b->action.test->act_then)
+	       && equal_action(a->action.test->act_else,
+			       b->action.test->act_else) ? TRUE : FALSE;
+    }
+
+    return FALSE;
+}
+
+/*
+ * Check if two expr structures are identical
+ */
+enum bool equal_expr(const struct expr *const a, const struct expr *const b)
+{
+    if (a == b)
+	return TRUE;
+    if (a->type != b->type || a->not != b->not)
+	return FALSE;
+
+    if (a->type == EXPR_COND)
+	return equal_condition(a->sub.cond, b->sub.cond);
+
+    return equal_expr(a->sub.expr.left, b->sub.expr.left)
+	   && equal_expr(a->sub.expr.right, b->sub.expr.right) ? TRUE : FALSE;
+}
+
+/*
+ * Check if two condition structures are identical (including the order of
+ * the list elements)
+ */
+static enum bool equal_condition(const struct condition *const a,
+				 const struct condition *const b)
+{
+    const struct addr *addr_a, *addr_b;
+    const struct port *port_a, *port_b;
+
+    if (a->type != b->type || a->dir != b->dir || a->proto != b->proto)
+	return FALSE;
+
+    switch (a->type) {
+    case COND_ADDR:
+	for (addr_a = a->cond.addr, addr_b = b->cond.addr;
+	     addr_a != NULL && addr_b != NULL;
+	     addr_a = addr_a->next, addr_b = addr_b->next)
+	    if (strcmp(addr_a->string, addr_b->string) != 0)
+		return FALSE;
+	return addr_a == addr_b ? TRUE : FALSE;
+
+    case COND_PORT:
+	for (port_a = a->cond.port, port_b = b->cond.port;
+	     port_a != NULL && port_b != NULL;
+	     port_a = port_a->next, port_b = port_b->next) {
+	    if (port_a->type != port_b->type)
+		return FALSE;
+	    if (port_a->type == PORT_NAME) {
+		if (strcmp(port_a->port.name, port_b->port.name) != 0)
+		    return FALSE;
+	    } else if (port_a->port.range.from != port_b->port.range.from
+		       || port_a->port.range.to != port_b->port.range.to)
+		return FALSE;
+	}
+	return port_a == port_b ? TRUE : FALSE;
+    }
+
+    return FALSE;
+}
+
+
+/*****************************************************************************
+ *
+ * Conversion Functions
+ *
+ */
+
+/*
+ * Parse a decimal number between 0 and max, returning the first character
+ * following it, or NULL if there is no valid number
+ */
+static const char *parse_number(const char *string, const unsigned long max,
+				unsigned long *const number)
+{
+    unsigned long value = 0;
+    unsigned digits = 0;
+
+    while (*string >= '0' && *string <= '9') {
+	value = value * 10 + (unsigned long) (*string++ - '0');
+	if (++digits > 3 || value > max)
+	    return NULL;
+    }
+
+    *number = value;
+    return digits == 0 ? NULL : string;
+}
+
+/*
+ * Parse a (possibly partial) dotted-quad IPv4 address; missing trailing
+ * bytes are zero, as with IPTables ("130.79.6" is 130.79.6.0)
+ */
+static const char *parse_ipv4(const char *string, unsigned long *const addr)
+{
+    unsigned long byte;
+    unsigned nb = 0;
+
+    *addr = 0;
+    for (;;) {
+	if ((string = parse_number(string, 255UL, &byte)) == NULL)
+	    return NULL;
+	*addr |= byte << (24 - 8 * nb++);
+
+	if (*string != '.' || nb == 4)
+	    return string;
+	string++;
+    }
+}
+
+/*
+ * Convert a numeric address to a network prefix; host names and
+ * non-contiguous masks cannot be converted and make this function fail
+ */
+enum bool addr_to_prefix(const struct addr *const addr,
+			 struct prefix *const prefix)
+{
+    return string_to_prefix(addr->string, prefix);
+}
+
+/*
+ * Convert the text of a numeric address to a network prefix, see
+ * addr_to_prefix()
+ */
+enum bool string_to_prefix(const char *string, struct prefix *const prefix)
+{
+    unsigned long mask, len;
+
+    if ((string = parse_ipv4(string, &prefix->net)) == NULL)
+	return FALSE;
+
+    switch (*string) {
+    case '\0':
+	/* Host address */
+	prefix->len = 32;
+	return TRUE;
+
+    case '/':
+	break;
+
+    default:
+	/* Probably a host name */
+	return FALSE;
+    }
+
+    /* Get the mask, either as a bit count or as a dotted-quad address */
+    if (strchr(++string, '.') == NULL) {
+	if ((string = parse_number(string, 32UL, &len)) == NULL)
+	    return FALSE;
+    } else {
+	if ((string = parse_ipv4(string, &mask)) == NULL)
+	    return FALSE;
+	for (len = 0; len < 32 && (mask & (0x80000000UL >> len)) != 0; len++)
+	    ;
+	if (len < 32 && (mask & (0xFFFFFFFFUL >> len)) != 0)
+	    return FALSE;
+    }
+    if (*string != '\0')
+	return FALSE;
+
+    /* Keep only the network part of the address */
+    prefix->len = (unsigned) len;
+    if (len < 32)
+	prefix->net &= ~(0xFFFFFFFFUL >> len) & 0xFFFFFFFFUL;
+    return TRUE;
+}
+
+
 /*****************************************************************************
  *
  * Dumping Functions
@@ -211,193 +496,208 @@ void free_port(struct port *port)
  */
 
 /* Local functions */
-static void dump_chain(const struct chain *chain, unsigned depth);
-static void dump_action(const struct action *action, unsigned depth);
-static void dump_test(const struct test *test, unsigned depth);
-static void dump_test_2(const struct test *test, unsigned depth);
-static void dump_expr(const struct expr *expr, unsigned depth);
-static void dump_condition(const struct condition *condition);
-static void dump_addr(const struct addr *addr);
-static void dump_one_addr(const struct addr *addr);
-static void dump_port(const struct port *port);
-static void dump_one_port(const struct port *port);
+static void dump_chain(unsigned chain, unsigned depth);
+static void dump_action(unsigned action, unsigned depth);
+static void dump_test(unsigned test, unsigned depth);
+static void dump_test_2(unsigned test, unsigned depth);
+static void dump_expr(unsigned expr, unsigned depth);
+static void dump_condition(const struct flat_cond *condition);
+static void dump_one_addr(const struct flat_cond *condition, unsigned i);
+static void dump_one_port(const struct flat_cond *condition, unsigned i);
 
 /* Local variables */
-static FILE *out_file;          /* The file where tu output the dump    */
+static struct out_sink output;  /* The file where tu output the dump    */
 static const char *line_prefix; /* What to display in front of lines    */
 static enum bool use_colors;    /* Wether to display the dump in colors */
+static const struct flat *flat; /* Configuration being dumped           */
 
 /*
  * Prefix and indent an output line
  */
 static void indent(unsigned depth)
 {
-    fputs(line_prefix, out_file);
-
-    depth *= INDENT_SPACES;
-    while (depth-- != 0)
-	putc(' ', out_file);
+    out_str(&output, line_prefix);
+    out_fill(&output, ' ', depth * INDENT_SPACES);
 }
 
 /*
- * Dump a full configuration
+ * Dump a full configuration; return FALSE if it could not be written
  */
-void dump_config(const struct chain *chain, FILE *const file,
-		 const char *const prefix, const enum bool comment,
-		 const enum bool colors)
+enum bool dump_config(const struct flat *const config, FILE *const file,
+		      const char *const prefix, const enum bool comment,
+		      const enum bool colors)
 {
-    out_file = file == NULL ? stdout : file;
+    unsigned chain;
+    enum bool written;
+
+    out_open(&output, file == NULL ? stdout : file);
     line_prefix = prefix == NULL ? "" : prefix;
     use_colors = colors;
+    flat = config;
 
     if (comment) {
 	indent(0U);
-	fputs(CD(COLOR_COMMENT "// Configuration dump generated by RuleWall"
-		 COLOR_RESET "\n", "// Configuration dump generated by "
-		 "RuleWall\n"), out_file);
+	out_str(&output, CD(COLOR_COMMENT "// Configuration dump generated by "
+			    "RuleWall" COLOR_RESET "\n", "// Configuration "
+			    "dump generated by RuleWall\n"));
 	indent(0U);
-	putc('\n', out_file);
+	out_char(&output, '\n');
     }
 
-    dump_chain(chain, 0U);
-    while ((chain = chain->next) != NULL) {
-	indent(0U);
-	putc('\n', out_file);
+    for (chain = 0; chain < flat->nb_chains; chain++) {
+	if (chain != 0) {
+	    indent(0U);
+	    out_char(&output, '\n');
+	}
 	dump_chain(chain, 0U);
     }
 
-    out_file = stdout;
+    written = out_close(&output);
     line_prefix = "";
     use_colors = FALSE;
+    flat = NULL;
+    return written;
 }
 
 /*
- * Dump a chain structure
+ * Dump a chain
  */
-static void dump_chain(const struct chain *const chain, const unsigned depth)
+static void dump_chain(const unsigned chain, const unsigned depth)
 {
     indent(depth);
-    fprintf(out_file, CD(COLOR_CHAIN "%s" COLOR_RESET " "
-			 COLOR_OPERATOR "=" COLOR_RESET "\n", "%s =\n"),
-	    chain->name);
+    out_strs(&output, CD(COLOR_CHAIN, ""), FLAT_NAME(flat, chain),
+	     CD(COLOR_RESET " " COLOR_OPERATOR "=" COLOR_RESET "\n", " =\n"),
+	     NULL);
 
-    dump_action(chain->action, depth + 1);
+    dump_action(FLAT_CHAIN(flat, chain)->action, depth + 1);
     indent(depth);
-    fputs(CD(COLOR_OPERATOR ";" COLOR_RESET "\n", ";\n"), out_file);
+    out_str(&output, CD(COLOR_OPERATOR ";" COLOR_RESET "\n", ";\n"));
 }
 
 /*
- * Dump an action structure
+ * Dump an action
  */
-static void dump_action(const struct action *const action,
-			const unsigned depth)
+static void dump_action(const unsigned action, const unsigned depth)
 {
-    switch (action->type) {
+    const struct flat_action *const node = FLAT_ACTION(flat, action);
+
+    switch (node->type) {
     case TARGET_FINAL:
 	indent(depth);
-	switch (action->action.final) {
+	switch (node->value) {
 	case FINAL_ACCEPT:
-	    fputs(CD(COLOR_FINAL "accept" COLOR_RESET "\n", "accept\n"),
-		  out_file);
+	    out_str(&output,
+		    CD(COLOR_FINAL "accept" COLOR_RESET "\n", "accept\n"));
 	    break;
 
 	case FINAL_DROP:
-	    fputs(CD(COLOR_FINAL "drop" COLOR_RESET "\n", "drop\n"),
-		  out_file);
+	    out_str(&output,
+		    CD(COLOR_FINAL "drop" COLOR_RESET "\n", "drop\n"));
 	    break;
 
 	case FINAL_REJECT:
-	    fputs(CD(COLOR_FINAL "reject" COLOR_RESET "\n", "reject\n"),
-		  out_file);
+	    out_str(&output,
+		    CD(COLOR_FINAL "reject" COLOR_RESET "\n", "reject\n"));
 	}
 	break;
 
     case TARGET_USER:
 	indent(depth);
-	fprintf(out_file, CD(COLOR_CHAIN "%s" COLOR_RESET "\n", "%s\n"),
-		action->action.user->name);
+	out_strs(&output, CD(COLOR_CHAIN, ""), FLAT_NAME(flat, node->value),
+		 CD(COLOR_RESET "\n", "\n"), NULL);
 	break;
 
     case TARGET_TEST:
-	dump_test(action->action.test, depth);
+	dump_test(node->value, depth);
     }
 }
 
 /*
- * Dump a test structure
+ * Dump a test
  */
-static void dump_test(const struct test *const test, const unsigned depth)
+static void dump_test(const unsigned test, const unsigned depth)
 {
     indent(depth);
     dump_test_2(test, depth);
 }
 
 /*
- * Dump a test structure, without indenting the first "if" (used to dieplay
- * "else if" on a single line)
+ * Dump a test, without indenting the first "if" (used to dieplay "else if"
+ * on a single line)
  */
-static void dump_test_2(const struct test *const test, const unsigned depth)
+static void dump_test_2(const unsigned test, const unsigned depth)
 {
-    fputs(CD(COLOR_KEYWORD "if" COLOR_RESET "\n", "if\n"), out_file);
-    dump_expr(test->expr, depth + 1);
+    const struct flat_test *const node = FLAT_TEST(flat, test);
+    const struct flat_action *const act_else
+	    = FLAT_ACTION(flat, node->act_else);
+
+    out_str(&output, CD(COLOR_KEYWORD "if" COLOR_RESET "\n", "if\n"));
+    dump_expr(node->expr, depth + 1);
 
     indent(depth);
-    fputs(CD(COLOR_KEYWORD "then" COLOR_RESET "\n", "then\n"), out_file);
-    dump_action(test->act_then, depth + 1);
+    out_str(&output, CD(COLOR_KEYWORD "then" COLOR_RESET "\n", "then\n"));
+    dump_action(node->act_then, depth + 1);
 
     indent(depth);
-    fputs(CD(COLOR_KEYWORD "else" COLOR_RESET, "else"), out_file);
-    if (test->act_else->type == TARGET_TEST) {
-	putc(' ', out_file);
-	dump_test_2(test->act_else->action.test, depth);
+    out_str(&output, CD(COLOR_KEYWORD "else" COLOR_RESET, "else"));
+    if (act_else->type == TARGET_TEST) {
+	out_char(&output, ' ');
+	dump_test_2(act_else->value, depth);
     } else {
-	putc('\n', out_file);
-	dump_action(test->act_else, depth + 1);
+	out_char(&output, '\n');
+	dump_action(node->act_else, depth + 1);
     }
 }
 
 /*
- * Dump an expr structure
+ * Dump an expression
  */
-static void dump_expr(const struct expr *const expr, const unsigned depth)
+static void dump_expr(const unsigned expr, const unsigned depth)
 {
+    const struct flat_expr *const node = FLAT_EXPR(flat, expr);
+
     indent(depth);
-    if (expr->not == TRUE)
-	fputs(CD(COLOR_OPERATOR "!" COLOR_RESET " ", "! "), out_file);
+    if (node->not == TRUE)
+	out_str(&output, CD(COLOR_OPERATOR "!" COLOR_RESET " ", "! "));
 
-    if (expr->type == EXPR_COND)
-	dump_condition(expr->sub.cond);
+    if (node->type == EXPR_COND)
+	dump_condition(FLAT_COND(flat, node->left));
     else {
-	fputs(CD(COLOR_OPERATOR "(" COLOR_RESET "\n", "(\n"), out_file);
+	out_str(&output, CD(COLOR_OPERATOR "(" COLOR_RESET "\n", "(\n"));
 
-	dump_expr(expr->sub.expr.left, depth + 1);
+	dump_expr(node->left, depth + 1);
 
 	indent(depth);
-	switch (expr->type) {
+	switch (node->type) {
 	case EXPR_AND:
-	    fputs(CD(COLOR_OPERATOR "&&" COLOR_RESET "\n", "&&\n"), out_file);
+	    out_str(&output,
+		    CD(COLOR_OPERATOR "&&" COLOR_RESET "\n", "&&\n"));
 	    break;
 
 	case EXPR_OR:
-	    fputs(CD(COLOR_OPERATOR "||" COLOR_RESET "\n", "||\n"), out_file);
+	    out_str(&output,
+		    CD(COLOR_OPERATOR "||" COLOR_RESET "\n", "||\n"));
 
 	default:
 	    break;
 	}
 
-	dump_expr(expr->sub.expr.right, depth + 1);
+	dump_expr(node->right, depth + 1);
 
 	indent(depth);
-	fputs(CD(COLOR_OPERATOR ")" COLOR_RESET "\n", ")\n"), out_file);
+	out_str(&output, CD(COLOR_OPERATOR ")" COLOR_RESET "\n", ")\n"));
     }
 }
 
 /*
- * Dump a condition structure
+ * Dump a condition, its list between braces if it has several elements
  */
-static void dump_condition(const struct condition *const condition)
+static void dump_condition(const struct flat_cond *const condition)
 {
+    void (*const dump_one)(const struct flat_cond *, unsigned)
+	    = condition->type == COND_ADDR ? dump_one_addr : dump_one_port;
     const char *dir;
+    unsigned i;
     static const char *const protos[] =
 	    {"ip", "ipv4", "ipv6", "port", "tcp", "udp"};
 
@@ -418,83 +718,53 @@ static void dump_condition(const struct condition *const condition)
 	dir = "";
     }
 
-    fprintf(out_file, CD(COLOR_PROTO "%s" COLOR_RESET "%s ", "%s%s "),
-	    protos[condition->proto], dir);
-
-    switch (condition->type) {
-    case COND_ADDR:
-	dump_addr(condition->cond.addr);
-	break;
+    out_strs(&output, CD(COLOR_PROTO, ""), protos[condition->proto],
+	     CD(COLOR_RESET, ""), dir, " ", NULL);
 
-    case COND_PORT:
-	dump_port(condition->cond.port);
-	break;
-    }
-
-    putc('\n', out_file);
-}
-
-/*
- * Dump an addr structure
- */
-static void dump_addr(const struct addr *addr)
-{
-    if (addr->next == NULL)
-	dump_one_addr(addr);
+    if (condition->nb == 1)
+	dump_one(condition, 0);
     else {
-	fputs(CD(COLOR_OPERATOR "{" COLOR_RESET " ", "{ "), out_file);
-	dump_one_addr(addr);
-	while ((addr = addr->next) != NULL) {
-	    fputs(CD(COLOR_OPERATOR "," COLOR_RESET " ", ", "), out_file);
-	    dump_one_addr(addr);
+	out_str(&output, CD(COLOR_OPERATOR "{" COLOR_RESET " ", "{ "));
+	dump_one(condition, 0);
+	for (i = 1; i < condition->nb; i++) {
+	    out_str(&output, CD(COLOR_OPERATOR "," COLOR_RESET " ", ", "));
+	    dump_one(condition, i);
 	}
-	fputs(CD(" " COLOR_OPERATOR "}" COLOR_RESET, " }"), out_file);
+	out_str(&output, CD(" " COLOR_OPERATOR "}" COLOR_RESET, " }"));
     }
-}
 
-/*
- * Dump a one_addr structure
- */
-static void dump_one_addr(const struct addr *const addr)
-{
-    fprintf(out_file, CD(COLOR_HOST "%s" COLOR_RESET, "%s"), addr->string);
+    out_char(&output, '\n');
 }
 
 /*
- * Dump a port structure
+ * Dump an address of a condition
  */
-static void dump_port(const struct port *port)
+static void dump_one_addr(const struct flat_cond *const condition,
+			  const unsigned i)
 {
-    if (port->next == NULL)
-	dump_one_port(port);
-    else {
-	fputs(CD(COLOR_OPERATOR "{" COLOR_RESET " ", "{ "), out_file);
-	dump_one_port(port);
-	while ((port = port->next) != NULL) {
-	    fputs(CD(COLOR_OPERATOR "," COLOR_RESET " ", ", "), out_file);
-	    dump_one_port(port);
-	}
-	fputs(CD(" " COLOR_OPERATOR "}" COLOR_RESET, " }"), out_file);
-    }
+    out_strs(&output, CD(COLOR_HOST, ""), FLAT_ADDR(flat, condition, i),
+	     CD(COLOR_RESET, ""), NULL);
 }
 
 /*
- * Dump a one_port structure
+ * Dump a port of a condition
  */
-static void dump_one_port(const struct port *const port)
+static void dump_one_port(const struct flat_cond *const condition,
+			  const unsigned i)
 {
-    fputs(CD(COLOR_PORT, ""), out_file);
-    switch (port->type) {
-    case PORT_NUMERIC:
-	fprintf(out_file, "%u", (unsigned) port->port.range.from);
-	if (port->port.range.to != port->port.range.from)
-	    fprintf(out_file, "-%u", (unsigned) port->port.range.to);
-	break;
+    const struct flat_port *const port = FLAT_PORT(flat, condition, i);
 
-    case PORT_NAME:
-	fputs(port->port.name, out_file);
+    out_str(&output, CD(COLOR_PORT, ""));
+    if (port->name != FLAT_NONE)
+	out_str(&output, FLAT_STRING(flat, port->name));
+    else {
+	out_number(&output, (unsigned long) port->range.from);
+	if (port->range.to != port->range.from) {
+	    out_char(&output, '-');
+	    out_number(&output, (unsigned long) port->range.to);
+	}
     }
-    fputs(CD(COLOR_RESET, ""), out_file);
+    out_str(&output, CD(COLOR_RESET, ""));
 }
 
 /* End of File */
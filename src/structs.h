@@ -68,6 +68,31 @@ enum direction { DIR_BOTH, DIR_SRC, DIR_DST };
 /* A port range */
 struct one_port { unsigned short from, to; };
 
+/* An IPv4 network prefix (address in host byte order) */
+struct prefix { unsigned long net; unsigned len; };
+
+/* Source ID of a node: the index of its file among the parsed ones (see
+ * get_source()) and its line, 0 if unknown; the parser sets the line only,
+ * the file being added once all the files are known; a file index too large
+ * for the 32 - SRC_LINE_BITS remaining bits makes the source unknown */
+#define SRC_LINE_BITS 20
+#define SRC_LINE_MAX  0xFFFFFU
+#define SRC_FILE_MAX  0xFFEU
+#define SRC_ID(file, line) ((unsigned) (file) > SRC_FILE_MAX ? 0U \
+			    : (((unsigned) (file) + 1) << SRC_LINE_BITS) \
+			      | ((unsigned) (line) & SRC_LINE_MAX))
+#define SRC_FILE(src) (((src) >> SRC_LINE_BITS) - 1)
+#define SRC_LINE(src) ((src) & SRC_LINE_MAX)
+
+/* Hash functions on 32 bits: Bernstein to look things up, and FNV-1a to get
+ * a second hash value independent of the first one */
+#define HASH_SEED     5381UL
+#define HASH_FNV_SEED 2166136261UL
+#define HASH_MIX(hash, value) \
+	(((hash) * 33 + (unsigned long) (value)) & 0xFFFFFFFFUL)
+#define HASH_FNV_MIX(hash, value) \
+	((((hash) ^ (unsigned long) (value)) * 16777619UL) & 0xFFFFFFFFUL)
+
 
 /*
  * Custom types: structures
@@ -78,6 +103,7 @@ struct chain {
     struct chain *next;    /* Next chain (linked list) */
     char *name;            /* Chain name               */
     struct action *action; /* Associated action        */
+    unsigned src;          /* Source ID                */
 };
 
 /* Action */
@@ -88,12 +114,14 @@ struct action {
 	const struct chain *user;  /* User-defined chain */
 	struct test        *test;  /* Test (conditions)  */
     } action;
+    unsigned src; /* Source ID */
 };
 
 /* Test */
 struct test {
     struct expr *expr;                  /* Associated test expression */
     struct action *act_then, *act_else; /* Taken actions              */
+    unsigned src;                       /* Source ID                  */
 };
 
 /* Expression */
@@ -106,6 +134,7 @@ struct expr {
 	} expr;
 	struct condition *cond; /* Condition */
     } sub;
+    unsigned src;        /* Source ID                            */
 };
 
 /* Condition */
@@ -117,6 +146,7 @@ struct condition {
 	struct addr *addr; /* Host address    */
 	struct port *port; /* Port (TCP, UDP) */
     } cond;
+    unsigned src;        /* Source ID          */
 };
 
 /* Host address */
@@ -144,10 +174,35 @@ extern void free_condition(struct condition *condition);
 extern void free_addr(struct addr *addr);
 extern void free_port(struct port *port);
 
-/* Dumping functions */
-extern void dump_config(const struct chain *chain, FILE *file,
-			const char *prefix, enum bool comment,
-			enum bool colors);
+/* Comparison functions */
+extern unsigned long hash_string(unsigned long hash, const char *string);
+extern unsigned long hash_action(const struct action *action);
+extern unsigned long hash_expr(const struct expr *expr);
+extern enum bool equal_action(const struct action *a,
+			      const struct action *b);
+extern enum bool equal_expr(const struct expr *a, const struct expr *b);
+
+/* Conversion functions */
+extern enum bool addr_to_prefix(const struct addr *addr,
+				struct prefix *prefix);
+extern enum bool string_to_prefix(const char *string,
+				  struct prefix *prefix);
+
+/* Dumping functions (the configuration being flattened, see flat.h) */
+struct flat;
+extern enum bool dump_config(const struct flat *config, FILE *file,
+			     const char *prefix, enum bool comment,
+			     enum bool colors);
+
+/* Parsing functions (defined in loader.c) */
+extern struct chain *parse_files(const char *const *names, unsigned nb);
+extern struct chain *parse_config(const char *filename);
+extern enum bool list_files(enum bool (*func)(const char *name,
+					      void *data),
+			    void *data);
+extern void free_files(void);
+extern const char *get_source(unsigned file);
+extern enum bool set_sources(const char *const *names, unsigned nb);
 
 /* C++ protection */
 #ifdef __cplusplus
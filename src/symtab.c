@@ -0,0 +1,127 @@
+/* ---------------------------------------------------------------------------
+ *
+ * RuleWall: A Firewall Configuration Parser
+ * Copyright (C) 2006 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/symtab.c
+ *
+ * Description: Chain Symbol Table
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* System headers */
+#include <stdlib.h> /* NULL, malloc(), free() */
+#include <string.h> /* strcmp()               */
+
+/* Local headers */
+#include "structs.h"
+#include "hashtab.h"
+#include "symtab.h"
+
+
+/*****************************************************************************
+ *
+ * Local Datatypes and Variables
+ *
+ */
+
+/* Symbol (element of the hash table) */
+struct symbol {
+    struct hsh_elem elem;      /* Hash table element */
+    const struct chain *chain; /* Associated chain   */
+};
+
+/* Hash table */
+static struct hsh_table symbols = { NULL, 0, 0 };
+
+
+/*****************************************************************************
+ *
+ * Local Functions
+ *
+ */
+
+/*
+ * Check if a symbol has a given name
+ */
+static enum bool has_name(const struct hsh_elem *const elem,
+			  const void *const name)
+{
+    return strcmp(((const struct symbol *) elem)->chain->name,
+		  (const char *) name) == 0 ? TRUE : FALSE;
+}
+
+
+/*****************************************************************************
+ *
+ * Global Functions
+ *
+ */
+
+/*
+ * Find a chain structure corresponding to its associated name
+ */
+const struct chain *sym_find(const char *const name)
+{
+    const struct symbol *const sym
+	    = (const struct symbol *) hsh_find(&symbols,
+					       hash_string(HASH_SEED, name),
+					       has_name, name);
+
+    return sym != NULL ? sym->chain : NULL;
+}
+
+/*
+ * Register a newly defined chain; return FALSE if there is not enough memory
+ */
+enum bool sym_add(const struct chain *const chain)
+{
+    struct symbol *sym;
+
+    if ((sym = malloc(sizeof(struct symbol))) == NULL)
+	return FALSE;
+    sym->chain = chain;
+    if (hsh_add(&symbols, &sym->elem, hash_string(HASH_SEED, chain->name))
+	    == FALSE) {
+	free(sym);
+	return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Forget all the symbols
+ */
+void sym_free(void)
+{
+    hsh_free(&symbols, TRUE);
+}
+
+/* End of File */